@@ -4,23 +4,27 @@
 #include <memory>
 #include <string>
 #include <iostream>
-#include <cassert>
 #include <vector>
+#include <algorithm>
+#include <cstddef>
 #include "sbt.hpp"
+#include "ir.hpp"
 
 using namespace std;
 // 不能全局声明变量和函数！！！
 
-// 全局临时变量使用记录
-static bool global_t_id[1024];
-// 跳过不可达代码段的字符串内记号（该记号之后的部分不会输出到IR）
-static const string SKIP_UNREACHABLE = "`";
+// 当前函数中下一个临时变量的序号：每个函数从0开始单调递增，每个临时变量只定义一次（SSA）
+static int32_t next_t_id = 0;
 
 // 是否启用调试信息（cerr输出AST结构）
 static bool debugMode = true;
-static int branch_cnt = 0;  // 还有未跳转出去的块吗？（用于某些没有分支控制的ret语句）
-static bool block_end = false; // 基本块是否结束的标记
 static int basic_block_tag_id = 0;
+// 当前所在的循环（由内到外入栈），每项为{条件块, 循环体块, 出口块}的标签，供break/continue使用
+static vector<vector<string>> loop_tags;
+// 已定义的函数：函数名 -> {是否无返回值, 形参个数}，调用时检查
+static unordered_map<string, pair<bool, size_t>> func_table;
+// 当前函数是否无返回值（决定return;和函数末尾补上的ret）
+static bool cur_func_void = false;
 // 分配tag_cnt个全局基本块标签（用于分支、循环、跳转语句）
 static vector<string> alloc_basic_block_tags(int tag_cnt)
 {
@@ -35,48 +39,119 @@ static vector<string> alloc_basic_block_tags(int tag_cnt)
     return result;
 }
 
-// 输出块末的jump，如果已经遇到了ret，就不用输出
+// 输出块末的jump
+// 前面如果已经遇到ret，ret之后会开启一个新的（不可达）基本块，jump落在其中，由优化器删除
 static string get_block_end_ir(const vector<string> &tags, int index)
 {
-    // 前面已经遇到ret语句了，因此没有必要再输出jump
-    if (block_end)
-    {
-        block_end = false; // ret语句已过
-        return "\n\n";
-    }
-    block_end = true;
     return "jump " + tags[index] + "\n\n";
 }
+// AST节点池：节点按创建顺序连续存放在大块内存中，从不单独释放，程序结束时整体交还系统
+// 每条语句有十几个节点，逐个malloc的块头开销和碎片比节点本身还大；析构函数照常运行，只是不回收内存
+// 批量/服务模式下一个作业的AST析构后reset，已分配的块留给下一个作业
+class ASTPool
+{
+public:
+    void *alloc(size_t size)
+    {
+        size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+        if (size > (size_t)(end - cur))
+        {
+            // 上一块剩余的空间不再使用，先复用之前的作业留下的足够大的块
+            while (next < chunks.size() && chunks[next].second < size)
+                ++next;
+            if (next == chunks.size())
+            {
+                size_t chunk = max(size, CHUNK_SIZE);
+                chunks.emplace_back(new char[chunk], chunk);
+            }
+            cur = chunks[next].first;
+            end = cur + chunks[next].second;
+            ++next;
+        }
+        void *p = cur;
+        cur += size;
+        return p;
+    }
+
+    // 分配的位置，release回退到mark时的位置，之后分配的节点必须都已析构
+    class Mark
+    {
+    public:
+        char *cur = nullptr, *end = nullptr;
+        size_t next = 0;
+    };
+    Mark mark() const { return {cur, end, next}; }
+    void release(const Mark &m)
+    {
+        cur = m.cur;
+        end = m.end;
+        next = m.next;
+    }
+    void reset() { release(Mark()); }
+
+private:
+    static constexpr size_t CHUNK_SIZE = 1 << 20;
+    char *cur = nullptr, *end = nullptr;
+    vector<pair<char *, size_t>> chunks; // 所有的块及其大小
+    size_t next = 0;                     // 下一个可以使用的块
+};
+static ASTPool ast_pool;
+
 // 所有 AST 的基类
 class BaseAST
 {
 public:
+    static void *operator new(size_t size) { return ast_pool.alloc(size); }
+    static void operator delete(void *) {}
+
     // 继承属性
-    int32_t depth = 0; // AST树深度（根节点深度为0）
-    int t_type;        // 【表达式】计算结果的类型
-    int blockId;       // 块ID
+    int32_t depth = 0;   // AST树深度（根节点深度为0）
+    int t_type = INT_VT; // 【表达式】计算结果的类型
+    int blockId;         // 块ID
 
     // 综合属性
     int32_t t_id = -1; // 【表达式】计算结果的变量名序号
     // 【可优化】如果一个式子规约到出现第一条IR时，此后无需再计算t_val值，除非想优化
-    string r_val;         // 【表达式】计算结果的右值，主要是因为部分指令对值没有影响，因此需要通过它来继承
+    int32_t c_val = 0;    // 【表达式】isConst时编译期算出的值（32位回绕），部分指令对值没有影响，因此需要通过它来继承
     bool isConst = false; // 是否为常量或字面量，可以进行【常量合并】优化
     string ident;         //  【变量/常量名】
 
     virtual ~BaseAST() = default;
     // Dump translates the AST into Koopa IR string
     virtual string Dump() = 0;
+    // 作为条件输出：成立时跳转到true_tag，否则跳转到false_tag（输出以br或jump结束）
+    // 默认先求值再分支，&&和||重写为短路求值的分支
+    // 条件在编译期可以确定时isConst为真，c_val为条件的值，调用者可以直接舍弃分支
+    virtual string DumpCond(const string &true_tag, const string &false_tag)
+    {
+        string s = Dump();
+        s += loadIfisPointer();
+        if (isConst)
+            s += ("jump " + (c_val ? true_tag : false_tag) + "\n\n");
+        else
+            s += ("br " + get_val_if_possible() + ", " + true_tag + ", " + false_tag + "\n\n");
+        return s;
+    }
 
-    // 同步子节点的综合属性：t_id r_val t_type isConst isRet
+    // 同步子节点的综合属性：t_id c_val t_type isConst isRet
     inline void syncProps(const unique_ptr<BaseAST> &child)
     {
         t_id = child->t_id;
-        r_val = child->r_val;
+        c_val = child->c_val;
         t_type = child->t_type;
         isConst = child->isConst;
         ident = child->ident;
     }
 
+    // 两个操作数都是常量时在编译期计算（32位回绕，与优化器的常量折叠相同），结果存入c_val
+    // 除数为0等无法计算的情况不折叠，isConst为假，留到运行时计算
+    inline void foldConst(const string &koopa_op, const unique_ptr<BaseAST> &lhs, const unique_ptr<BaseAST> &rhs)
+    {
+        IRBinOp op;
+        isConst = lhs->isConst && rhs->isConst && getBinOpByName(koopa_op, op) &&
+                  foldBinOp(op, lhs->c_val, rhs->c_val, c_val);
+    }
+
     // 输出AST
     void debug(const string &nodeName, const unique_ptr<BaseAST> &child)
     {
@@ -91,25 +166,10 @@ public:
         cerr << nodeName << endl;
     }
 
-    // 从全局t_id分配新的t_id给当前节点
-    void alloc_ref()
-    {
-        for (size_t i = 0; i < 1024; ++i)
-        {
-            if (!global_t_id[i])
-            {
-                t_id = i;
-                global_t_id[i] = true;
-                return;
-            }
-        }
-    }
-    // 释放（尽可能用少的t_id，减少寄存器浪费空间）
-    inline void free_ref(int32_t t_id)
+    // 分配当前函数中新的t_id给当前节点
+    inline void alloc_ref()
     {
-        if (t_id == -1)
-            return;
-        global_t_id[t_id] = false;
+        t_id = next_t_id++;
     }
 
     // 获取引用名（常作为左值）
@@ -121,13 +181,18 @@ public:
     // 若为常量或字面量，返回值；否则返回临时变量名ref
     inline string get_val_if_possible()
     {
+        if (t_type == VOID_VT)
+        {
+            cerr << "Syntax Error: void function used as value\n";
+            throw CompileError();
+        }
         // 常量直接返回
         if (isConst)
-            return r_val;
+            return to_string(c_val);
         if (t_id == -1)
         {
             cerr << "Unallocated pointer...\n";
-            assert(false);
+            throw CompileError();
         }
         // 都不是，只能返回临时缓冲内容
         return get_ref();
@@ -147,6 +212,52 @@ public:
         return "";
     }
 
+    // if语句的条件为常量时只输出会执行的分支，不需要标签和跳转
+    // 不执行的分支照常Dump（类型检查、作用域分析），但丢弃生成的IR
+    string fold_const_branch(const unique_ptr<BaseAST> &cond, const unique_ptr<BaseAST> &then_stmt,
+                             const unique_ptr<BaseAST> &else_stmt)
+    {
+        bool taken = cond->c_val != 0;
+        string then_ir = then_stmt->Dump();
+        string else_ir = else_stmt ? else_stmt->Dump() : "";
+        return taken ? then_ir : else_ir;
+    }
+
+    // while循环：条件块在循环体之前，循环体末尾跳回条件块
+    //   jump %cond; %cond: br exp, %body, %end; %body: ...; jump %cond; %end:
+    string dump_while(const unique_ptr<BaseAST> &cond, const unique_ptr<BaseAST> &body)
+    {
+        vector<string> tags = alloc_basic_block_tags(3);
+        string s = "jump " + tags[0] + "\n\n";
+        s += (tags[0] + ":\n");
+        s += cond->DumpCond(tags[1], tags[2]);
+        // 条件恒为假时循环体不会执行，只做分析
+        bool skip = cond->isConst && !cond->c_val;
+        s += (tags[1] + ":\n");
+        loop_tags.push_back(tags);
+        string body_ir = body->Dump();
+        loop_tags.pop_back();
+        if (skip)
+            return "";
+        s += body_ir;
+        s += ("jump " + tags[0] + "\n\n");
+        s += (tags[2] + ":\n");
+        return s;
+    }
+
+    // break/continue：跳到最内层循环的出口/条件块，之后的语句放入新的（不可达）基本块
+    string dump_loop_jump(int tag_index, const string &keyword)
+    {
+        if (loop_tags.empty())
+        {
+            cerr << "Syntax Error: " << keyword << " statement not within a loop\n";
+            throw CompileError();
+        }
+        string s = "jump " + loop_tags.back()[tag_index] + "\n\n";
+        s += (alloc_basic_block_tags(1)[0] + ":\n");
+        return s;
+    }
+
     string get_koopa_op(string op)
     {
         if (op == "*")
@@ -171,7 +282,7 @@ public:
             return "eq";
         else if (op == "!=")
             return "ne";
-        assert(false);
+        throw CompileError();
     }
 };
 
@@ -179,17 +290,44 @@ class CompUnitAST : public BaseAST
 {
 public:
     // 用智能指针管理对象
-    unique_ptr<BaseAST> func_def;
+    unique_ptr<BaseAST> func_defs;
 
-    string Dump() override
+    // 整个编译单元开始翻译前的初始化（流水线模式下在第一个函数翻译前调用）
+    static void beginUnit()
     {
         initTypeHash();
         initBlockHash();
         initTypeSBT();
+    }
+
+    string Dump() override
+    {
+        beginUnit();
         depth = 0;
-        debug("comp_unit", func_def);
-        string s = func_def->Dump();
-        return s.substr(0, s.find_first_of(SKIP_UNREACHABLE));  // 不可达部分不需要输出
+        debug("comp_unit", func_defs);
+        func_defs->blockId = 0;
+        return func_defs->Dump();
+    }
+};
+
+class FuncDefsAST : public BaseAST
+{
+public:
+    vector<unique_ptr<BaseAST>> func_defs; // 按源码顺序收集，不再是左递归的链
+
+    string Dump() override
+    {
+        // 层次不会加深，故不用debug
+        string s;
+        for (size_t i = 0; i < func_defs.size(); ++i)
+        {
+            func_defs[i]->depth = depth;
+            func_defs[i]->blockId = blockId;
+            if (i)
+                s += "\n\n";
+            s += func_defs[i]->Dump();
+        }
+        return s;
     }
 };
 
@@ -220,7 +358,7 @@ public:
             syncProps(var_decl);
             break;
         default:
-            assert(false);
+            throw CompileError();
         }
         return s;
     }
@@ -251,29 +389,18 @@ public:
 class ConstDefsAST : public BaseAST
 {
 public:
-    int selection;
-    unique_ptr<BaseAST> const_defs;
-    unique_ptr<BaseAST> const_def;
+    vector<unique_ptr<BaseAST>> const_defs;
 
     string Dump() override
     {
-        debug("const_defs", const_def);
         isConst = false; // 定义语句不是右值
         string s;
-        switch (selection)
+        for (auto &const_def : const_defs)
         {
-        case 1:
-            const_defs->t_type = const_def->t_type = t_type; // 继承（父->子）
-            const_defs->blockId = const_def->blockId = blockId;
-            s = const_defs->Dump() + const_def->Dump();
-            break;
-        case 2:
+            debug("const_defs", const_def);
             const_def->t_type = t_type; // 继承（父->子）
             const_def->blockId = blockId;
-            s = const_def->Dump();
-            break;
-        default:
-            assert(false);
+            s += const_def->Dump();
         }
         return s;
     }
@@ -307,7 +434,12 @@ public:
         const_init_val->t_type = t_type; // 继承（父->子）
         const_init_val->blockId = blockId;
         s = const_init_val->Dump();
-        addConstToSBT(blockId, ident, atoi(const_init_val->r_val.data())); // t_type已经从父亲那里继承
+        if (!const_init_val->isConst)
+        {
+            cerr << "Semantic Error: initializer of const " << ident << " is not a constant expression\n";
+            throw CompileError();
+        }
+        addConstToSBT(blockId, ident, const_init_val->c_val); // t_type已经从父亲那里继承
         // 常量本质上和字面量没有区别，可以直接参与运算
         syncProps(const_init_val);
         return s;
@@ -353,29 +485,18 @@ public:
 class VarDefsAST : public BaseAST
 {
 public:
-    int selection;
-    unique_ptr<BaseAST> var_defs;
-    unique_ptr<BaseAST> var_def;
+    vector<unique_ptr<BaseAST>> var_defs;
 
     string Dump() override
     {
-        debug("var_defs", var_def);
         isConst = false; // 定义语句不是右值
         string s;
-        switch (selection)
+        for (auto &var_def : var_defs)
         {
-        case 1:
-            var_defs->t_type = var_def->t_type = t_type; // 继承（父->子）
-            var_defs->blockId = var_def->blockId = blockId;
-            s = var_defs->Dump() + var_def->Dump();
-            break;
-        case 2:
+            debug("var_defs", var_def);
             var_def->t_type = t_type; // 继承（父->子）
             var_def->blockId = blockId;
-            s = var_def->Dump();
-            break;
-        default:
-            assert(false);
+            s += var_def->Dump();
         }
         return s;
     }
@@ -402,41 +523,96 @@ public:
         {
             debug("var_def", init_val);
             init_val->blockId = blockId;
-            s += (init_val->Dump() + init_val->loadIfisPointer());
+            s += init_val->Dump();
+            s += init_val->loadIfisPointer();
             s += ("store " + init_val->get_val_if_possible() + ", @" + ident + "\n");
         }
         return s;
     }
 };
 
-// 初始化值
-class InitValAST : public BaseAST
+// 形参列表：Dump输出形参的alloc/store，params按顺序记录形参名
+class FuncFParamsAST : public BaseAST
 {
 public:
-    unique_ptr<BaseAST> exp;
+    vector<unique_ptr<BaseAST>> func_f_params;
+    vector<string> params;
 
     string Dump() override
     {
-        debug("init_val", exp);
-        exp->blockId = blockId;
-        string s = exp->Dump();
-        syncProps(exp);
+        string s;
+        for (auto &func_f_param : func_f_params)
+        {
+            debug("func_f_params", func_f_param);
+            func_f_param->blockId = blockId;
+            s += func_f_param->Dump();
+            params.push_back(func_f_param->ident);
+        }
         return s;
     }
 };
 
+// 形参：和局部变量一样分配在栈上，进入函数时写入实参的值，此后按变量访问
+class FuncFParamAST : public BaseAST
+{
+public:
+    unique_ptr<BaseAST> b_type;
+
+    string Dump() override
+    {
+        debug("func_f_param", b_type);
+        b_type->blockId = blockId;
+        b_type->Dump();
+        string name_id = getNameId(blockId, ident);
+        addVarToSBT(blockId, name_id);
+        return "@" + name_id + " = alloc i32\nstore %arg_" + ident + ", @" + name_id + "\n";
+    }
+};
+
 class FuncDefAST : public BaseAST
 {
 public:
-    unique_ptr<BaseAST> func_type; // 返回值类型
-    unique_ptr<BaseAST> block;     // 函数体
+    unique_ptr<BaseAST> func_type;     // 返回值类型
+    unique_ptr<BaseAST> func_f_params; // 形参列表（无参数时为空）
+    unique_ptr<BaseAST> block;         // 函数体
 
     string Dump() override
     {
         debug("func_def", func_type);
         debug("func_def", block);
-        block->blockId = blockId; // 父块的id传下去（C语言中，由于不允许嵌套函数，所以FuncDef->blockId = 0）
-        string s = "fun @" + ident + "(): " + func_type->Dump() + " {\n%entry:\n" + block->Dump() + "}";
+        string ret_type = func_type->Dump();
+        cur_func_void = ret_type.empty();
+        next_t_id = 0; // 临时变量名只需在函数内唯一
+        // 形参在函数体外层单独的块中，函数体可以声明同名变量遮蔽形参
+        // 父块的id传下去（C语言中，由于不允许嵌套函数，所以FuncDef->blockId = 0）
+        int param_block = alloc_block_id(blockId);
+        string param_ir;
+        vector<string> params;
+        if (func_f_params)
+        {
+            func_f_params->blockId = param_block;
+            param_ir = func_f_params->Dump();
+            params = static_cast<FuncFParamsAST *>(func_f_params.get())->params;
+        }
+        // 先登记函数再翻译函数体，函数体中可以递归调用自身
+        if (func_table.count(ident))
+        {
+            cerr << "Syntax Error: Function Redefined " << ident << endl;
+            throw CompileError();
+        }
+        func_table[ident] = {cur_func_void, params.size()};
+
+        string s = "fun @" + ident + "(";
+        for (size_t i = 0; i < params.size(); ++i)
+            s += (i ? ", %arg_" : "%arg_") + params[i] + ": i32";
+        s += ")";
+        if (!cur_func_void)
+            s += ": " + ret_type;
+        s += " {\n%entry:\n" + param_ir;
+        block->blockId = param_block;
+        s += block->Dump();
+        // 末尾的块可能没有ret（控制流走到函数末尾），补上返回；若该块不可达会被优化器删除
+        s += cur_func_void ? "ret\n}" : "ret 0\n}";
         return s;
     }
 };
@@ -479,26 +655,17 @@ public:
 class BlockItemsAST : public BaseAST
 {
 public:
-    int selection;
-    unique_ptr<BaseAST> block_item;
-    unique_ptr<BaseAST> block_items;
+    vector<unique_ptr<BaseAST>> block_items; // 块中的语句按顺序逐个翻译，递归深度与语句数无关
 
     string Dump() override
     {
         // 层次不会加深，故不用debug
         string s;
-        switch (selection)
+        for (auto &block_item : block_items)
         {
-        case 1:
-            block_items->blockId = block_item->blockId = blockId; // 父->子
-            s = block_items->Dump() + block_item->Dump();
-            break;
-        case 2:
+            block_item->depth = depth;
             block_item->blockId = blockId; // 父->子
-            s = block_item->Dump();
-            break;
-        default:
-            assert(false);
+            s += block_item->Dump();
         }
         return s;
     }
@@ -530,7 +697,7 @@ public:
             syncProps(stmt);
             break;
         default:
-            assert(false);
+            throw CompileError();
         }
         return s;
     }
@@ -558,7 +725,6 @@ public:
     unique_ptr<BaseAST> l_val;
     unique_ptr<BaseAST> exp;
     unique_ptr<BaseAST> block;
-    unique_ptr<BaseAST> lorExp;
     unique_ptr<BaseAST> ms;
     unique_ptr<BaseAST> else_ms;
 
@@ -579,12 +745,13 @@ public:
             if (l_val->isConst)
             {
                 cerr << "Syntax Error: Const val isn't a left val!\n";
-                assert(false);
+                throw CompileError();
             }
             // 变量赋值语句
             else
             {
-                s += exp->Dump() + exp->loadIfisPointer();                          // 计算右值的结果
+                s += exp->Dump(); // 计算右值的结果
+                s += exp->loadIfisPointer();
                 s += ("store " + exp->get_val_if_possible() + ", @" + l_id + "\n"); // 注意要赋值给左值变量标签
             }
             break;
@@ -599,38 +766,60 @@ public:
         // IF '(' Exp ')' ms ELSE else_ms
         case 4:
             exp->blockId = ms->blockId = else_ms->blockId = blockId;
-            s = exp->Dump(); // 判断条件
             tags = alloc_basic_block_tags(3);
-            ++branch_cnt;
-            if (exp->t_id == -1 && !exp->isConst)
+            s = exp->DumpCond(tags[0], tags[1]); // 判断条件，直接跳转到两个分支
+            // 条件为常量：只输出会执行的分支，另一个分支仍要做类型检查和作用域分析，但丢弃生成的IR
+            if (exp->isConst)
             {
-                exp->alloc_ref();
-                s += (exp->get_ref() + " = load @" + exp->ident + "\n"); // 对于exp为store指令的，由于没有返回值，要先加载到临时变量中
+                s = fold_const_branch(exp, ms, else_ms);
+                break;
             }
-            s += ("br " + exp->get_val_if_possible() + ", " + tags[0] + ", " + tags[1] + "\n\n");
-            block_end = false;      // 新块开始
             s += (tags[0] + ":\n"); // exp 为真的基本块
-            s += (ms->Dump() + get_block_end_ir(tags, 2));
-            block_end = false;      // 新块开始
+            s += ms->Dump();
+            s += get_block_end_ir(tags, 2);
             s += (tags[1] + ":\n"); // exp 为假的基本块
-            s += (else_ms->Dump() + get_block_end_ir(tags, 2));
-            block_end = false;      // 新块开始
+            s += else_ms->Dump();
+            s += get_block_end_ir(tags, 2);
             s += (tags[2] + ":\n"); // 退出分支语句的基本块
-            --branch_cnt;
             break;
         case 5:
+            if (cur_func_void)
+            {
+                cerr << "Syntax Error: void function returns a value\n";
+                throw CompileError();
+            }
             exp->blockId = blockId; // 父->子
             s = exp->Dump();
             // 返回的符号若为变量指针，则需要
             s += exp->loadIfisPointer();
             s += ("ret " + exp->get_val_if_possible() + "\n"); // 指令行
-            block_end = true;
-            // 如果ret不处于任何分支，那么此后不应该输出任何语句
-            if(!branch_cnt) {
-                s += ("}" + SKIP_UNREACHABLE);
+            // ret之后的语句放到新的基本块中（不可达，由优化器删除）
+            s += ("\n" + alloc_basic_block_tags(1)[0] + ":\n");
+            break;
+        // WHILE '(' Exp ')' ms
+        case 6:
+            exp->blockId = ms->blockId = blockId;
+            s = dump_while(exp, ms);
+            break;
+        // BREAK ';'
+        case 7:
+            s = dump_loop_jump(2, "break");
+            break;
+        // CONTINUE ';'
+        case 8:
+            s = dump_loop_jump(0, "continue");
+            break;
+        // RETURN ';'
+        case 9:
+            if (!cur_func_void)
+            {
+                cerr << "Syntax Error: int function returns without a value\n";
+                throw CompileError();
             }
+            s = "ret\n";
+            s += ("\n" + alloc_basic_block_tags(1)[0] + ":\n");
             break;
-        default: // 对应只有;的空语句或return ;
+        default: // 对应只有;的空语句
             s = "";
         }
         return s;
@@ -657,90 +846,44 @@ public:
         // IF '(' Exp ')' MS ELSE UMS
         case 1:
             exp->blockId = ms->blockId = ums->blockId = blockId;
-            s = exp->Dump(); // 判断条件
             tags = alloc_basic_block_tags(3);
-            ++branch_cnt;
-            if (exp->t_id == -1 && !exp->isConst)
+            s = exp->DumpCond(tags[0], tags[1]); // 判断条件，直接跳转到两个分支
+            if (exp->isConst)
             {
-                exp->alloc_ref();
-                s += (exp->get_ref() + " = load @" + exp->ident + "\n"); // 对于exp为store指令的，由于没有返回值，要先加载到临时变量中
+                s = fold_const_branch(exp, ms, ums);
+                break;
             }
-            s += ("br " + exp->get_val_if_possible() + ", " + tags[0] + ", " + tags[1] + "\n\n");
-            block_end = false;      // 新块开始
             s += (tags[0] + ":\n"); // exp 为真的基本块
-            s += (ms->Dump() + get_block_end_ir(tags, 2));
-            block_end = false;      // 新块开始
+            s += ms->Dump();
+            s += get_block_end_ir(tags, 2);
             s += (tags[1] + ":\n"); // exp 为假的基本块
-            s += (ums->Dump() + get_block_end_ir(tags, 2));
-            block_end = false;      // 新块开始
+            s += ums->Dump();
+            s += get_block_end_ir(tags, 2);
             s += (tags[2] + ":\n"); // 退出分支语句的基本块
-            --branch_cnt;
             break;
         // IF '(' Exp ')' Stmt
         case 2:
             exp->blockId = stmt->blockId = blockId;
-            s = exp->Dump();
             tags = alloc_basic_block_tags(2);
-            ++branch_cnt;
-            if (exp->t_id == -1 && !exp->isConst)
+            s = exp->DumpCond(tags[0], tags[1]);
+            if (exp->isConst)
             {
-                exp->alloc_ref();
-                s += (exp->get_ref() + " = load @" + exp->ident + "\n"); // 对于exp为store指令的，由于没有返回值，要先加载到临时变量中
+                s = fold_const_branch(exp, stmt, nullptr);
+                break;
             }
-            s += ("br " + exp->get_val_if_possible() + ", " + tags[0] + ", " + tags[1] + "\n\n");
-            block_end = false;      // 新块开始
             s += (tags[0] + ":\n"); // exp 为真的基本块
-            s += (stmt->Dump() + get_block_end_ir(tags, 1));
-            block_end = false;      // 新块开始
+            s += stmt->Dump();
+            s += get_block_end_ir(tags, 1);
             s += (tags[1] + ":\n"); // exp为假/退出分支语句的基本块
-            --branch_cnt;
             break;
-        default:
-            cerr << "Parsing Error in: UMS\n";
-            assert(false);
-        }
-        return s;
-    }
-};
-
-// 狭义表达式（一元、二元）
-class ExpAST : public BaseAST
-{
-public:
-    // 表示选择了哪个产生式
-    int selection;
-    // unique_ptr<BaseAST> unaryExp; // 一元表达式
-    // unique_ptr<BaseAST> addExp;   // 加法表达式
-    unique_ptr<BaseAST> lorExp;
-
-    string Dump() override
-    {
-
-        string s;
-        switch (selection)
-        {
-        // case 1:
-        //     unaryExp->depth = depth + 1;
-        //     // 值不发生改变，因此原样复制
-        //     s = unaryExp->Dump();
-        //     syncProps(unaryExp);
-        //     break;
-        // case 2:
-        //     addExp->depth = depth + 1;
-        //     // 值不发生改变，因此原样复制
-        //     s = addExp->Dump();
-        //     syncProps(addExp);
-        //     break;
+        // WHILE '(' Exp ')' UMS
         case 3:
-            debug("exp", lorExp);
-            lorExp->blockId = blockId; // 父->子
-            lorExp->depth = depth + 1;
-            // 值不发生改变，因此原样复制
-            s = lorExp->Dump();
-            syncProps(lorExp);
+            exp->blockId = ums->blockId = blockId;
+            s = dump_while(exp, ums);
             break;
         default:
-            assert(false);
+            cerr << "Parsing Error in: UMS\n";
+            throw CompileError();
         }
         return s;
     }
@@ -759,54 +902,46 @@ public:
         isConst = node.isConst; //  判断是否为常量，如果是，则可以在规约时合并常量
         if (isConst)
         {
-            stringstream ss;
-            ss << node.const_val;
-            r_val = ss.str();
-            cerr << "r_val = " << r_val << endl;
+            c_val = node.const_val;
+            cerr << "c_val = " << c_val << endl;
         }
         return "";
     }
 };
 
-// 主表达式（一元、二元、整数）
+// 主表达式：整数字面量（括号表达式和左值在语法分析时直接使用子节点）
 class PrimaryExpAST : public BaseAST
 {
 public:
-    // 表示选择了哪个产生式
-    int selection;
-    // 产生式1
-    unique_ptr<BaseAST> exp; // 表达式
-    // 产生式2
-    unique_ptr<BaseAST> l_val;
-    // 产生式3
     uint32_t number; // 整数
 
     string Dump() override
     {
-        string s = "";
-        switch (selection)
+        t_id = -1;
+        c_val = (int32_t)number; // 2147483648只能作为-2147483648出现，按32位回绕
+        t_type = INT_VT;
+        isConst = true; // 字面量（整型）是右值
+        return "";
+    }
+};
+
+// 函数调用的实参：Dump输出各实参的求值，vals按顺序记录实参的值
+class FuncRParamsAST : public BaseAST
+{
+public:
+    vector<unique_ptr<BaseAST>> exps;
+    vector<string> vals;
+
+    string Dump() override
+    {
+        string s;
+        for (auto &exp : exps)
         {
-        case 1:
-            debug("primary", exp);
-            exp->blockId = blockId; // 父->子
-            s = exp->Dump();
-            syncProps(exp);
-            break;
-        case 2:
-            debug("primary", l_val);
-            l_val->blockId = blockId; // 父->子
-            s = l_val->Dump();
-            syncProps(l_val);
-            break;
-        case 3:
-            t_id = -1;
-            r_val = to_string(number);
-            t_type = INT_VT;
-            isConst = true; // 字面量（整型）是右值
-            break;
-        default:
-            cerr << "Parsing Error in: PrimaryExp:=(Exp)|Number\n";
-            assert(false);
+            debug("func_r_params", exp);
+            exp->blockId = blockId;
+            s += exp->Dump();
+            s += exp->loadIfisPointer();
+            vals.push_back(exp->get_val_if_possible());
         }
         return s;
     }
@@ -816,25 +951,20 @@ public:
 class UnaryExpAST : public BaseAST
 {
 public:
-    // 表示选择了哪个产生式
+    // 表示选择了哪个产生式（主表达式在语法分析时直接使用子节点，不经过一元表达式）
     int selection;
-    // 产生式1
-    unique_ptr<BaseAST> primaryExp; // 表达式
     // 产生式2
     string unaryOp;               // 一元算符
     unique_ptr<BaseAST> unaryExp; // 一元表达式
+    // 产生式3
+    string callee;                     // 被调函数名
+    unique_ptr<BaseAST> func_r_params; // 实参（无参数时为空）
 
     string Dump() override
     {
         string s;
         switch (selection)
         {
-        case 1:
-            debug("unary", primaryExp);
-            primaryExp->blockId = blockId; // 父->子
-            s = primaryExp->Dump();
-            syncProps(primaryExp);
-            break;
         case 2:
             debug("unary", unaryExp);
             unaryExp->blockId = blockId; // 父->子
@@ -843,49 +973,87 @@ public:
             {
                 if (!unaryExp->isConst)
                 {
+                    s += unaryExp->loadIfisPointer();
                     alloc_ref(); // 分配新临时变量
-                    s = s + unaryExp->loadIfisPointer() + get_ref() + " = eq " + unaryExp->get_val_if_possible() + ", 0\n";
+                    s += get_ref() + " = eq " + unaryExp->get_val_if_possible() + ", 0\n";
                 }
-                r_val = to_string(!atoi(unaryExp->r_val.data()));
+                c_val = !unaryExp->c_val;
             }
             else if (unaryOp == "-")
             {
                 if (!unaryExp->isConst)
                 {
+                    s += unaryExp->loadIfisPointer();
                     alloc_ref(); // 分配新临时变量
-                    s = s + unaryExp->loadIfisPointer() + get_ref() + " = sub 0, " + unaryExp->get_val_if_possible() + "\n";
+                    s += get_ref() + " = sub 0, " + unaryExp->get_val_if_possible() + "\n";
                 }
-                r_val = to_string(-atoi(unaryExp->r_val.data()));
+                c_val = (int32_t)(0u - (uint32_t)unaryExp->c_val);
             }
             else if (unaryOp == "+") // 不产生新指令，照搬之前的指令
             {
-                t_id = unaryExp->t_id;
-                r_val = unaryExp->r_val;
+                syncProps(unaryExp); // 子表达式可能是尚未load的变量，ident也要一并继承
             }
             else
             {
                 cerr << "Parsing Error: Undefined unary op: " << unaryOp << endl;
-                assert(false);
+                throw CompileError();
             }
             isConst = unaryExp->isConst;
             t_type = unaryExp->t_type;
             break;
+        case 3:
+            debug("unary", func_r_params);
+            s = dump_call();
+            break;
         default:
-            cerr << "Parsing Error: in UnaryExp:=PrimaryExp|UnaryOp UnaryExp\n";
-            assert(false);
+            cerr << "Parsing Error: in UnaryExp:=UnaryOp UnaryExp|IDENT '(' FuncRParams ')'\n";
+            throw CompileError();
         }
         return s;
     }
+
+    // 函数调用：先依次求出实参，有返回值时结果存入新的临时变量
+    string dump_call()
+    {
+        auto it = func_table.find(callee);
+        if (it == func_table.end())
+        {
+            cerr << "Syntax Error: Function Undefined " << callee << endl;
+            throw CompileError();
+        }
+        string s;
+        vector<string> vals;
+        if (func_r_params)
+        {
+            func_r_params->blockId = blockId;
+            s = func_r_params->Dump();
+            vals = static_cast<FuncRParamsAST *>(func_r_params.get())->vals;
+        }
+        if (vals.size() != it->second.second)
+        {
+            cerr << "Syntax Error: Wrong number of arguments to " << callee << endl;
+            throw CompileError();
+        }
+        string call = "call @" + callee + "(";
+        for (size_t i = 0; i < vals.size(); ++i)
+            call += (i ? ", " : "") + vals[i];
+        call += ")\n";
+        isConst = false;
+        if (it->second.first)
+        {
+            t_type = VOID_VT; // 无返回值，作为值使用时在get_val_if_possible中报错
+            return s + call;
+        }
+        t_type = INT_VT;
+        alloc_ref();
+        return s + get_ref() + " = " + call;
+    }
 };
 
 class MulExpAST : public BaseAST
 {
 public:
-    // 表示选择了哪个产生式
-    int selection;
-    // 产生式1
     unique_ptr<BaseAST> unaryExp; // 一元表达式
-    // 产生式2
     string mulop; // 多元算符
     unique_ptr<BaseAST> mulExp;
 
@@ -893,48 +1061,22 @@ public:
     {
         debug("mul", unaryExp);
         string s, s1;
-        switch (selection)
+        debug("mul", mulExp);
+        mulExp->blockId = unaryExp->blockId = blockId;       // 父->子
+        s = mulExp->Dump();      // 先求出多元式（左结合）
+        s += mulExp->loadIfisPointer();
+        s1 = unaryExp->Dump(); // 然后求出一元式
+        s1 += unaryExp->loadIfisPointer();
+        foldConst(get_koopa_op(mulop), mulExp, unaryExp); // 仅当两个右值的运算结果才是右值
+        t_type = mulExp->t_type;                             // 没有考虑类型转换和检查
+        if (!isConst)
         {
-        case 1:
-            // 值不发生改变，因此原样复制
-            unaryExp->blockId = blockId; // 父->子
-            s = unaryExp->Dump();
-            syncProps(unaryExp);
-            break;
-        case 2:
-            debug("mul", mulExp);
-            mulExp->blockId = unaryExp->blockId = blockId;       // 父->子
-            s = mulExp->Dump() + mulExp->loadIfisPointer();      // 先求出多元式（左结合）
-            s1 = unaryExp->Dump() + unaryExp->loadIfisPointer(); // 然后求出一元式
-            isConst = mulExp->isConst & unaryExp->isConst;       // 仅当两个右值的运算结果才是右值
-            t_type = mulExp->t_type;                             // 没有考虑类型转换和检查
-            if (!isConst)
-            {
-                alloc_ref(); // 分配新临时变量
+            alloc_ref(); // 分配新临时变量
 
-                s = s + s1 +
-                    get_ref() + " = " + get_koopa_op(mulop) + " " +
-                    mulExp->get_val_if_possible() + ", " +
-                    unaryExp->get_val_if_possible() + "\n";
-            }
-            else // 是右值类型才能计算出结果
-            {
-                if (mulop == "*")
-                {
-                    r_val = to_string(atoi(mulExp->r_val.data()) * atoi(unaryExp->r_val.data()));
-                }
-                else if (mulop == "/")
-                {
-                    r_val = to_string(atoi(mulExp->r_val.data()) / atoi(unaryExp->r_val.data()));
-                }
-                else if (mulop == "%")
-                {
-                    r_val = to_string(atoi(mulExp->r_val.data()) % atoi(unaryExp->r_val.data()));
-                }
-            }
-            break;
-        default:
-            assert(false);
+            s = s + s1 +
+                get_ref() + " = " + get_koopa_op(mulop) + " " +
+                mulExp->get_val_if_possible() + ", " +
+                unaryExp->get_val_if_possible() + "\n";
         }
         return s;
     }
@@ -943,11 +1085,7 @@ public:
 class AddExpAST : public BaseAST
 {
 public:
-    // 表示选择了哪个产生式
-    int selection;
-    // 产生式1
     unique_ptr<BaseAST> mulExp;
-    // 产生式2
     string mulop; // 多元算符
     unique_ptr<BaseAST> addExp;
 
@@ -955,44 +1093,22 @@ public:
     {
         debug("add", mulExp);
         string s, s1;
-        switch (selection)
+        debug("add", addExp);
+        addExp->blockId = mulExp->blockId = blockId; // 父->子
+        s = addExp->Dump();
+        s += addExp->loadIfisPointer();
+        s1 = mulExp->Dump();
+        s1 += mulExp->loadIfisPointer();
+        foldConst(get_koopa_op(mulop), addExp, mulExp); // 仅当两个右值的运算结果才是右值
+        t_type = addExp->t_type;                     // 没有考虑类型转换和检查
+
+        if (!isConst)
         {
-        case 1:
-            // 值不发生改变，因此原样复制
-            mulExp->blockId = blockId; // 父->子
-            s = mulExp->Dump();
-            syncProps(mulExp);
-            break;
-        case 2:
-            debug("add", addExp);
-            addExp->blockId = mulExp->blockId = blockId; // 父->子
-            s = addExp->Dump() + addExp->loadIfisPointer();
-            s1 = mulExp->Dump() + mulExp->loadIfisPointer();
-            isConst = addExp->isConst & mulExp->isConst; // 仅当两个右值的运算结果才是右值
-            t_type = addExp->t_type;                     // 没有考虑类型转换和检查
-
-            if (!isConst)
-            {
-                alloc_ref();
-                s = s + s1 +
-                    get_ref() + " = " + get_koopa_op(mulop) + " " +
-                    addExp->get_val_if_possible() + ", " +
-                    mulExp->get_val_if_possible() + "\n";
-            }
-            else
-            {
-                if (mulop == "+")
-                {
-                    r_val = to_string(atoi(addExp->r_val.data()) + atoi(mulExp->r_val.data()));
-                }
-                else if (mulop == "-")
-                {
-                    r_val = to_string(atoi(addExp->r_val.data()) - atoi(mulExp->r_val.data()));
-                }
-            }
-            break;
-        default:
-            assert(false);
+            alloc_ref();
+            s = s + s1 +
+                get_ref() + " = " + get_koopa_op(mulop) + " " +
+                addExp->get_val_if_possible() + ", " +
+                mulExp->get_val_if_possible() + "\n";
         }
         return s;
     }
@@ -1001,11 +1117,7 @@ public:
 class RelExpAST : public BaseAST
 {
 public:
-    // 表示选择了哪个产生式
-    int selection;
-    // 产生式1
     unique_ptr<BaseAST> addExp;
-    // 产生式2
     unique_ptr<BaseAST> relExp;
     string relop;
 
@@ -1013,52 +1125,22 @@ public:
     {
         debug("rel", addExp);
         string s, s1;
-        switch (selection)
+        debug("rel", relExp);
+        relExp->blockId = addExp->blockId = blockId; // 父->子
+        s = relExp->Dump();
+        s += relExp->loadIfisPointer();
+        s1 = addExp->Dump();
+        s1 += addExp->loadIfisPointer();
+        foldConst(get_koopa_op(relop), relExp, addExp); // 仅当两个右值的运算结果才是右值
+        t_type = relExp->t_type;                     // 没有考虑类型转换和检查
+
+        if (!isConst)
         {
-        case 1:
-            // 值不发生改变，因此原样复制
-            addExp->blockId = blockId; // 父->子
-            s = addExp->Dump();
-            syncProps(addExp);
-            break;
-        case 2:
-            debug("rel", relExp);
-            relExp->blockId = addExp->blockId = blockId; // 父->子
-            s = relExp->Dump() + relExp->loadIfisPointer();
-            s1 = addExp->Dump() + addExp->loadIfisPointer();
-            isConst = relExp->isConst & addExp->isConst; // 仅当两个右值的运算结果才是右值
-            t_type = relExp->t_type;                     // 没有考虑类型转换和检查
-
-            if (!isConst)
-            {
-                alloc_ref();
-                s = s + s1 +
-                    get_ref() + " = " + get_koopa_op(relop) + " " +
-                    relExp->get_val_if_possible() + ", " +
-                    addExp->get_val_if_possible() + "\n";
-            }
-            else
-            {
-                if (relop == ">")
-                {
-                    r_val = to_string(atoi(relExp->r_val.data()) > atoi(addExp->r_val.data()));
-                }
-                else if (relop == "<")
-                {
-                    r_val = to_string(atoi(relExp->r_val.data()) < atoi(addExp->r_val.data()));
-                }
-                else if (relop == ">=")
-                {
-                    r_val = to_string(atoi(relExp->r_val.data()) >= atoi(addExp->r_val.data()));
-                }
-                else if (relop == "<=")
-                {
-                    r_val = to_string(atoi(relExp->r_val.data()) <= atoi(addExp->r_val.data()));
-                }
-            }
-            break;
-        default:
-            assert(false);
+            alloc_ref();
+            s = s + s1 +
+                get_ref() + " = " + get_koopa_op(relop) + " " +
+                relExp->get_val_if_possible() + ", " +
+                addExp->get_val_if_possible() + "\n";
         }
         return s;
     }
@@ -1067,11 +1149,7 @@ public:
 class EqExpAST : public BaseAST
 {
 public:
-    // 表示选择了哪个产生式
-    int selection;
-    // 产生式1
     unique_ptr<BaseAST> relExp;
-    // 产生式2
     unique_ptr<BaseAST> eqExp;
     string eqop;
 
@@ -1079,44 +1157,21 @@ public:
     {
         debug("eq", relExp);
         string s, s1;
-        switch (selection)
+        debug("eq", eqExp);
+        eqExp->blockId = relExp->blockId = blockId; // 父->子
+        s = eqExp->Dump();
+        s += eqExp->loadIfisPointer();
+        s1 = relExp->Dump();
+        s1 += relExp->loadIfisPointer();
+        foldConst(get_koopa_op(eqop), eqExp, relExp); // 仅当两个右值的运算结果才是右值
+        t_type = eqExp->t_type;                     // 没有考虑类型转换和检查
+        if (!isConst)
         {
-        case 1:
-            // 值不发生改变，因此原样复制
-            relExp->blockId = blockId; // 父->子
-            s = relExp->Dump();
-            syncProps(relExp);
-            break;
-        case 2:
-            debug("eq", eqExp);
-            eqExp->blockId = relExp->blockId = blockId; // 父->子
-            s = eqExp->Dump() + eqExp->loadIfisPointer();
-            s1 = relExp->Dump() + relExp->loadIfisPointer();
-            isConst = eqExp->isConst & relExp->isConst; // 仅当两个右值的运算结果才是右值
-            t_type = eqExp->t_type;                     // 没有考虑类型转换和检查
-            if (!isConst)
-            {
-                alloc_ref();
-                s = s + s1 +
-                    get_ref() + " = " + get_koopa_op(eqop) + " " +
-                    eqExp->get_val_if_possible() + ", " +
-                    relExp->get_val_if_possible() + "\n";
-            }
-            else
-            {
-                if (eqop == "==")
-                {
-                    r_val = (to_string(atoi(eqExp->r_val.data()) == atoi(relExp->r_val.data())));
-                }
-                else if (eqop == "!=")
-                {
-                    r_val = (to_string(atoi(eqExp->r_val.data()) != atoi(relExp->r_val.data())));
-                }
-            }
-
-            break;
-        default:
-            assert(false);
+            alloc_ref();
+            s = s + s1 +
+                get_ref() + " = " + get_koopa_op(eqop) + " " +
+                eqExp->get_val_if_possible() + ", " +
+                relExp->get_val_if_possible() + "\n";
         }
         return s;
     }
@@ -1125,55 +1180,93 @@ public:
 class LAndExpAST : public BaseAST
 {
 public:
-    // 表示选择了哪个产生式
-    int selection;
-    // 产生式1
     unique_ptr<BaseAST> eqExp;
-    // 产生式2
     unique_ptr<BaseAST> landExp;
 
     string Dump() override
     {
         debug("land", eqExp);
-        string s, s1, s2, s3;
-        switch (selection)
+        string s, s1;
+        vector<string> tags; // 短路求值需要的基本块标签
+        debug("land", landExp);
+        landExp->blockId = eqExp->blockId = blockId;
+        s = landExp->Dump();
+        s += landExp->loadIfisPointer();
+        t_type = landExp->t_type; // 没有考虑类型转换和检查
+        // 左侧为常量时不需要分支：为假则右侧不求值（仍要分析，但丢弃生成的IR）
+        if (landExp->isConst && !landExp->c_val)
         {
-        case 1:
-            // 值不发生改变，因此原样复制
-            eqExp->blockId = blockId;
-            s = eqExp->Dump();
-            syncProps(eqExp);
-            break;
-        case 2:
-            debug("land", landExp);
-            landExp->blockId = eqExp->blockId = blockId;
-            s = landExp->Dump() + landExp->loadIfisPointer();
-            s1 = eqExp->Dump() + eqExp->loadIfisPointer();
-            isConst = landExp->isConst & eqExp->isConst; // 仅当两个右值的运算结果才是右值
-            t_type = landExp->t_type;                    // 没有考虑类型转换和检查
-
-            if (!isConst)
+            eqExp->Dump();
+            isConst = true;
+            c_val = 0;
+            return s;
+        }
+        if (landExp->isConst)
+        {
+            s += eqExp->Dump();
+            s += eqExp->loadIfisPointer();
+            isConst = eqExp->isConst;
+            if (isConst)
             {
-                alloc_ref();
-                // Koopa IR只支持按位与；a && b => %1 = ne a, 0; %2 = ne b, 0; %3 = and %1, %2;
-                s = s + s1 +
-                    get_ref() + " = ne " +
-                    landExp->get_val_if_possible() + ", 0\n";
-                s2 = get_ref();
-                alloc_ref();
-                s = s + get_ref() + " = ne " +
-                    eqExp->get_val_if_possible() + ", 0\n";
-                s3 = get_ref();
-                alloc_ref();
-                s = s + get_ref() + " = and " + s2 + ", " + s3 + "\n";
+                c_val = eqExp->c_val != 0;
             }
             else
             {
-                r_val = to_string(atoi(landExp->r_val.data()) && atoi(eqExp->r_val.data()));
+                alloc_ref();
+                s += (get_ref() + " = ne " + eqExp->get_val_if_possible() + ", 0\n");
             }
-            break;
-        default:
-            assert(false);
+            return s;
+        }
+        // a && b => br a, %rhs, %end(0); %rhs: jump %end(b != 0); %end(%r: i32):
+        isConst = false;
+        tags = alloc_basic_block_tags(2);
+        s += ("br " + landExp->get_val_if_possible() + ", " + tags[0] + ", " + tags[1] + "(0)\n\n");
+        s += (tags[0] + ":\n");
+        s += eqExp->Dump();
+        s += eqExp->loadIfisPointer();
+        if (eqExp->isConst)
+        {
+            s1 = to_string(eqExp->c_val != 0);
+        }
+        else
+        {
+            alloc_ref();
+            s += (get_ref() + " = ne " + eqExp->get_val_if_possible() + ", 0\n");
+            s1 = get_ref();
+        }
+        s += ("jump " + tags[1] + "(" + s1 + ")\n\n");
+        alloc_ref();
+        s += (tags[1] + "(" + get_ref() + ": i32):\n");
+        return s;
+    }
+
+    // a && b作为条件：a为假直接跳到false_tag，否则再判断b
+    string DumpCond(const string &true_tag, const string &false_tag) override
+    {
+        debug("land", eqExp);
+        string s;
+        string rhs_tag;
+        debug("land", landExp);
+        landExp->blockId = eqExp->blockId = blockId;
+        rhs_tag = alloc_basic_block_tags(1)[0];
+        s = landExp->DumpCond(rhs_tag, false_tag);
+        if (!landExp->isConst)
+        {
+            s += (rhs_tag + ":\n");
+            s += eqExp->DumpCond(true_tag, false_tag);
+            isConst = false;
+        }
+        else if (!landExp->c_val)
+        {
+            eqExp->Dump(); // 右侧不会求值，只做分析
+            isConst = true;
+            c_val = 0;
+        }
+        else
+        {
+            s = eqExp->DumpCond(true_tag, false_tag);
+            isConst = eqExp->isConst;
+            c_val = eqExp->c_val != 0;
         }
         return s;
     }
@@ -1182,72 +1275,94 @@ public:
 class LOrExpAST : public BaseAST
 {
 public:
-    // 表示选择了哪个产生式
-    int selection;
-    // 产生式1
     unique_ptr<BaseAST> landExp;
-    // 产生式2
     unique_ptr<BaseAST> lorExp;
 
     string Dump() override
     {
         debug("lor", landExp);
-        string s, s1, s2, s3;
-        switch (selection)
+        string s, s1;
+        vector<string> tags; // 短路求值需要的基本块标签
+        debug("lor", lorExp);
+        lorExp->blockId = landExp->blockId = blockId;
+        s = lorExp->Dump();
+        s += lorExp->loadIfisPointer();
+        t_type = lorExp->t_type; // 没有考虑类型转换和检查
+        // 左侧为常量时不需要分支：为真则右侧不求值（仍要分析，但丢弃生成的IR）
+        if (lorExp->isConst && lorExp->c_val)
         {
-        case 1:
-            // 值不发生改变，因此原样复制
-            landExp->blockId = blockId;
-            s = landExp->Dump();
-            syncProps(landExp);
-            break;
-        case 2:
-            debug("lor", lorExp);
-            lorExp->blockId = landExp->blockId = blockId;
-            s = lorExp->Dump() + lorExp->loadIfisPointer();
-            s1 = landExp->Dump() + landExp->loadIfisPointer();
-            isConst = lorExp->isConst & landExp->isConst;
-            t_type = lorExp->t_type; // 没有考虑类型转换和检查
-
-            if (!isConst)
+            landExp->Dump();
+            isConst = true;
+            c_val = 1;
+            return s;
+        }
+        if (lorExp->isConst)
+        {
+            s += landExp->Dump();
+            s += landExp->loadIfisPointer();
+            isConst = landExp->isConst;
+            if (isConst)
             {
-                alloc_ref();
-                // Koopa IR只支持按位或; a || b => %1 = ne a, 0; %2 = ne b, 0; %3 = or %1, %2;
-                s = s + s1 +
-                    get_ref() + " = ne " +
-                    lorExp->get_val_if_possible() + ", 0\n";
-                s2 = get_ref();
-                alloc_ref();
-                s = s + get_ref() + " = ne " +
-                    landExp->get_val_if_possible() + ", 0\n";
-                s3 = get_ref();
-                alloc_ref();
-                s = s + get_ref() + " = or " + s2 + ", " + s3 + "\n";
+                c_val = landExp->c_val != 0;
             }
             else
             {
-                r_val = to_string(atoi(lorExp->r_val.data()) || atoi(landExp->r_val.data()));
+                alloc_ref();
+                s += (get_ref() + " = ne " + landExp->get_val_if_possible() + ", 0\n");
             }
-            break;
-        default:
-            assert(false);
+            return s;
+        }
+        // a || b => br a, %end(1), %rhs; %rhs: jump %end(b != 0); %end(%r: i32):
+        isConst = false;
+        tags = alloc_basic_block_tags(2);
+        s += ("br " + lorExp->get_val_if_possible() + ", " + tags[1] + "(1), " + tags[0] + "\n\n");
+        s += (tags[0] + ":\n");
+        s += landExp->Dump();
+        s += landExp->loadIfisPointer();
+        if (landExp->isConst)
+        {
+            s1 = to_string(landExp->c_val != 0);
+        }
+        else
+        {
+            alloc_ref();
+            s += (get_ref() + " = ne " + landExp->get_val_if_possible() + ", 0\n");
+            s1 = get_ref();
         }
+        s += ("jump " + tags[1] + "(" + s1 + ")\n\n");
+        alloc_ref();
+        s += (tags[1] + "(" + get_ref() + ": i32):\n");
         return s;
     }
-};
-
-// 常量表达式
-class ConstExpAST : public BaseAST
-{
-public:
-    unique_ptr<BaseAST> exp;
 
-    string Dump() override
+    // a || b作为条件：a为真直接跳到true_tag，否则再判断b
+    string DumpCond(const string &true_tag, const string &false_tag) override
     {
-        debug("const_exp", exp);
-        exp->blockId = blockId;
-        string s = exp->Dump();
-        syncProps(exp);
+        debug("lor", landExp);
+        string s;
+        string rhs_tag;
+        debug("lor", lorExp);
+        lorExp->blockId = landExp->blockId = blockId;
+        rhs_tag = alloc_basic_block_tags(1)[0];
+        s = lorExp->DumpCond(true_tag, rhs_tag);
+        if (!lorExp->isConst)
+        {
+            s += (rhs_tag + ":\n");
+            s += landExp->DumpCond(true_tag, false_tag);
+            isConst = false;
+        }
+        else if (lorExp->c_val)
+        {
+            landExp->Dump(); // 右侧不会求值，只做分析
+            isConst = true;
+            c_val = 1;
+        }
+        else
+        {
+            s = landExp->DumpCond(true_tag, false_tag);
+            isConst = landExp->isConst;
+            c_val = landExp->c_val != 0;
+        }
         return s;
     }
 };
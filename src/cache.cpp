@@ -0,0 +1,302 @@
+#include "cache.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    // 输出格式或缓存格式改变时修改，使旧的缓存全部失效
+    const char *const CACHE_VERSION = "fe-cache-2";
+    const time_t STALE_TMP_SECONDS = 3600; // 写入中途退出留下的临时文件，超过该时间后清理
+
+    // 128位FNV-1a
+    class Hasher
+    {
+    public:
+        void update(const string &data)
+        {
+            for (unsigned char c : data)
+            {
+                h ^= c;
+                h *= PRIME;
+            }
+            // 分隔各个字段，避免"ab"+"c"与"a"+"bc"相同
+            h ^= 0xff;
+            h *= PRIME;
+        }
+
+        string hex() const
+        {
+            char buf[33];
+            snprintf(buf, sizeof(buf), "%016llx%016llx", (unsigned long long)(h >> 64), (unsigned long long)h);
+            return buf;
+        }
+
+    private:
+        static constexpr unsigned __int128 PRIME = ((unsigned __int128)1 << 88) + 0x13b;
+        unsigned __int128 h = ((unsigned __int128)0x6c62272e07bb0142ull << 64) + 0x62b821756295c58dull;
+    };
+
+    // 编译器本身：可执行文件的大小和修改时间，重新编译编译器后旧的结果不再命中
+    const string &compilerId()
+    {
+        static string id;
+        if (id.empty())
+        {
+            struct stat st;
+            stringstream ss;
+            ss << CACHE_VERSION;
+            if (!stat("/proc/self/exe", &st))
+                ss << " " << st.st_size << " " << st.st_mtime;
+            id = ss.str();
+        }
+        return id;
+    }
+
+    // 对缓存目录加锁，离开作用域时释放；加锁失败时不加锁继续，只影响统计的准确性
+    class DirLock
+    {
+    public:
+        DirLock(const string &dir)
+        {
+            fd = open((dir + "/lock").c_str(), O_RDWR | O_CREAT, 0644);
+            if (fd >= 0)
+                flock(fd, LOCK_EX);
+        }
+        ~DirLock()
+        {
+            if (fd >= 0)
+                close(fd); // 关闭时释放锁
+        }
+
+    private:
+        int fd;
+    };
+
+    bool endsWith(const string &s, const string &suffix)
+    {
+        return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+}
+
+void CompileCache::setKey(const string &source, const string &options)
+{
+    this->options = options;
+    Hasher hasher;
+    hasher.update(compilerId());
+    hasher.update(options);
+    hasher.update(source);
+    key = hasher.hex();
+}
+
+string CompileCache::functionKey(const string &func_ir) const
+{
+    Hasher hasher;
+    hasher.update(compilerId());
+    hasher.update(options);
+    hasher.update("function"); // 与整个文件的键区分
+    hasher.update(func_ir);
+    return hasher.hex();
+}
+
+string CompileCache::entryPath(const string &key, const string &kind) const
+{
+    return dir + "/" + key + "." + kind;
+}
+
+bool CompileCache::lookup(string &output)
+{
+    mkdir(dir.c_str(), 0755);
+    hit = load(entryPath(key, "out"), output);
+    ++(hit ? session.hits : session.misses);
+    return hit;
+}
+
+void CompileCache::store(const string &output)
+{
+    save(entryPath(key, "out"), output);
+}
+
+bool CompileCache::lookupFunction(const string &key, string &data)
+{
+    bool found = load(entryPath(key, "fn"), data);
+    ++(found ? session.funcHits : session.funcMisses);
+    return found;
+}
+
+void CompileCache::storeFunction(const string &key, const string &data)
+{
+    save(entryPath(key, "fn"), data);
+}
+
+bool CompileCache::load(const string &path, string &data)
+{
+    ifstream fin(path, ios_base::binary);
+    if (!fin.is_open())
+        return false;
+    stringstream ss;
+    ss << fin.rdbuf();
+    if (fin.bad())
+        return false;
+    data = ss.str();
+    utime(path.c_str(), nullptr); // 最近使用
+    return true;
+}
+
+void CompileCache::save(const string &path, const string &data)
+{
+    string tmp = path + ".tmp." + to_string(getpid());
+    {
+        ofstream fout(tmp, ios_base::binary);
+        fout << data;
+        if (!fout.good())
+        {
+            cerr << "Failed to write compile cache entry " << tmp << endl;
+            fout.close();
+            unlink(tmp.c_str());
+            return;
+        }
+    }
+    struct stat st;
+    uint64_t old = stat(path.c_str(), &st) ? 0 : st.st_size; // 覆盖已有的结果时总大小只增加差值
+    // rename是原子的，并发写同一个键时后写的覆盖先写的，内容相同
+    if (rename(tmp.c_str(), path.c_str()))
+    {
+        cerr << "Failed to write compile cache entry " << path << endl;
+        unlink(tmp.c_str());
+        return;
+    }
+    addedBytes += (int64_t)data.size() - (int64_t)old;
+}
+
+void CompileCache::finish()
+{
+    DirLock lock(dir);
+    totals = readStats();
+    totals.hits += session.hits;
+    totals.misses += session.misses;
+    totals.funcHits += session.funcHits;
+    totals.funcMisses += session.funcMisses;
+    totals.bytes = addedBytes < 0 && (uint64_t)-addedBytes > totals.bytes ? 0 : totals.bytes + addedBytes;
+    // 累加的总大小只是估计（并发覆盖同一个键、目录被外部修改），超过上限时扫描目录得到准确值再决定是否淘汰
+    if (!totals.hasBytes || totals.bytes > maxBytes)
+        evict(totals);
+    writeStats(totals);
+}
+
+CompileCache::Stats CompileCache::readStats()
+{
+    Stats stats;
+    ifstream fin(dir + "/stats");
+    string name;
+    uint64_t value;
+    while (fin >> name >> value)
+    {
+        if (name == "hits")
+            stats.hits = value;
+        else if (name == "misses")
+            stats.misses = value;
+        else if (name == "func_hits")
+            stats.funcHits = value;
+        else if (name == "func_misses")
+            stats.funcMisses = value;
+        else if (name == "evictions")
+            stats.evictions = value;
+        else if (name == "bytes")
+        {
+            stats.bytes = value;
+            stats.hasBytes = true;
+        }
+    }
+    return stats;
+}
+
+void CompileCache::writeStats(const Stats &stats)
+{
+    string tmp = dir + "/stats.tmp";
+    {
+        ofstream fout(tmp);
+        fout << "hits " << stats.hits << "\n"
+             << "misses " << stats.misses << "\n"
+             << "func_hits " << stats.funcHits << "\n"
+             << "func_misses " << stats.funcMisses << "\n"
+             << "evictions " << stats.evictions << "\n"
+             << "bytes " << stats.bytes << "\n";
+    }
+    rename(tmp.c_str(), (dir + "/stats").c_str());
+}
+
+void CompileCache::evict(Stats &stats)
+{
+    class Entry
+    {
+    public:
+        string path;
+        uint64_t size;
+        struct timespec mtime;
+    };
+    vector<Entry> entries;
+    uint64_t total = 0;
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return;
+    time_t now = time(nullptr);
+    while (auto ent = readdir(d))
+    {
+        string name = ent->d_name;
+        string path = dir + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) || !S_ISREG(st.st_mode))
+            continue;
+        if (name.find(".tmp.") != string::npos)
+        {
+            if (now - st.st_mtime > STALE_TMP_SECONDS)
+                unlink(path.c_str());
+            continue;
+        }
+        if (!endsWith(name, ".out") && !endsWith(name, ".fn"))
+            continue;
+        entries.push_back({path, (uint64_t)st.st_size, st.st_mtim});
+        total += st.st_size;
+    }
+    closedir(d);
+    stats.bytes = total;
+    stats.hasBytes = true;
+    if (total <= maxBytes)
+        return;
+    sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b)
+         { return a.mtime.tv_sec != b.mtime.tv_sec ? a.mtime.tv_sec < b.mtime.tv_sec : a.mtime.tv_nsec < b.mtime.tv_nsec; });
+    for (auto &entry : entries)
+    {
+        if (total <= maxBytes)
+            break;
+        if (!unlink(entry.path.c_str()))
+        {
+            total -= entry.size;
+            ++stats.evictions;
+        }
+    }
+    stats.bytes = total;
+}
+
+void CompileCache::report(ostream &os)
+{
+    os << "compile cache " << (hit ? "hit" : "miss") << " " << key;
+    if (!hit)
+        os << " (functions: " << session.funcHits << " reused, " << session.funcMisses << " compiled)";
+    os << "\n"
+       << "cache totals: hits " << totals.hits << ", misses " << totals.misses
+       << ", function hits " << totals.funcHits << ", function misses " << totals.funcMisses
+       << ", evictions " << totals.evictions << "\n";
+}
@@ -0,0 +1,66 @@
+// 编译结果的磁盘缓存：以源文件内容、编译器版本和编译选项的哈希为键，命中时直接输出保存的结果
+// 整个文件未命中时再按函数查找，只重新优化和生成改动过的函数
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+using namespace std;
+
+// 缓存目录中每个结果是一个文件：整个文件的结果为<键>.out，单个函数的结果为<键>.fn
+// 写入临时文件后rename，读者不会看到写了一半的结果
+// 命中时更新文件的修改时间，总大小超过上限时按修改时间从旧到新删除（LRU）
+// 累计的命中/未命中/淘汰次数和结果的总大小记录在目录下的stats文件中，修改stats和淘汰时持有目录下lock文件的锁
+// 总大小由每次编译写入的字节数累加，只有超过上限（或还没有记录）时才扫描整个目录，扫描时重新得到准确的总大小
+class CompileCache
+{
+public:
+    string dir;                        // 为空时不使用缓存（-cache-dir=DIR）
+    uint64_t maxBytes = 256ull << 20;  // 缓存的总大小上限（-cache-size=MB）
+    bool printStats = false;           // 结束时在stderr输出命中统计（-cache-stats）
+
+    bool enabled() const { return !dir.empty(); }
+    // 由源文件内容、模式和影响输出的编译选项计算整个文件的键
+    void setKey(const string &source, const string &options);
+    // 整个文件：命中时把结果存入output并返回true
+    bool lookup(string &output);
+    void store(const string &output);
+    // 单个函数：键由函数进入函数级pass之前的IR文本计算，编译选项与整个文件相同
+    string functionKey(const string &func_ir) const;
+    bool lookupFunction(const string &key, string &data);
+    void storeFunction(const string &key, const string &data);
+    // 编译结束时调用一次：累加统计并按大小上限淘汰
+    void finish();
+    void report(ostream &os);
+
+private:
+    class Stats
+    {
+    public:
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t funcHits = 0;
+        uint64_t funcMisses = 0;
+        uint64_t evictions = 0;
+        uint64_t bytes = 0;      // 结果文件的总大小
+        bool hasBytes = false;   // stats文件中是否记录了总大小
+    };
+
+    string key;
+    string options;
+    bool hit = false;
+    Stats session; // 本次编译的统计
+    Stats totals;  // finish之后的累计统计
+    int64_t addedBytes = 0; // 本次编译写入的结果使总大小增加的字节数
+
+    string entryPath(const string &key, const string &kind) const;
+    bool load(const string &path, string &data);
+    void save(const string &path, const string &data);
+    Stats readStats();
+    void writeStats(const Stats &stats);
+    void evict(Stats &stats);
+};
+
+#endif // CACHE_HPP
@@ -0,0 +1,207 @@
+#include "passes.hpp"
+
+using namespace std;
+
+// 死代码删除与控制流图化简
+
+// 被load读取过或地址逃逸的alloc，对它的store才有意义
+static unordered_set<IRValue *> collectReadAllocs(IRFunction &func)
+{
+    unordered_set<IRValue *> read;
+    for (auto bb : func.blocks)
+    {
+        for (auto inst : bb->insts)
+        {
+            for (size_t i = 0; i < inst->ops.size(); ++i)
+            {
+                if (inst->kind == IR_STORE && i == 1)
+                    continue;
+                read.insert(inst->ops[i]);
+            }
+            for (auto &list : inst->args)
+                read.insert(list.begin(), list.end());
+        }
+    }
+    return read;
+}
+
+bool DCE(IRFunction &func)
+{
+    func.buildCFG();
+    auto incoming = collectIncomingEdges(func);
+    unordered_set<IRValue *> read = collectReadAllocs(func);
+    unordered_map<IRValue *, pair<IRBlock *, size_t>> param_pos;
+    for (auto bb : func.blocks)
+        for (size_t i = 0; i < bb->params.size(); ++i)
+            param_pos[bb->params[i]] = {bb, i};
+
+    // 从有副作用的指令出发标记活跃值；块参数活跃时，所有边上对应的实参也活跃
+    unordered_set<IRValue *> live;
+    vector<IRValue *> work;
+    auto mark = [&](IRValue *v)
+    {
+        if ((v->parent || v->kind == IR_BLOCK_ARG) && live.insert(v).second)
+            work.push_back(v);
+    };
+    for (auto bb : func.blocks)
+    {
+        for (auto inst : bb->insts)
+        {
+            if (!inst->hasSideEffect())
+                continue;
+            // 写入从未被读取的局部变量是死存储
+            if (inst->kind == IR_STORE && inst->ops[1]->kind == IR_ALLOC && !read.count(inst->ops[1]))
+                continue;
+            mark(inst);
+        }
+    }
+    while (!work.empty())
+    {
+        IRValue *v = work.back();
+        work.pop_back();
+        if (v->kind == IR_BLOCK_ARG)
+        {
+            auto pos = param_pos[v];
+            for (auto &edge : incoming[pos.first->id])
+                mark(edge.first->args[edge.second][pos.second]);
+            continue;
+        }
+        // 跳转实参只经由块参数变为活跃
+        for (auto op : v->ops)
+            mark(op);
+    }
+
+    bool changed = false;
+    for (auto bb : func.blocks)
+    {
+        vector<bool> keep(bb->params.size(), true);
+        bool erased = false;
+        for (size_t i = 0; i < bb->params.size(); ++i)
+        {
+            if (live.count(bb->params[i]))
+                continue;
+            keep[i] = false;
+            erased = true;
+        }
+        if (erased)
+        {
+            eraseBlockParams(bb, keep, incoming[bb->id]);
+            changed = true;
+        }
+        for (auto inst : bb->insts)
+        {
+            if (live.count(inst))
+                continue;
+            inst->dead = true;
+            changed = true;
+        }
+    }
+    func.sweep();
+    return changed;
+}
+
+// 跳过只含一条无参jump的空块，返回最终目标；没有可跳过的块时返回nullptr
+static IRBlock *getForwardTarget(IRBlock *bb, IRBlock *entry, vector<IRValue *> *&args)
+{
+    IRBlock *cur = bb;
+    unordered_set<IRBlock *> visited;
+    while (cur != entry && cur->params.empty() && cur->insts.size() == 1 && cur->insts[0]->kind == IR_JUMP)
+    {
+        // 空的死循环无法跳过
+        if (!visited.insert(cur).second)
+            return nullptr;
+        args = &cur->insts[0]->args[0];
+        cur = cur->insts[0]->targets[0];
+    }
+    return cur == bb ? nullptr : cur;
+}
+
+bool SimplifyCFG(IRFunction &func)
+{
+    bool changed = func.removeUnreachableBlocks();
+    if (func.blocks.empty())
+        return changed;
+    IRBlock *entry = func.blocks[0];
+
+    // 1. 退化的分支：条件为常量，或两个目标与实参都相同
+    for (auto bb : func.blocks)
+    {
+        IRValue *term = bb->terminator();
+        if (!term || term->kind != IR_BRANCH)
+            continue;
+        IRValue *cond = term->ops[0];
+        size_t keep;
+        if (cond->kind == IR_INT)
+            keep = cond->imm ? 0 : 1;
+        else if (term->targets[0] == term->targets[1] && term->args[0] == term->args[1])
+            keep = 0;
+        else
+            continue;
+        term->kind = IR_JUMP;
+        term->ops.clear();
+        term->targets = {term->targets[keep]};
+        term->args = {term->args[keep]};
+        changed = true;
+    }
+
+    // 2. 跳转穿过空块：直接跳到空块的目标
+    unordered_map<IRBlock *, pair<IRBlock *, vector<IRValue *> *>> forward;
+    for (auto bb : func.blocks)
+    {
+        vector<IRValue *> *args = nullptr;
+        IRBlock *target = getForwardTarget(bb, entry, args);
+        if (target)
+            forward[bb] = {target, args};
+    }
+    for (auto bb : func.blocks)
+    {
+        IRValue *term = bb->terminator();
+        if (!term || forward.count(bb))
+            continue;
+        for (size_t k = 0; k < term->targets.size(); ++k)
+        {
+            auto it = forward.find(term->targets[k]);
+            if (it == forward.end())
+                continue;
+            term->targets[k] = it->second.first;
+            term->args[k] = *it->second.second;
+            changed = true;
+        }
+    }
+    changed |= func.removeUnreachableBlocks();
+
+    // 3. 合并：块只有一个前驱，且前驱以jump无条件跳入
+    unordered_map<IRBlock *, IRBlock *> merged_into;
+    unordered_map<IRValue *, IRValue *> repl;
+    for (auto bb : func.blocks)
+    {
+        if (bb == entry || bb->preds.size() != 1)
+            continue;
+        IRBlock *pred = bb->preds[0];
+        while (merged_into.count(pred))
+            pred = merged_into[pred];
+        IRValue *term = pred->terminator();
+        if (pred == bb || !term || term->kind != IR_JUMP || term->targets[0] != bb)
+            continue;
+        for (size_t i = 0; i < bb->params.size(); ++i)
+            repl[bb->params[i]] = term->args[0][i];
+        pred->insts.pop_back();
+        for (auto inst : bb->insts)
+        {
+            inst->parent = pred;
+            pred->insts.push_back(inst);
+        }
+        bb->insts.clear();
+        bb->params.clear();
+        bb->dead = true;
+        merged_into[bb] = pred;
+        changed = true;
+    }
+    if (!merged_into.empty())
+    {
+        func.sweep();
+        func.replaceUses(repl);
+        func.buildCFG();
+    }
+    return changed;
+}
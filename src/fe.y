@@ -8,6 +8,7 @@ top：code_seg只能是C/C++，将被放在实现文件的最开头。
 imports：此时代码段code_seg只能是JAVA
 */
 %code requires {
+  #include <functional>
   #include <memory>
   #include <string>
   #include "ast.hpp"
@@ -21,15 +22,42 @@ imports：此时代码段code_seg只能是JAVA
 #include "ast.hpp"
 #include <cstdio>
 #include <cstring>
+#include <functional>
 #include <vector>
 
 // 声明 lexer 函数和错误处理函数
 // C++11 unique_ptr: one ptr only reflects on one r-val; it destructs automatically.
 int yylex();
-void yyerror(std::unique_ptr<BaseAST> &ast, const char *s);
+void yyerror(std::unique_ptr<BaseAST> &ast, const std::function<void(const std::string &)> &emitFunc, const char *s);
 
 using namespace std;
 
+// 流水线模式（emitFunc非空）：每归约出一个函数就立即翻译为IR交给后端，解析器接着解析下一个函数
+// 函数必须先定义后调用，翻译一个函数只需要它之前的函数的信息
+// 翻译完的函数不再需要：释放它的AST和块的符号表，内存只取决于最大的函数而不是整个程序
+static bool unit_begun = false;
+static ASTPool::Mark func_mark; // 第一个函数之后的位置（第一个函数的节点在FuncDefsAST之前，不能回退）
+static void emitFuncDef(BaseAST *func_def, const function<void(const string &)> &emitFunc, bool first)
+{
+  if (!unit_begun)
+  {
+    CompUnitAST::beginUnit();
+    unit_begun = true;
+  }
+  int first_block = global_block_id + 1;
+  func_def->depth = 1;
+  func_def->blockId = 0;
+  emitFunc(func_def->Dump());
+  delete func_def;
+  if (first)
+    func_mark = ast_pool.mark();
+  else
+    ast_pool.release(func_mark);
+  // 没有全局变量，其他函数不会再查找这些块
+  for (int id = first_block; id <= global_block_id; ++id)
+    unordered_map<string, SBTNode>().swap(*SBT.at(id));
+}
+
 %}
 
 // 定义 yyparse() 函数和错误处理函数的附加参数
@@ -38,7 +66,8 @@ using namespace std;
 // %parse-param { std::unique_ptr<std::string> &ast }
 
 // Lv1.3
-%parse-param { std::unique_ptr<BaseAST> &ast }
+// emitFunc：流水线模式下每个函数的IR的接收者，为空时解析完成后再由ast->Dump()翻译整个程序
+%parse-param { std::unique_ptr<BaseAST> &ast } { const std::function<void(const std::string &)> &emitFunc }
 
 // yylval(token流) 的定义, 我们把它定义成了一个联合体 (union)
 // all union members share same mem and address
@@ -62,25 +91,44 @@ using namespace std;
 
 // %token: <decl in %union, values>
 // lexer 返回的所有 终结符（即token） 类型的声明
-%token INT RETURN CONST IF ELSE
+%token INT VOID RETURN CONST IF ELSE WHILE BREAK CONTINUE
 %token <str_val> IDENT RELOP EQOP LOGICAND LOGICOR
 %token <int_val> INT_VAL
 
 %type <ast_val> Decl ConstDecl BType ConstDefs ConstDef ConstInitVal VarDecl VarDefs VarDef InitVal BlockItems BlockItem LVal ConstExp
-  FuncDef FuncType Block Stmt MS UMS Exp PrimaryExp UnaryExp AddExp MulExp RelExp EqExp LAndExp LOrExp
+  FuncDefs FuncDef FuncType FuncFParams FuncFParam FuncRParams Block Stmt MS UMS Exp PrimaryExp UnaryExp AddExp MulExp RelExp EqExp LAndExp LOrExp
 %type <int_val> Number
 %type <str_val> UnaryOp
 
 %%
 
 CompUnit
-  : FuncDef {
+  : FuncDefs {
     auto comp_unit = make_unique<CompUnitAST>();
-    comp_unit->func_def = unique_ptr<BaseAST>($1);
+    comp_unit->func_defs = unique_ptr<BaseAST>($1);
     ast = move(comp_unit);  // move()函数强制将左值转换为右值
   }
   ;
 
+FuncDefs
+  : FuncDefs FuncDef {
+    auto ast = static_cast<FuncDefsAST *>($1);
+    if (emitFunc)
+      emitFuncDef($2, emitFunc, false);
+    else
+      ast->func_defs.emplace_back($2);
+    $$ = ast;
+  }
+  | FuncDef {
+    auto ast = new FuncDefsAST();
+    if (emitFunc)
+      emitFuncDef($1, emitFunc, true);
+    else
+      ast->func_defs.emplace_back($1);
+    $$ = ast;
+  }
+  ;
+
 Decl
   : ConstDecl {
     auto ast = new DeclAST();
@@ -107,16 +155,13 @@ ConstDecl
 
 ConstDefs
   : ConstDefs ',' ConstDef {
-    auto ast = new ConstDefsAST();
-    ast->selection = 1;
-    ast->const_defs = unique_ptr<BaseAST>($1);
-    ast->const_def = unique_ptr<BaseAST>($3);
+    auto ast = static_cast<ConstDefsAST *>($1);
+    ast->const_defs.emplace_back($3);
     $$ = ast;
   }
   | ConstDef {
     auto ast = new ConstDefsAST();
-    ast->selection = 2;
-    ast->const_def = unique_ptr<BaseAST>($1);
+    ast->const_defs.emplace_back($1);
     $$ = ast;
   }
   ;
@@ -157,16 +202,13 @@ VarDecl
 
 VarDefs
   : VarDefs ',' VarDef {
-    auto ast = new VarDefsAST();
-    ast->selection = 1;
-    ast->var_defs = unique_ptr<BaseAST>($1);
-    ast->var_def = unique_ptr<BaseAST>($3);
+    auto ast = static_cast<VarDefsAST *>($1);
+    ast->var_defs.emplace_back($3);
     $$ = ast;
   }
   | VarDef {
     auto ast = new VarDefsAST();
-    ast->selection = 2;
-    ast->var_def = unique_ptr<BaseAST>($1);
+    ast->var_defs.emplace_back($1);
     $$ = ast;
   }
   ;
@@ -187,11 +229,10 @@ VarDef
   }
   ;
 
+// 单一产生式不建新节点，直接使用子节点
 InitVal
   : Exp {
-    auto ast = new InitValAST();
-    ast->exp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   ;
 
@@ -203,6 +244,14 @@ FuncDef
     ast->block = unique_ptr<BaseAST>($5);
     $$ = ast;
   }
+  | FuncType IDENT '(' FuncFParams ')' Block {
+    auto ast = new FuncDefAST();
+    ast->func_type = unique_ptr<BaseAST>($1);
+    ast->ident = *unique_ptr<string>($2);
+    ast->func_f_params = unique_ptr<BaseAST>($4);
+    ast->block = unique_ptr<BaseAST>($6);
+    $$ = ast;
+  }
   ;
 
 FuncType
@@ -211,6 +260,33 @@ FuncType
     ast->type = "int";
     $$ = ast;
   }
+  | VOID {
+    auto ast = new FuncTypeAST();
+    ast->type = "void";
+    $$ = ast;
+  }
+  ;
+
+FuncFParams
+  : FuncFParams ',' FuncFParam {
+    auto ast = static_cast<FuncFParamsAST *>($1);
+    ast->func_f_params.emplace_back($3);
+    $$ = ast;
+  }
+  | FuncFParam {
+    auto ast = new FuncFParamsAST();
+    ast->func_f_params.emplace_back($1);
+    $$ = ast;
+  }
+  ;
+
+FuncFParam
+  : BType IDENT {
+    auto ast = new FuncFParamAST();
+    ast->b_type = unique_ptr<BaseAST>($1);
+    ast->ident = *unique_ptr<string>($2);
+    $$ = ast;
+  }
   ;
 
 Block
@@ -228,19 +304,16 @@ Block
   }
   ;
 
-// 左递归，方便yacc的LR分析
+// 左递归，方便yacc的LR分析；归约时追加到同一个节点的vector中，不形成链
 BlockItems
   : BlockItems BlockItem {
-    auto ast = new BlockItemsAST();
-    ast->selection = 1;
-    ast->block_items = unique_ptr<BaseAST>($1);
-    ast->block_item = unique_ptr<BaseAST>($2);
+    auto ast = static_cast<BlockItemsAST *>($1);
+    ast->block_items.emplace_back($2);
     $$ = ast;
   }
   | BlockItem {
     auto ast = new BlockItemsAST();
-    ast->selection = 2;
-    ast->block_item = unique_ptr<BaseAST>($1);
+    ast->block_items.emplace_back($1);
     $$ = ast;
   }
   ;
@@ -308,7 +381,7 @@ MS
   }
   | RETURN ';' {
     auto ast = new MSAST();
-    ast->selection = 0;
+    ast->selection = 9;
     $$ = ast;
   }
   | RETURN Exp ';' {
@@ -317,6 +390,23 @@ MS
     ast->exp = unique_ptr<BaseAST>($2);
     $$ = ast;
   } 
+  | WHILE '(' Exp ')' MS {
+    auto ast = new MSAST();
+    ast->selection = 6;
+    ast->exp = unique_ptr<BaseAST>($3);
+    ast->ms = unique_ptr<BaseAST>($5);
+    $$ = ast;
+  }
+  | BREAK ';' {
+    auto ast = new MSAST();
+    ast->selection = 7;
+    $$ = ast;
+  }
+  | CONTINUE ';' {
+    auto ast = new MSAST();
+    ast->selection = 8;
+    $$ = ast;
+  }
   ;
 
   UMS  
@@ -335,6 +425,13 @@ MS
     ast->stmt = unique_ptr<BaseAST>($5);
     $$ = ast;
   }
+  | WHILE '(' Exp ')' UMS {
+    auto ast = new UMSAST();
+    ast->selection = 3;
+    ast->exp = unique_ptr<BaseAST>($3);
+    ast->ums = unique_ptr<BaseAST>($5);
+    $$ = ast;
+  }
   ;
 
 Exp         
@@ -353,10 +450,7 @@ Exp
   // }
   // | 
   LOrExp {
-    auto ast = new ExpAST();
-    ast->selection = 3;
-    ast->lorExp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
 ;
 
@@ -370,20 +464,13 @@ LVal
 
 PrimaryExp  
   : '(' Exp ')' {
-    auto ast = new PrimaryExpAST();
-    ast->selection = 1;
-    ast->exp = unique_ptr<BaseAST>($2);
-    $$ = ast;
+    $$ = $2;
   }
   | LVal {
-    auto ast = new PrimaryExpAST();
-    ast->selection = 2;
-    ast->l_val = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | Number {
     auto ast = new PrimaryExpAST();
-    ast->selection = 3;
     ast->number = $1; // it's of int32
     $$ = ast;
   }
@@ -397,11 +484,8 @@ Number
 
 UnaryExp    
   : PrimaryExp {
-    auto ast = new UnaryExpAST();
-    ast->selection = 1;
-    ast->primaryExp = unique_ptr<BaseAST>($1);
-    $$ = ast;
-  } 
+    $$ = $1;
+  }
   | UnaryOp UnaryExp {
     auto ast = new UnaryExpAST();
     ast->selection = 2;
@@ -409,6 +493,33 @@ UnaryExp
     ast->unaryExp = unique_ptr<BaseAST>($2);
     $$ = ast;
   }
+  | IDENT '(' ')' {
+    auto ast = new UnaryExpAST();
+    ast->selection = 3;
+    ast->callee = *unique_ptr<string>($1);
+    $$ = ast;
+  }
+  | IDENT '(' FuncRParams ')' {
+    auto ast = new UnaryExpAST();
+    ast->selection = 3;
+    ast->callee = *unique_ptr<string>($1);
+    ast->func_r_params = unique_ptr<BaseAST>($3);
+    $$ = ast;
+  }
+;
+
+// 函数调用的实参
+FuncRParams
+  : FuncRParams ',' Exp {
+    auto ast = static_cast<FuncRParamsAST *>($1);
+    ast->exps.emplace_back($3);
+    $$ = ast;
+  }
+  | Exp {
+    auto ast = new FuncRParamsAST();
+    ast->exps.emplace_back($1);
+    $$ = ast;
+  }
 ;
 
 UnaryOp
@@ -420,14 +531,10 @@ UnaryOp
 // 多元表达式
 MulExp
   : UnaryExp {
-    auto ast = new MulExpAST();
-    ast->selection = 1;
-    ast->unaryExp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | MulExp '*' UnaryExp {
     auto ast = new MulExpAST();
-    ast->selection = 2;
     ast->mulExp = unique_ptr<BaseAST>($1);
     ast->mulop = "*";
     ast->unaryExp = unique_ptr<BaseAST>($3);
@@ -435,7 +542,6 @@ MulExp
   }
   | MulExp '/' UnaryExp {
     auto ast = new MulExpAST();
-    ast->selection = 2;
     ast->mulExp = unique_ptr<BaseAST>($1);
     ast->mulop = "/";
     ast->unaryExp = unique_ptr<BaseAST>($3);
@@ -443,7 +549,6 @@ MulExp
   }
   | MulExp '%' UnaryExp {
     auto ast = new MulExpAST();
-    ast->selection = 2;
     ast->mulExp = unique_ptr<BaseAST>($1);
     ast->mulop = "%";
     ast->unaryExp = unique_ptr<BaseAST>($3);
@@ -453,14 +558,10 @@ MulExp
 
 AddExp
   : MulExp {
-    auto ast = new AddExpAST();
-    ast->selection = 1;
-    ast->mulExp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | AddExp '+' MulExp {
     auto ast = new AddExpAST();
-    ast->selection = 2;
     ast->addExp = unique_ptr<BaseAST>($1);
     ast->mulop = "+";
     ast->mulExp = unique_ptr<BaseAST>($3);
@@ -468,7 +569,6 @@ AddExp
   }
   | AddExp '-' MulExp {
     auto ast = new AddExpAST();
-    ast->selection = 2;
     ast->addExp = unique_ptr<BaseAST>($1);
     ast->mulop = "-";
     ast->mulExp = unique_ptr<BaseAST>($3);
@@ -478,16 +578,12 @@ AddExp
 
 RelExp
   : AddExp {
-    auto ast = new RelExpAST();
-    ast->selection = 1;
-    ast->addExp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | RelExp RELOP AddExp {
     auto ast = new RelExpAST();
-    ast->selection = 2;
     ast->relExp = unique_ptr<BaseAST>($1);
-    ast->relop = *$2;
+    ast->relop = *unique_ptr<string>($2);
     ast->addExp = unique_ptr<BaseAST>($3);
     $$ = ast;
   }
@@ -495,16 +591,12 @@ RelExp
 
 EqExp
   : RelExp {
-    auto ast = new EqExpAST();
-    ast->selection = 1;
-    ast->relExp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | EqExp EQOP RelExp {
     auto ast = new EqExpAST();
-    ast->selection = 2;
     ast->eqExp = unique_ptr<BaseAST>($1);
-    ast->eqop = *$2;
+    ast->eqop = *unique_ptr<string>($2);
     ast->relExp = unique_ptr<BaseAST>($3);
     $$ = ast;
   }
@@ -512,14 +604,10 @@ EqExp
 
 LAndExp
   : EqExp {
-    auto ast = new LAndExpAST();
-    ast->selection = 1;
-    ast->eqExp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | LAndExp LOGICAND EqExp {
     auto ast = new LAndExpAST();
-    ast->selection = 2;
     ast->landExp = unique_ptr<BaseAST>($1);
     ast->eqExp = unique_ptr<BaseAST>($3);
     $$ = ast;
@@ -528,14 +616,10 @@ LAndExp
 
 LOrExp
   : LAndExp {
-    auto ast = new LOrExpAST();
-    ast->selection = 1;
-    ast->landExp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | LOrExp LOGICOR LAndExp {
     auto ast = new LOrExpAST();
-    ast->selection = 2;
     ast->lorExp = unique_ptr<BaseAST>($1);
     ast->landExp = unique_ptr<BaseAST>($3);
     $$ = ast;
@@ -544,14 +628,13 @@ LOrExp
 
 ConstExp
   : Exp {
-    auto ast = new ConstExpAST();
-    ast->exp = unique_ptr<BaseAST>($1);
+    $$ = $1;
   }
 %%
 
 // 定义错误处理函数, 其中第二个参数是错误信息
 // parser 如果发生错误 (例如输入的程序出现了语法错误), 就会调用这个函数
-void yyerror(unique_ptr<BaseAST> &ast, const char *s) {
+void yyerror(unique_ptr<BaseAST> &ast, const function<void(const string &)> &emitFunc, const char *s) {
   extern int yylineno;	// defined and maintained in lex
 	extern char *yytext;	// defined and maintained in lex
 	int len=strlen(yytext);
@@ -563,3 +646,28 @@ void yyerror(unique_ptr<BaseAST> &ast, const char *s) {
 	}
 	fprintf(stderr, "PARSER ERROR: %s at symbol '%c' on line %d\n", s, atoi(buf), yylineno);
 }
+
+// 批量/服务模式下在两个作业之间调用：ast已经析构，清空前端的全局状态，AST节点池留给下一个作业
+// 这些状态是ast.hpp和sbt.hpp中的static变量，每个编译单元各有一份，前端只使用本文件中的这一份
+void resetFrontend() {
+  next_t_id = 0;
+  basic_block_tag_id = 0;
+  loop_tags.clear();
+  func_table.clear();
+  cur_func_void = false;
+  foundNameId.clear();
+  TYPE_HASH.clear();
+  for (auto &block : BLOCK_HASH)
+    delete block.second;
+  BLOCK_HASH.clear();
+  for (auto block : TYPE_SBT)
+    delete block;
+  TYPE_SBT.clear();
+  for (auto block : SBT)
+    delete block;
+  SBT.clear();
+  global_block_id = 0;
+  unit_begun = false;
+  func_mark = ASTPool::Mark();
+  ast_pool.reset();
+}
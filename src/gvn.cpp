@@ -0,0 +1,231 @@
+#include "passes.hpp"
+#include <map>
+#include <tuple>
+
+using namespace std;
+
+// 基于支配树的全局值编号
+// 按支配树先序遍历，作用域哈希表中只保存支配当前块的表达式，
+// 被支配的块中遇到相同的纯运算或可证明未被改写的load时直接复用之前的结果
+namespace
+{
+    typedef tuple<int, IRValue *, IRValue *> ExprKey;
+
+    bool isCommutative(IRBinOp op)
+    {
+        switch (op)
+        {
+        case IR_NE:
+        case IR_EQ:
+        case IR_ADD:
+        case IR_MUL:
+        case IR_AND:
+        case IR_OR:
+        case IR_XOR:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // 交换操作数后语义不变的比较运算：a > b 等价于 b < a
+    bool getSwappedCmp(IRBinOp op, IRBinOp &swapped)
+    {
+        switch (op)
+        {
+        case IR_GT:
+            swapped = IR_LT;
+            return true;
+        case IR_LT:
+            swapped = IR_GT;
+            return true;
+        case IR_GE:
+            swapped = IR_LE;
+            return true;
+        case IR_LE:
+            swapped = IR_GE;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // 规范化：可交换运算按操作数地址排序，比较运算统一成lhs < rhs的形式
+    ExprKey makeKey(IRBinOp op, IRValue *lhs, IRValue *rhs)
+    {
+        IRBinOp swapped;
+        if (lhs > rhs)
+        {
+            if (isCommutative(op))
+                swap(lhs, rhs);
+            else if (getSwappedCmp(op, swapped))
+            {
+                op = swapped;
+                swap(lhs, rhs);
+            }
+        }
+        return ExprKey(op, lhs, rhs);
+    }
+
+    class GVNPass
+    {
+    public:
+        GVNPass(IRFunction &func, DomTree &dom) : func(func), dom(dom)
+        {
+            local = collectLocalAllocs(func);
+        }
+
+        bool run()
+        {
+            if (func.blocks.empty())
+                return false;
+            struct Frame
+            {
+                int block;
+                size_t child;
+                vector<ExprKey> inserted;
+                unordered_map<IRValue *, IRValue *> loads; // 进入块时可用的load（地址 -> 值）
+            };
+            vector<Frame> dfs;
+            dfs.push_back({0, 0, {}, {}});
+            bool entering = true;
+            while (!dfs.empty())
+            {
+                Frame &frame = dfs.back();
+                if (entering)
+                {
+                    visitBlock(func.blocks[frame.block], frame.inserted, frame.loads);
+                    entering = false;
+                }
+                if (frame.child < dom.children[frame.block].size())
+                {
+                    int child = dom.children[frame.block][frame.child++];
+                    // 从支配者到该块的路径上可能有store，先去掉被改写的地址
+                    unordered_map<IRValue *, IRValue *> loads = frame.loads;
+                    killClobbered(child, frame.block, loads);
+                    dfs.push_back({child, 0, {}, move(loads)});
+                    entering = true;
+                    continue;
+                }
+                for (auto &key : frame.inserted)
+                    exprs.erase(key);
+                dfs.pop_back();
+            }
+            if (repl.empty())
+                return false;
+            func.sweep();
+            func.replaceUses(repl);
+            PruneBlockParams(func);
+            return true;
+        }
+
+    private:
+        IRFunction &func;
+        DomTree &dom;
+        unordered_set<IRValue *> local;
+        map<ExprKey, IRValue *> exprs; // 当前作用域内可用的表达式
+        unordered_map<IRValue *, IRValue *> repl;
+
+        IRValue *resolve(IRValue *v)
+        {
+            auto it = repl.find(v);
+            return it == repl.end() ? v : it->second;
+        }
+
+        // 按store/call修改可用load表
+        void clobber(IRValue *inst, unordered_map<IRValue *, IRValue *> &loads)
+        {
+            if (inst->kind == IR_STORE && local.count(inst->ops[1]))
+            {
+                loads.erase(inst->ops[1]);
+                return;
+            }
+            // 写入未知地址或调用函数：只有未逃逸的alloc仍然可靠
+            for (auto it = loads.begin(); it != loads.end();)
+            {
+                if (local.count(it->first))
+                    ++it;
+                else
+                    it = loads.erase(it);
+            }
+        }
+
+        void visitBlock(IRBlock *bb, vector<ExprKey> &inserted, unordered_map<IRValue *, IRValue *> &loads)
+        {
+            for (auto inst : bb->insts)
+            {
+                if (inst->kind == IR_BINARY)
+                {
+                    ExprKey key = makeKey(inst->op, resolve(inst->ops[0]), resolve(inst->ops[1]));
+                    auto it = exprs.find(key);
+                    if (it != exprs.end())
+                    {
+                        repl[inst] = it->second;
+                        inst->dead = true;
+                        continue;
+                    }
+                    exprs[key] = inst;
+                    inserted.push_back(key);
+                }
+                else if (inst->kind == IR_LOAD)
+                {
+                    IRValue *addr = resolve(inst->ops[0]);
+                    auto it = loads.find(addr);
+                    if (it != loads.end())
+                    {
+                        repl[inst] = it->second;
+                        inst->dead = true;
+                        continue;
+                    }
+                    loads[addr] = inst;
+                }
+                else if (inst->kind == IR_STORE || inst->kind == IR_CALL)
+                {
+                    clobber(inst, loads);
+                }
+            }
+        }
+
+        // 删除从idom的出口到块entry之间（不含idom本身）所有路径上被改写的load
+        void killClobbered(int entry, int idom, unordered_map<IRValue *, IRValue *> &loads)
+        {
+            if (loads.empty())
+                return;
+            IRBlock *bb = func.blocks[entry];
+            if (bb->preds.size() == 1 && bb->preds[0]->id == idom)
+                return;
+            vector<bool> visited(func.blocks.size(), false);
+            vector<int> work;
+            for (auto pred : bb->preds)
+            {
+                if (pred->id != idom && !visited[pred->id])
+                {
+                    visited[pred->id] = true;
+                    work.push_back(pred->id);
+                }
+            }
+            while (!work.empty() && !loads.empty())
+            {
+                IRBlock *cur = func.blocks[work.back()];
+                work.pop_back();
+                for (auto inst : cur->insts)
+                    if (inst->kind == IR_STORE || inst->kind == IR_CALL)
+                        clobber(inst, loads);
+                for (auto pred : cur->preds)
+                {
+                    if (pred->id != idom && !visited[pred->id])
+                    {
+                        visited[pred->id] = true;
+                        work.push_back(pred->id);
+                    }
+                }
+            }
+        }
+    };
+}
+
+bool GVN(IRFunction &func, AnalysisManager &am)
+{
+    GVNPass pass(func, am.getDomTree(func));
+    return pass.run();
+}
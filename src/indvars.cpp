@@ -0,0 +1,130 @@
+#include "passes.hpp"
+
+using namespace std;
+
+// 归纳变量强度削弱
+// 循环内的 d = p * f（p为基本归纳变量，f在循环内不变）改写为新的归纳变量：
+// 初值 init * f，每次迭代加 step * f，乘法变为加法（32位回绕下两者等价）
+namespace
+{
+    class StrengthReducer
+    {
+    public:
+        explicit StrengthReducer(IRFunction &func) : func(func) {}
+
+        bool run(LoopInfo &loops)
+        {
+            bool changed = false;
+            for (auto loop : loops.innermostFirst())
+                changed |= reduce(*loop);
+            return changed;
+        }
+
+    private:
+        IRFunction &func;
+
+        bool isInvariant(Loop &loop, IRValue *v)
+        {
+            if (!v->parent)
+                return v->kind != IR_BLOCK_ARG;
+            return !loop.contains(v->parent);
+        }
+
+        // d是否为 p * f 的形式，是则返回f
+        IRValue *getFactor(Loop &loop, IRValue *inst, IRValue *param)
+        {
+            if (inst->kind != IR_BINARY)
+                return nullptr;
+            IRValue *lhs = inst->ops[0], *rhs = inst->ops[1];
+            if (inst->op == IR_MUL)
+            {
+                if (lhs == param && isInvariant(loop, rhs))
+                    return rhs;
+                if (rhs == param && isInvariant(loop, lhs))
+                    return lhs;
+            }
+            // p << c 即 p * 2^c
+            if (inst->op == IR_SHL && lhs == param && rhs->kind == IR_INT && rhs->imm >= 0 && rhs->imm < 32)
+                return func.getInt((int32_t)(1u << rhs->imm));
+            return nullptr;
+        }
+
+        // 在块末尾（终结指令之前）插入二元运算，两侧都是常量时直接计算
+        IRValue *emitBinary(IRBlock *bb, IRBinOp op, IRValue *lhs, IRValue *rhs)
+        {
+            int32_t val;
+            if (lhs->kind == IR_INT && rhs->kind == IR_INT && foldBinOp(op, lhs->imm, rhs->imm, val))
+                return func.getInt(val);
+            IRValue *inst = func.newValue(IR_BINARY);
+            inst->op = op;
+            inst->ops = {lhs, rhs};
+            inst->hasResult = true;
+            inst->parent = bb;
+            bb->insts.insert(bb->insts.end() - 1, inst);
+            return inst;
+        }
+
+        bool reduce(Loop &loop)
+        {
+            vector<InductionVar> ivs = findInductionVars(loop);
+            if (ivs.empty())
+                return false;
+            vector<pair<IRValue *, const InductionVar *>> candidates;
+            vector<IRValue *> factors;
+            for (auto bb : loop.blocks)
+            {
+                for (auto inst : bb->insts)
+                {
+                    for (auto &iv : ivs)
+                    {
+                        // 归纳变量自身的递推不需要改写
+                        if (inst == iv.next)
+                            continue;
+                        IRValue *factor = getFactor(loop, inst, iv.param);
+                        if (!factor)
+                            continue;
+                        candidates.push_back({inst, &iv});
+                        factors.push_back(factor);
+                        break;
+                    }
+                }
+            }
+            if (candidates.empty())
+                return false;
+
+            IRBlock *pre = insertPreheader(func, loop);
+            IREdge entry, latch;
+            getLoopEdges(loop, entry, latch);
+            IRBlock *latch_bb = latch.first->parent;
+            unordered_map<IRValue *, IRValue *> repl;
+            for (size_t i = 0; i < candidates.size(); ++i)
+            {
+                IRValue *inst = candidates[i].first;
+                const InductionVar &iv = *candidates[i].second;
+                IRValue *factor = factors[i];
+                IRValue *init = emitBinary(pre, IR_MUL, entry.first->args[entry.second][iv.index], factor);
+                IRValue *step = emitBinary(pre, IR_MUL, factor, func.getInt(iv.step));
+
+                IRValue *param = func.newValue(IR_BLOCK_ARG);
+                param->hasResult = true;
+                param->parent = loop.header;
+                loop.header->params.push_back(param);
+                IRValue *next = emitBinary(latch_bb, IR_ADD, param, step);
+                entry.first->args[entry.second].push_back(init);
+                latch.first->args[latch.second].push_back(next);
+
+                repl[inst] = param;
+                inst->dead = true;
+            }
+            func.sweep();
+            func.replaceUses(repl);
+            return true;
+        }
+    };
+}
+
+bool StrengthReduce(IRFunction &func, AnalysisManager &am)
+{
+    StrengthReducer reducer(func);
+    return reducer.run(am.getLoopInfo(func));
+}
@@ -0,0 +1,332 @@
+#include "passes.hpp"
+#include <algorithm>
+
+using namespace std;
+
+// 自底向上的函数内联
+// 按调用图强连通分量的逆拓扑序处理（被调函数先于调用者），被调函数已经内联过它自己的调用；
+// 同一分量内的调用是递归，不内联。
+// 代价模型：被调函数的指令数，减去省掉的调用开销和常量实参带来的收益，不超过阈值时内联；
+// 只有一个调用点的函数和很小的叶子函数总是内联。最后删除不再被调用的函数（main除外）
+// 流式编译时（InlineCalls）每次只处理一个函数，被调函数是已经处理过的函数的副本；
+// 不知道之后还有哪些调用者，因此不用只有一个调用点的规则，也不删除函数
+namespace
+{
+    const size_t TINY_FUNC_SIZE = 8;      // 不超过该大小的叶子函数总是内联
+    const int CALL_COST = 5;              // 调用本身的开销：传参、call/ret、保存ra和栈帧
+    const int CONST_ARG_BONUS = 4;        // 每个常量实参，内联后可以继续传播
+    const size_t MAX_CALLER_SIZE = 4000;  // 调用者增长到该大小后不再内联
+
+    size_t getSize(const IRFunction &func)
+    {
+        size_t n = 0;
+        for (auto bb : func.blocks)
+            n += bb->insts.size();
+        return n;
+    }
+
+    bool hasCall(const IRFunction &func)
+    {
+        for (auto bb : func.blocks)
+            for (auto inst : bb->insts)
+                if (inst->kind == IR_CALL)
+                    return true;
+        return false;
+    }
+
+    class Inliner
+    {
+    public:
+        Inliner(IRProgram *prog, int threshold) : prog(prog), threshold(threshold) {}
+
+        bool run()
+        {
+            for (auto &func : prog->funcs)
+                funcs[func->name] = func.get();
+            buildCallGraph();
+            for (auto &func : prog->funcs)
+            {
+                if (!dfs_index.count(func.get()))
+                    strongConnect(func.get());
+            }
+            bool changed = false;
+            for (auto func : order)
+                changed |= inlineCalls(*func);
+            changed |= removeDeadFunctions();
+            return changed;
+        }
+
+        bool runOn(IRFunction &func, const unordered_map<string, IRFunction *> &callees)
+        {
+            streaming = true;
+            funcs = callees;
+            return inlineCalls(func);
+        }
+
+    private:
+        IRProgram *prog;
+        int threshold;
+        bool streaming = false;
+        unordered_map<string, IRFunction *> funcs;
+        unordered_map<IRFunction *, vector<IRFunction *>> callees;
+        unordered_map<IRFunction *, int> call_count; // 每个函数的调用点个数
+
+        // Tarjan算法求强连通分量，order按分量完成的顺序排列（被调函数在前）
+        unordered_map<IRFunction *, int> dfs_index, low, scc;
+        vector<IRFunction *> stack;
+        unordered_set<IRFunction *> on_stack;
+        vector<IRFunction *> order;
+        int dfs_cnt = 0, scc_cnt = 0;
+
+        IRFunction *getCallee(IRValue *call)
+        {
+            auto it = funcs.find(call->callee);
+            return it == funcs.end() ? nullptr : it->second; // 只有声明的外部函数无法内联
+        }
+
+        void buildCallGraph()
+        {
+            for (auto &func : prog->funcs)
+            {
+                auto &list = callees[func.get()];
+                for (auto bb : func->blocks)
+                {
+                    for (auto inst : bb->insts)
+                    {
+                        IRFunction *callee = inst->kind == IR_CALL ? getCallee(inst) : nullptr;
+                        if (!callee)
+                            continue;
+                        ++call_count[callee];
+                        if (find(list.begin(), list.end(), callee) == list.end())
+                            list.push_back(callee);
+                    }
+                }
+            }
+        }
+
+        void strongConnect(IRFunction *func)
+        {
+            dfs_index[func] = low[func] = dfs_cnt++;
+            stack.push_back(func);
+            on_stack.insert(func);
+            for (auto callee : callees[func])
+            {
+                if (!dfs_index.count(callee))
+                {
+                    strongConnect(callee);
+                    low[func] = min(low[func], low[callee]);
+                }
+                else if (on_stack.count(callee))
+                    low[func] = min(low[func], dfs_index[callee]);
+            }
+            if (low[func] != dfs_index[func])
+                return;
+            IRFunction *member;
+            do
+            {
+                member = stack.back();
+                stack.pop_back();
+                on_stack.erase(member);
+                scc[member] = scc_cnt;
+                order.push_back(member);
+            } while (member != func);
+            ++scc_cnt;
+        }
+
+        bool shouldInline(IRFunction &caller, IRFunction &callee, IRValue *call)
+        {
+            if (callee.name == "@main" || (!streaming && scc[&caller] == scc[&callee]))
+                return false;
+            size_t size = getSize(callee);
+            if (getSize(caller) + size > MAX_CALLER_SIZE)
+                return false;
+            // 内联后被调函数会被删除，不会增加代码
+            if (!streaming && call_count[&callee] == 1)
+                return true;
+            if (size <= TINY_FUNC_SIZE && !hasCall(callee))
+                return true;
+            int cost = (int)size - CALL_COST;
+            for (auto arg : call->ops)
+                if (arg->kind == IR_INT)
+                    cost -= CONST_ARG_BONUS;
+            return cost <= threshold;
+        }
+
+        bool inlineCalls(IRFunction &func)
+        {
+            bool changed = false;
+            for (size_t b = 0; b < func.blocks.size(); ++b)
+            {
+                IRBlock *bb = func.blocks[b];
+                for (size_t i = 0; i < bb->insts.size(); ++i)
+                {
+                    IRValue *inst = bb->insts[i];
+                    IRFunction *callee = inst->kind == IR_CALL ? getCallee(inst) : nullptr;
+                    if (!callee || !shouldInline(func, *callee, inst))
+                        continue;
+                    IRBlock *cont = inlineCall(func, bb, i, *callee);
+                    changed = true;
+                    // 复制进来的块中的调用在被调函数中已经处理过，从后继块继续
+                    b = find(func.blocks.begin(), func.blocks.end(), cont) - func.blocks.begin() - 1;
+                    break;
+                }
+            }
+            if (changed)
+                func.buildCFG();
+            return changed;
+        }
+
+        // 把bb中下标为pos的call替换为被调函数的副本，返回call之后的指令所在的新块
+        IRBlock *inlineCall(IRFunction &func, IRBlock *bb, size_t pos, IRFunction &callee)
+        {
+            IRValue *call = bb->insts[pos];
+            string hint = callee.name.substr(1);
+
+            // call之后的指令移入cont，返回值作为cont的参数
+            IRBlock *cont = func.newBlock(hint + "_ret");
+            IRValue *result = nullptr;
+            if (call->hasResult)
+            {
+                result = func.newValue(IR_BLOCK_ARG);
+                result->hasResult = true;
+                result->parent = cont;
+                cont->params.push_back(result);
+            }
+            cont->insts.assign(bb->insts.begin() + pos + 1, bb->insts.end());
+            for (auto inst : cont->insts)
+                inst->parent = cont;
+            bb->insts.resize(pos);
+
+            // 先建立所有块和值的对应，循环中的值可能在定义之前就被（回边的实参）使用
+            unordered_map<IRValue *, IRValue *> vmap;
+            unordered_map<IRBlock *, IRBlock *> bmap;
+            vector<IRBlock *> created;
+            for (size_t i = 0; i < callee.params.size(); ++i)
+                vmap[callee.params[i]] = call->ops[i];
+            for (auto cbb : callee.blocks)
+            {
+                IRBlock *nb = func.newBlock(hint + "_" + cbb->name.substr(1));
+                for (auto param : cbb->params)
+                {
+                    IRValue *copy = func.newValue(IR_BLOCK_ARG);
+                    copy->hasResult = true;
+                    copy->parent = nb;
+                    nb->params.push_back(copy);
+                    vmap[param] = copy;
+                }
+                for (auto inst : cbb->insts)
+                {
+                    // ret改为带着返回值跳到cont
+                    IRValue *copy = func.newValue(inst->kind == IR_RETURN ? IR_JUMP : inst->kind);
+                    copy->parent = nb;
+                    nb->insts.push_back(copy);
+                    vmap[inst] = copy;
+                }
+                bmap[cbb] = nb;
+                created.push_back(nb);
+            }
+            // 常量属于各自的函数，要换成调用者中的常量
+            auto mapValue = [&](IRValue *v)
+            {
+                if (v->kind == IR_INT)
+                    return func.getInt(v->imm);
+                if (v->kind == IR_UNDEF)
+                    return func.getUndef();
+                auto it = vmap.find(v);
+                return it == vmap.end() ? v : it->second;
+            };
+            vector<IRValue *> allocs;
+            for (auto cbb : callee.blocks)
+            {
+                for (auto inst : cbb->insts)
+                {
+                    IRValue *copy = vmap[inst];
+                    if (inst->kind == IR_RETURN)
+                    {
+                        copy->targets = {cont};
+                        copy->args.emplace_back();
+                        if (result)
+                            copy->args[0].push_back(inst->ops.empty() ? func.getUndef() : mapValue(inst->ops[0]));
+                        continue;
+                    }
+                    copy->op = inst->op;
+                    copy->imm = inst->imm;
+                    copy->hasResult = inst->hasResult;
+                    copy->callee = inst->callee;
+                    for (auto op : inst->ops)
+                        copy->ops.push_back(mapValue(op));
+                    for (auto target : inst->targets)
+                        copy->targets.push_back(bmap[target]);
+                    for (auto &list : inst->args)
+                    {
+                        copy->args.emplace_back();
+                        for (auto arg : list)
+                            copy->args.back().push_back(mapValue(arg));
+                    }
+                    if (inst->kind == IR_CALL && getCallee(inst))
+                        ++call_count[getCallee(inst)];
+                    // 同一函数可能被内联多次，alloc不能沿用原来的名字
+                    if (inst->kind == IR_ALLOC)
+                        allocs.push_back(copy);
+                }
+            }
+            --call_count[&callee];
+
+            // alloc统一放到调用者的入口块
+            for (auto alloc : allocs)
+            {
+                auto &insts = alloc->parent->insts;
+                insts.erase(find(insts.begin(), insts.end(), alloc));
+            }
+            IRBlock *entry = func.blocks[0];
+            for (auto alloc : allocs)
+                alloc->parent = entry;
+            entry->insts.insert(entry->insts.begin(), allocs.begin(), allocs.end());
+
+            IRValue *jump = func.newValue(IR_JUMP);
+            jump->parent = bb;
+            jump->targets = {bmap[callee.blocks[0]]};
+            jump->args.emplace_back();
+            bb->insts.push_back(jump);
+
+            created.push_back(cont);
+            auto it = find(func.blocks.begin(), func.blocks.end(), bb);
+            func.blocks.insert(it + 1, created.begin(), created.end());
+            if (result)
+                func.replaceUses({{call, result}});
+            return cont;
+        }
+
+        bool removeDeadFunctions()
+        {
+            size_t n = prog->funcs.size();
+            prog->funcs.erase(remove_if(prog->funcs.begin(), prog->funcs.end(), [&](const unique_ptr<IRFunction> &func)
+                                        { return func->name != "@main" && !call_count[func.get()]; }),
+                              prog->funcs.end());
+            return n != prog->funcs.size();
+        }
+    };
+}
+
+bool Inline(IRProgram &prog, int threshold)
+{
+    Inliner inliner(&prog, threshold);
+    return inliner.run();
+}
+
+bool InlineCalls(IRFunction &func, const unordered_map<string, IRFunction *> &callees, int threshold)
+{
+    Inliner inliner(nullptr, threshold);
+    return inliner.runOn(func, callees);
+}
+
+bool MayInline(const IRFunction &func, int threshold)
+{
+    if (func.name == "@main")
+        return false;
+    size_t size = getSize(func);
+    if (size <= TINY_FUNC_SIZE && !hasCall(func))
+        return true;
+    // 所有实参都是常量时代价最小
+    return (int)size - CALL_COST - CONST_ARG_BONUS * (int)func.params.size() <= threshold;
+}
@@ -0,0 +1,395 @@
+#include "passes.hpp"
+#include <cassert>
+#include <cctype>
+
+using namespace std;
+
+// 指令合并：按声明式的改写规则表化简二元运算，用工作表迭代到不动点
+// 规则写成前缀表达式 (op a b)，叶子为：
+//   x、y       任意值，同名的变量必须匹配同一个值
+//   c1、c2     任意整数常量
+//   b          比较运算的结果（只会是0或1）
+//   整数       等于该值的常量
+// 结果中只含常量的子表达式在改写时直接求值，其余子表达式生成新指令
+// 可交换运算匹配时会尝试交换操作数；匹配前常量统一放到右边
+namespace
+{
+    const char *const RULES[][2] = {
+        // 恒等式
+        {"(add x 0)", "x"},
+        {"(sub x x)", "0"},
+        {"(mul x 0)", "0"},
+        {"(mul x 1)", "x"},
+        {"(mul x -1)", "(sub 0 x)"},
+        {"(div x 1)", "x"},
+        {"(div x -1)", "(sub 0 x)"},
+        {"(mod x 1)", "0"},
+        {"(mod x -1)", "0"},
+        {"(and x 0)", "0"},
+        {"(and x -1)", "x"},
+        {"(and x x)", "x"},
+        {"(or x 0)", "x"},
+        {"(or x -1)", "-1"},
+        {"(or x x)", "x"},
+        {"(xor x 0)", "x"},
+        {"(xor x x)", "0"},
+        {"(shl x 0)", "x"},
+        {"(shr x 0)", "x"},
+        {"(sar x 0)", "x"},
+        {"(eq x x)", "1"},
+        {"(ne x x)", "0"},
+        {"(lt x x)", "0"},
+        {"(gt x x)", "0"},
+        {"(le x x)", "1"},
+        {"(ge x x)", "1"},
+        // 取负与加减抵消
+        {"(sub 0 (sub 0 x))", "x"},
+        {"(sub x (sub 0 y))", "(add x y)"},
+        {"(add x (sub 0 y))", "(sub x y)"},
+        {"(sub (add x y) y)", "x"},
+        {"(add (sub x y) y)", "x"},
+        {"(sub x (sub x y))", "y"},
+        // 常量重结合：减常量统一为加常量，相邻的常量合并
+        {"(sub x c1)", "(add x (sub 0 c1))"},
+        {"(add (add x c1) c2)", "(add x (add c1 c2))"},
+        {"(add (sub c1 x) c2)", "(sub (add c1 c2) x)"},
+        {"(sub c1 (add x c2))", "(sub (sub c1 c2) x)"},
+        {"(sub c1 (sub c2 x))", "(add x (sub c1 c2))"},
+        {"(mul (mul x c1) c2)", "(mul x (mul c1 c2))"},
+        {"(and (and x c1) c2)", "(and x (and c1 c2))"},
+        {"(or (or x c1) c2)", "(or x (or c1 c2))"},
+        {"(xor (xor x c1) c2)", "(xor x (xor c1 c2))"},
+        // 布尔值规范化：比较结果与0/1比较时化为原比较或其反
+        {"(ne b 0)", "b"},
+        {"(eq b 1)", "b"},
+        {"(and b 1)", "b"},
+        {"(ne b 1)", "(eq b 0)"},
+        {"(xor b 1)", "(eq b 0)"},
+        {"(eq (eq x y) 0)", "(ne x y)"},
+        {"(eq (ne x y) 0)", "(eq x y)"},
+        {"(eq (lt x y) 0)", "(ge x y)"},
+        {"(eq (ge x y) 0)", "(lt x y)"},
+        {"(eq (gt x y) 0)", "(le x y)"},
+        {"(eq (le x y) 0)", "(gt x y)"},
+    };
+
+    enum PatternKind
+    {
+        PAT_ANY,   // x、y
+        PAT_CONST, // c1、c2
+        PAT_BOOL,  // b
+        PAT_INT,
+        PAT_BINARY
+    };
+
+    class Pattern
+    {
+    public:
+        PatternKind kind;
+        int var = -1; // 变量的编号
+        int32_t imm = 0;
+        IRBinOp op = IR_ADD;
+        vector<Pattern> subs;
+    };
+
+    class Rule
+    {
+    public:
+        Pattern from, to;
+        int numVars = 0;
+    };
+
+    class PatternParser
+    {
+    public:
+        PatternParser(const char *text, unordered_map<string, int> &vars) : p(text), vars(vars) {}
+
+        Pattern parse()
+        {
+            skipSpace();
+            Pattern pat;
+            if (*p == '(')
+            {
+                ++p;
+                string name = word();
+                bool ok = getBinOpByName(name, pat.op);
+                assert(ok);
+                pat.kind = PAT_BINARY;
+                pat.subs.push_back(parse());
+                pat.subs.push_back(parse());
+                skipSpace();
+                assert(*p == ')');
+                ++p;
+                return pat;
+            }
+            string name = word();
+            if (isdigit(name[0]) || name[0] == '-')
+            {
+                pat.kind = PAT_INT;
+                pat.imm = stoi(name);
+                return pat;
+            }
+            pat.kind = name[0] == 'c' ? PAT_CONST : name == "b" ? PAT_BOOL : PAT_ANY;
+            if (!vars.count(name))
+            {
+                int id = vars.size();
+                vars[name] = id;
+            }
+            pat.var = vars[name];
+            return pat;
+        }
+
+    private:
+        const char *p;
+        unordered_map<string, int> &vars;
+
+        void skipSpace()
+        {
+            while (isspace(*p))
+                ++p;
+        }
+
+        string word()
+        {
+            skipSpace();
+            const char *start = p;
+            while (*p && !isspace(*p) && *p != '(' && *p != ')')
+                ++p;
+            return string(start, p);
+        }
+    };
+
+    vector<Rule> parseRules()
+    {
+        vector<Rule> rules;
+        for (auto &text : RULES)
+        {
+            unordered_map<string, int> vars;
+            Rule rule;
+            rule.from = PatternParser(text[0], vars).parse();
+            size_t bound = vars.size();
+            rule.to = PatternParser(text[1], vars).parse();
+            assert(vars.size() == bound); // 结果中不能出现未绑定的变量
+            rule.numVars = vars.size();
+            rules.push_back(move(rule));
+        }
+        return rules;
+    }
+
+    // 静态局部变量的初始化是线程安全的，多个线程同时运行时只解析一次
+    const vector<Rule> &getRules()
+    {
+        static const vector<Rule> rules = parseRules();
+        return rules;
+    }
+
+    bool isCommutative(IRBinOp op)
+    {
+        return op == IR_NE || op == IR_EQ || op == IR_ADD || op == IR_MUL || op == IR_AND || op == IR_OR || op == IR_XOR;
+    }
+
+    bool isCompare(IRBinOp op)
+    {
+        return op <= IR_LE;
+    }
+
+    class InstCombiner
+    {
+    public:
+        InstCombiner(IRFunction &func) : func(func) {}
+
+        bool run()
+        {
+            for (auto bb : func.blocks)
+            {
+                for (auto inst : bb->insts)
+                {
+                    forEachOperand(inst, [&](IRValue *&op)
+                                   { users[op].push_back(inst); });
+                }
+            }
+            // 倒序入栈，按程序顺序处理，操作数先于使用者被化简
+            for (auto it = func.blocks.rbegin(); it != func.blocks.rend(); ++it)
+                for (auto inst = (*it)->insts.rbegin(); inst != (*it)->insts.rend(); ++inst)
+                    push(*inst);
+            bool changed = false;
+            while (!worklist.empty())
+            {
+                IRValue *inst = worklist.back();
+                worklist.pop_back();
+                queued.erase(inst);
+                if (!inst->dead && inst->kind == IR_BINARY)
+                    changed |= visit(inst);
+            }
+            if (changed)
+                func.sweep();
+            return changed;
+        }
+
+    private:
+        IRFunction &func;
+        unordered_map<IRValue *, vector<IRValue *>> users;
+        vector<IRValue *> worklist;
+        unordered_set<IRValue *> queued;
+
+        void push(IRValue *inst)
+        {
+            if (inst->kind == IR_BINARY && queued.insert(inst).second)
+                worklist.push_back(inst);
+        }
+
+        void pushUsers(IRValue *inst)
+        {
+            for (auto user : users[inst])
+                push(user);
+        }
+
+        bool visit(IRValue *inst)
+        {
+            IRValue *lhs = inst->ops[0], *rhs = inst->ops[1];
+            int32_t val;
+            if (lhs->kind == IR_INT && rhs->kind == IR_INT)
+            {
+                // 除数为0时保留原指令
+                if (!foldBinOp(inst->op, lhs->imm, rhs->imm, val))
+                    return false;
+                replace(inst, func.getInt(val));
+                return true;
+            }
+            if (lhs->kind == IR_INT && canonicalize(inst))
+            {
+                push(inst);
+                pushUsers(inst);
+                return true;
+            }
+            for (auto &rule : getRules())
+            {
+                vector<IRValue *> binds(rule.numVars, nullptr);
+                if (!match(rule.from, inst, binds))
+                    continue;
+                apply(rule.to, inst, binds);
+                return true;
+            }
+            return false;
+        }
+
+        // 常量放到右边：可交换运算直接交换，比较运算交换后改为对称的比较
+        bool canonicalize(IRValue *inst)
+        {
+            static const IRBinOp swapped[] = {IR_NE, IR_EQ, IR_LT, IR_GT, IR_LE, IR_GE};
+            if (isCompare(inst->op))
+                inst->op = swapped[inst->op];
+            else if (!isCommutative(inst->op))
+                return false;
+            swap(inst->ops[0], inst->ops[1]);
+            return true;
+        }
+
+        bool match(const Pattern &pat, IRValue *v, vector<IRValue *> &binds)
+        {
+            switch (pat.kind)
+            {
+            case PAT_INT:
+                return v->kind == IR_INT && v->imm == pat.imm;
+            case PAT_CONST:
+            case PAT_BOOL:
+            case PAT_ANY:
+                if (pat.kind == PAT_CONST && v->kind != IR_INT)
+                    return false;
+                if (pat.kind == PAT_BOOL && !(v->kind == IR_BINARY && isCompare(v->op)))
+                    return false;
+                if (binds[pat.var])
+                    return binds[pat.var] == v;
+                binds[pat.var] = v;
+                return true;
+            case PAT_BINARY:
+            {
+                if (v->kind != IR_BINARY || v->dead || v->op != pat.op)
+                    return false;
+                vector<IRValue *> saved = binds;
+                if (match(pat.subs[0], v->ops[0], binds) && match(pat.subs[1], v->ops[1], binds))
+                    return true;
+                binds = saved;
+                if (isCommutative(pat.op) && match(pat.subs[0], v->ops[1], binds) && match(pat.subs[1], v->ops[0], binds))
+                    return true;
+                binds = saved;
+                return false;
+            }
+            }
+            return false;
+        }
+
+        // 生成结果的子表达式，新指令插在before之前
+        IRValue *build(const Pattern &pat, IRValue *before, const vector<IRValue *> &binds)
+        {
+            if (pat.kind == PAT_INT)
+                return func.getInt(pat.imm);
+            if (pat.kind != PAT_BINARY)
+                return binds[pat.var];
+            IRValue *lhs = build(pat.subs[0], before, binds);
+            IRValue *rhs = build(pat.subs[1], before, binds);
+            int32_t val;
+            if (lhs->kind == IR_INT && rhs->kind == IR_INT && foldBinOp(pat.op, lhs->imm, rhs->imm, val))
+                return func.getInt(val);
+            IRValue *inst = func.newValue(IR_BINARY);
+            inst->op = pat.op;
+            inst->hasResult = true;
+            inst->ops = {lhs, rhs};
+            inst->parent = before->parent;
+            auto &insts = before->parent->insts;
+            insts.insert(find(insts.begin(), insts.end(), before), inst);
+            users[lhs].push_back(inst);
+            users[rhs].push_back(inst);
+            push(inst);
+            return inst;
+        }
+
+        void apply(const Pattern &to, IRValue *inst, const vector<IRValue *> &binds)
+        {
+            if (to.kind != PAT_BINARY)
+            {
+                replace(inst, build(to, inst, binds));
+                return;
+            }
+            IRValue *lhs = build(to.subs[0], inst, binds);
+            IRValue *rhs = build(to.subs[1], inst, binds);
+            int32_t val;
+            if (lhs->kind == IR_INT && rhs->kind == IR_INT && foldBinOp(to.op, lhs->imm, rhs->imm, val))
+            {
+                replace(inst, func.getInt(val));
+                return;
+            }
+            // 原地改写，使用者的操作数不用改
+            inst->op = to.op;
+            inst->ops = {lhs, rhs};
+            users[lhs].push_back(inst);
+            users[rhs].push_back(inst);
+            push(inst);
+            pushUsers(inst);
+        }
+
+        void replace(IRValue *inst, IRValue *v)
+        {
+            inst->dead = true;
+            for (auto user : users[inst])
+            {
+                if (user->dead)
+                    continue;
+                forEachOperand(user, [&](IRValue *&op)
+                               {
+                                   if (op == inst)
+                                       op = v;
+                               });
+                users[v].push_back(user);
+                push(user);
+            }
+            users.erase(inst);
+        }
+    };
+}
+
+bool InstCombine(IRFunction &func)
+{
+    InstCombiner combiner(func);
+    return combiner.run();
+}
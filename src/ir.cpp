@@ -0,0 +1,1087 @@
+#include "ir.hpp"
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <sstream>
+#include <unordered_set>
+
+using namespace std;
+
+static const char *BIN_OP_NAMES[] = {"ne", "eq", "gt", "lt", "ge", "le", "add", "sub", "mul",
+                                     "div", "mod", "and", "or", "xor", "shl", "shr", "sar"};
+
+const char *getBinOpName(IRBinOp op)
+{
+    return BIN_OP_NAMES[op];
+}
+
+bool getBinOpByName(const string &name, IRBinOp &op)
+{
+    for (int i = IR_NE; i <= IR_SAR; ++i)
+    {
+        if (name == BIN_OP_NAMES[i])
+        {
+            op = (IRBinOp)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool foldBinOp(IRBinOp op, int32_t lhs, int32_t rhs, int32_t &result)
+{
+    // 加减乘和移位按无符号计算，避免有符号溢出的未定义行为
+    uint32_t l = lhs, r = rhs;
+    switch (op)
+    {
+    case IR_NE:
+        result = lhs != rhs;
+        break;
+    case IR_EQ:
+        result = lhs == rhs;
+        break;
+    case IR_GT:
+        result = lhs > rhs;
+        break;
+    case IR_LT:
+        result = lhs < rhs;
+        break;
+    case IR_GE:
+        result = lhs >= rhs;
+        break;
+    case IR_LE:
+        result = lhs <= rhs;
+        break;
+    case IR_ADD:
+        result = (int32_t)(l + r);
+        break;
+    case IR_SUB:
+        result = (int32_t)(l - r);
+        break;
+    case IR_MUL:
+        result = (int32_t)(l * r);
+        break;
+    case IR_DIV:
+    case IR_MOD:
+        if (rhs == 0 || (lhs == INT32_MIN && rhs == -1))
+            return false;
+        result = op == IR_DIV ? lhs / rhs : lhs % rhs;
+        break;
+    case IR_AND:
+        result = lhs & rhs;
+        break;
+    case IR_OR:
+        result = lhs | rhs;
+        break;
+    case IR_XOR:
+        result = lhs ^ rhs;
+        break;
+    case IR_SHL:
+        result = (int32_t)(l << (r & 31));
+        break;
+    case IR_SHR:
+        result = (int32_t)(l >> (r & 31));
+        break;
+    case IR_SAR:
+        result = lhs >> (r & 31);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+void forEachOperand(IRValue *inst, const function<void(IRValue *&)> &fn)
+{
+    for (auto &op : inst->ops)
+        fn(op);
+    for (auto &list : inst->args)
+        for (auto &arg : list)
+            fn(arg);
+}
+
+vector<vector<IREdge>> collectIncomingEdges(IRFunction &func)
+{
+    vector<vector<IREdge>> incoming(func.blocks.size());
+    for (auto bb : func.blocks)
+    {
+        IRValue *term = bb->terminator();
+        if (!term)
+            continue;
+        for (size_t k = 0; k < term->targets.size(); ++k)
+            incoming[term->targets[k]->id].push_back({term, k});
+    }
+    return incoming;
+}
+
+void eraseBlockParams(IRBlock *bb, const vector<bool> &keep, vector<IREdge> &edges)
+{
+    vector<IRValue *> params;
+    for (size_t i = 0; i < bb->params.size(); ++i)
+        if (keep[i])
+            params.push_back(bb->params[i]);
+    bb->params.swap(params);
+    for (auto &edge : edges)
+    {
+        auto &list = edge.first->args[edge.second];
+        vector<IRValue *> kept;
+        for (size_t i = 0; i < list.size(); ++i)
+            if (keep[i])
+                kept.push_back(list[i]);
+        list.swap(kept);
+    }
+}
+
+IRValue *IRFunction::newValue(IRKind kind)
+{
+    value_pool.emplace_back(new IRValue());
+    value_pool.back()->kind = kind;
+    return value_pool.back().get();
+}
+
+IRBlock *IRFunction::newBlock(const string &hint)
+{
+    string name;
+    do
+    {
+        name = "%" + hint + "_" + to_string(block_name_cnt++);
+    } while (block_names.count(name));
+    return createBlock(name);
+}
+
+IRBlock *IRFunction::createBlock(const string &name)
+{
+    block_names.insert(name);
+    block_pool.emplace_back(new IRBlock());
+    block_pool.back()->name = name;
+    return block_pool.back().get();
+}
+
+IRValue *IRFunction::getInt(int32_t val)
+{
+    auto it = int_pool.find(val);
+    if (it != int_pool.end())
+        return it->second;
+    IRValue *v = newValue(IR_INT);
+    v->imm = val;
+    v->hasResult = true;
+    int_pool.emplace(val, v);
+    return v;
+}
+
+IRValue *IRFunction::getUndef()
+{
+    if (!undef)
+    {
+        undef = newValue(IR_UNDEF);
+        undef->hasResult = true;
+    }
+    return undef;
+}
+
+void IRFunction::buildCFG()
+{
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        blocks[i]->id = i;
+        blocks[i]->preds.clear();
+        blocks[i]->succs.clear();
+    }
+    for (auto bb : blocks)
+    {
+        IRValue *term = bb->terminator();
+        if (!term)
+            continue;
+        for (auto target : term->targets)
+        {
+            // 同一条br的两个目标相同时只记一条边
+            if (find(bb->succs.begin(), bb->succs.end(), target) != bb->succs.end())
+                continue;
+            bb->succs.push_back(target);
+            target->preds.push_back(bb);
+        }
+    }
+}
+
+bool IRFunction::removeUnreachableBlocks()
+{
+    buildCFG();
+    if (blocks.empty())
+        return false;
+    vector<bool> reached(blocks.size(), false);
+    vector<IRBlock *> work = {blocks[0]};
+    reached[0] = true;
+    while (!work.empty())
+    {
+        IRBlock *bb = work.back();
+        work.pop_back();
+        for (auto succ : bb->succs)
+        {
+            if (reached[succ->id])
+                continue;
+            reached[succ->id] = true;
+            work.push_back(succ);
+        }
+    }
+    bool changed = false;
+    for (auto bb : blocks)
+    {
+        if (reached[bb->id])
+            continue;
+        bb->dead = true;
+        changed = true;
+    }
+    if (changed)
+    {
+        sweep();
+        buildCFG();
+    }
+    return changed;
+}
+
+void IRFunction::canonicalizeNames()
+{
+    unordered_set<string> used; // 形参的名字保持不变，新名字要避开
+    for (auto param : params)
+        used.insert(param->name);
+    unordered_map<string, int> seq;
+    auto rename = [&](string &name)
+    {
+        if (name.empty() || !isdigit(name.back()))
+            return;
+        while (isdigit(name.back()))
+            name.pop_back();
+        string base = name;
+        do
+        {
+            name = base + to_string(seq[base]++);
+        } while (used.count(name));
+        used.insert(name);
+    };
+    block_names.clear();
+    for (auto bb : blocks)
+    {
+        rename(bb->name);
+        block_names.insert(bb->name);
+        for (auto inst : bb->insts)
+            if (inst->kind == IR_ALLOC)
+                rename(inst->name);
+    }
+}
+
+void IRFunction::sweep()
+{
+    blocks.erase(remove_if(blocks.begin(), blocks.end(), [](IRBlock *bb)
+                           { return bb->dead; }),
+                 blocks.end());
+    for (auto bb : blocks)
+    {
+        bb->insts.erase(remove_if(bb->insts.begin(), bb->insts.end(), [](IRValue *v)
+                                  { return v->dead; }),
+                        bb->insts.end());
+    }
+}
+
+void IRFunction::replaceUses(const unordered_map<IRValue *, IRValue *> &repl)
+{
+    if (repl.empty())
+        return;
+    auto resolve = [&](IRValue *&v)
+    {
+        auto it = repl.find(v);
+        while (it != repl.end())
+        {
+            v = it->second;
+            it = repl.find(v);
+        }
+    };
+    for (auto bb : blocks)
+        for (auto inst : bb->insts)
+            forEachOperand(inst, resolve);
+}
+
+// ---------------------------------------------------------------------------
+// Koopa IR文本解析
+// ---------------------------------------------------------------------------
+
+namespace
+{
+    enum TokenKind
+    {
+        TK_NAME,  // @x %x
+        TK_INT,   // 整数
+        TK_WORD,  // 关键字、类型、助记符
+        TK_PUNCT, // 单字符符号
+        TK_END
+    };
+
+    struct Token
+    {
+        TokenKind kind;
+        string text;
+        int line;
+    };
+
+    class IRParser
+    {
+    public:
+        IRParser(const string &text) { tokenize(text); }
+
+        bool parse(IRProgram &prog)
+        {
+            while (peek().kind != TK_END)
+            {
+                if (isWord("fun"))
+                {
+                    if (!parseFunction(prog))
+                        return false;
+                }
+                else if (isWord("decl"))
+                {
+                    if (!parseDecl(prog))
+                        return false;
+                }
+                else
+                    return error("expected fun or decl");
+            }
+            return true;
+        }
+
+    private:
+        vector<Token> tokens;
+        size_t pos = 0;
+
+        // 当前函数的符号
+        IRFunction *func = nullptr;
+        unordered_map<string, IRValue *> values;
+        unordered_set<IRValue *> defined;
+        unordered_map<string, IRBlock *> blocks;
+        unordered_set<IRBlock *> placed;
+
+        void tokenize(const string &text)
+        {
+            size_t i = 0, n = text.size();
+            int line = 1;
+            while (i < n)
+            {
+                char c = text[i];
+                if (c == '\n')
+                {
+                    ++line;
+                    ++i;
+                }
+                else if (isspace((unsigned char)c))
+                    ++i;
+                else if (c == '/' && i + 1 < n && text[i + 1] == '/')
+                {
+                    while (i < n && text[i] != '\n')
+                        ++i;
+                }
+                else if (c == '/' && i + 1 < n && text[i + 1] == '*')
+                {
+                    i += 2;
+                    while (i + 1 < n && !(text[i] == '*' && text[i + 1] == '/'))
+                        line += (text[i++] == '\n');
+                    i += 2;
+                }
+                else if (c == '@' || c == '%')
+                {
+                    size_t j = i + 1;
+                    while (j < n && (isalnum((unsigned char)text[j]) || text[j] == '_'))
+                        ++j;
+                    tokens.push_back({TK_NAME, text.substr(i, j - i), line});
+                    i = j;
+                }
+                else if (isdigit((unsigned char)c) || (c == '-' && i + 1 < n && isdigit((unsigned char)text[i + 1])))
+                {
+                    size_t j = i + 1;
+                    while (j < n && isdigit((unsigned char)text[j]))
+                        ++j;
+                    tokens.push_back({TK_INT, text.substr(i, j - i), line});
+                    i = j;
+                }
+                else if (isalpha((unsigned char)c) || c == '_')
+                {
+                    size_t j = i + 1;
+                    while (j < n && (isalnum((unsigned char)text[j]) || text[j] == '_'))
+                        ++j;
+                    tokens.push_back({TK_WORD, text.substr(i, j - i), line});
+                    i = j;
+                }
+                else
+                {
+                    tokens.push_back({TK_PUNCT, string(1, c), line});
+                    ++i;
+                }
+            }
+            tokens.push_back({TK_END, "", line});
+        }
+
+        const Token &peek(size_t k = 0) const
+        {
+            return tokens[min(pos + k, tokens.size() - 1)];
+        }
+        Token next() { return tokens[pos < tokens.size() - 1 ? pos++ : pos]; }
+        bool isWord(const char *w, size_t k = 0) const { return peek(k).kind == TK_WORD && peek(k).text == w; }
+        bool isPunct(char c, size_t k = 0) const { return peek(k).kind == TK_PUNCT && peek(k).text[0] == c; }
+
+        bool error(const string &msg)
+        {
+            cerr << "IR Parse Error: " << msg << " at line " << peek().line
+                 << " near '" << peek().text << "'\n";
+            return false;
+        }
+        bool expect(char c)
+        {
+            if (!isPunct(c))
+                return error(string("expected '") + c + "'");
+            ++pos;
+            return true;
+        }
+
+        // 类型只需原样记录（目前只有i32和指针）
+        bool parseType(string &type)
+        {
+            if (isPunct('*'))
+            {
+                ++pos;
+                string base;
+                if (!parseType(base))
+                    return false;
+                type = "*" + base;
+                return true;
+            }
+            if (peek().kind != TK_WORD)
+                return error("expected type");
+            type = next().text;
+            return true;
+        }
+
+        bool parseDecl(IRProgram &prog)
+        {
+            ++pos; // decl
+            IRDecl decl;
+            if (peek().kind != TK_NAME)
+                return error("expected function name");
+            decl.name = next().text;
+            if (!expect('('))
+                return false;
+            while (!isPunct(')'))
+            {
+                string type;
+                if (!parseType(type))
+                    return false;
+                decl.paramTypes.push_back(type);
+                if (isPunct(','))
+                    ++pos;
+            }
+            ++pos;
+            if (isPunct(':'))
+            {
+                ++pos;
+                if (!parseType(decl.retType))
+                    return false;
+            }
+            prog.decls.push_back(decl);
+            return true;
+        }
+
+        // 名字第一次出现时创建占位值，定义时再填写内容（允许前向引用）
+        IRValue *lookupValue(const string &name)
+        {
+            auto it = values.find(name);
+            if (it != values.end())
+                return it->second;
+            IRValue *v = func->newValue(IR_UNDEF);
+            values.emplace(name, v);
+            return v;
+        }
+
+        IRValue *defineValue(const string &name, IRKind kind)
+        {
+            IRValue *v = lookupValue(name);
+            if (defined.count(v))
+            {
+                error("redefined value " + name);
+                return nullptr;
+            }
+            defined.insert(v);
+            v->kind = kind;
+            v->hasResult = true;
+            // 只保留alloc的名字，其余临时值在输出时重新编号
+            if (kind == IR_ALLOC || kind == IR_FUNC_ARG)
+                v->name = name;
+            return v;
+        }
+
+        IRBlock *lookupBlock(const string &name)
+        {
+            auto it = blocks.find(name);
+            if (it != blocks.end())
+                return it->second;
+            IRBlock *bb = func->createBlock(name);
+            blocks.emplace(name, bb);
+            return bb;
+        }
+
+        bool parseOperand(IRValue *&v)
+        {
+            if (peek().kind == TK_INT)
+            {
+                v = func->getInt((int32_t)stoll(next().text));
+                return true;
+            }
+            if (isWord("undef"))
+            {
+                ++pos;
+                v = func->getUndef();
+                return true;
+            }
+            if (peek().kind == TK_NAME)
+            {
+                v = lookupValue(next().text);
+                return true;
+            }
+            return error("expected operand");
+        }
+
+        bool parseOperandList(vector<IRValue *> &list)
+        {
+            if (!expect('('))
+                return false;
+            while (!isPunct(')'))
+            {
+                IRValue *v;
+                if (!parseOperand(v))
+                    return false;
+                list.push_back(v);
+                if (isPunct(','))
+                    ++pos;
+                else if (!isPunct(')'))
+                    return error("expected ',' or ')'");
+            }
+            ++pos;
+            return true;
+        }
+
+        bool parseTarget(IRValue *inst)
+        {
+            if (peek().kind != TK_NAME)
+                return error("expected label");
+            inst->targets.push_back(lookupBlock(next().text));
+            inst->args.emplace_back();
+            if (isPunct('('))
+                return parseOperandList(inst->args.back());
+            return true;
+        }
+
+        bool parseFunction(IRProgram &prog)
+        {
+            ++pos; // fun
+            prog.funcs.emplace_back(new IRFunction());
+            func = prog.funcs.back().get();
+            values.clear();
+            defined.clear();
+            blocks.clear();
+            placed.clear();
+
+            if (peek().kind != TK_NAME)
+                return error("expected function name");
+            func->name = next().text;
+            if (!expect('('))
+                return false;
+            while (!isPunct(')'))
+            {
+                if (peek().kind != TK_NAME)
+                    return error("expected parameter name");
+                string name = next().text;
+                string type;
+                if (!expect(':') || !parseType(type))
+                    return false;
+                IRValue *param = defineValue(name, IR_FUNC_ARG);
+                if (!param)
+                    return false;
+                param->imm = func->params.size();
+                func->params.push_back(param);
+                if (isPunct(','))
+                    ++pos;
+            }
+            ++pos;
+            func->retVoid = true;
+            if (isPunct(':'))
+            {
+                ++pos;
+                string type;
+                if (!parseType(type))
+                    return false;
+                func->retVoid = false;
+            }
+            if (!expect('{'))
+                return false;
+
+            IRBlock *cur = nullptr;
+            while (!isPunct('}'))
+            {
+                if (peek().kind == TK_END)
+                    return error("unexpected end of input");
+                // 基本块标签：%name: 或 %name(%p: i32, ...):
+                if (peek().kind == TK_NAME && (isPunct(':', 1) || isPunct('(', 1)))
+                {
+                    cur = lookupBlock(next().text);
+                    if (placed.count(cur))
+                        return error("redefined label " + cur->name);
+                    placed.insert(cur);
+                    func->blocks.push_back(cur);
+                    if (isPunct('('))
+                    {
+                        ++pos;
+                        while (!isPunct(')'))
+                        {
+                            if (peek().kind != TK_NAME)
+                                return error("expected block parameter");
+                            string name = next().text;
+                            string type;
+                            if (!expect(':') || !parseType(type))
+                                return false;
+                            IRValue *param = defineValue(name, IR_BLOCK_ARG);
+                            if (!param)
+                                return false;
+                            param->parent = cur;
+                            cur->params.push_back(param);
+                            if (isPunct(','))
+                                ++pos;
+                        }
+                        ++pos;
+                    }
+                    if (!expect(':'))
+                        return false;
+                    continue;
+                }
+                if (!cur)
+                    return error("instruction outside of basic block");
+                IRValue *inst = parseInst();
+                if (!inst)
+                    return false;
+                inst->parent = cur;
+                cur->insts.push_back(inst);
+            }
+            ++pos;
+
+            for (auto &item : values)
+            {
+                if (!defined.count(item.second))
+                    return error("undefined value " + item.first + " in " + func->name);
+            }
+            for (auto &item : blocks)
+            {
+                if (!placed.count(item.second))
+                    return error("undefined label " + item.first + " in " + func->name);
+            }
+            func->buildCFG();
+            return true;
+        }
+
+        IRValue *parseCall(IRValue *inst)
+        {
+            if (peek().kind != TK_NAME)
+            {
+                error("expected callee");
+                return nullptr;
+            }
+            inst->callee = next().text;
+            if (!parseOperandList(inst->ops))
+                return nullptr;
+            return inst;
+        }
+
+        IRValue *parseInst()
+        {
+            // %x = ...
+            if (peek().kind == TK_NAME && isPunct('=', 1))
+            {
+                string name = next().text;
+                ++pos; // =
+                if (peek().kind != TK_WORD)
+                {
+                    error("expected instruction");
+                    return nullptr;
+                }
+                string mnemonic = next().text;
+                IRBinOp op;
+                IRValue *inst;
+                if (mnemonic == "alloc")
+                {
+                    string type;
+                    if (!parseType(type) || !(inst = defineValue(name, IR_ALLOC)))
+                        return nullptr;
+                    return inst;
+                }
+                if (mnemonic == "load")
+                {
+                    if (!(inst = defineValue(name, IR_LOAD)))
+                        return nullptr;
+                    inst->ops.resize(1);
+                    return parseOperand(inst->ops[0]) ? inst : nullptr;
+                }
+                if (mnemonic == "call")
+                {
+                    if (!(inst = defineValue(name, IR_CALL)))
+                        return nullptr;
+                    return parseCall(inst);
+                }
+                if (getBinOpByName(mnemonic, op))
+                {
+                    if (!(inst = defineValue(name, IR_BINARY)))
+                        return nullptr;
+                    inst->op = op;
+                    inst->ops.resize(2);
+                    if (!parseOperand(inst->ops[0]) || !expect(',') || !parseOperand(inst->ops[1]))
+                        return nullptr;
+                    return inst;
+                }
+                error("unsupported instruction " + mnemonic);
+                return nullptr;
+            }
+            if (peek().kind != TK_WORD)
+            {
+                error("expected instruction");
+                return nullptr;
+            }
+            string mnemonic = next().text;
+            if (mnemonic == "store")
+            {
+                IRValue *inst = func->newValue(IR_STORE);
+                inst->ops.resize(2);
+                if (!parseOperand(inst->ops[0]) || !expect(',') || !parseOperand(inst->ops[1]))
+                    return nullptr;
+                return inst;
+            }
+            if (mnemonic == "br")
+            {
+                IRValue *inst = func->newValue(IR_BRANCH);
+                inst->ops.resize(1);
+                if (!parseOperand(inst->ops[0]) || !expect(',') || !parseTarget(inst) || !expect(',') || !parseTarget(inst))
+                    return nullptr;
+                return inst;
+            }
+            if (mnemonic == "jump")
+            {
+                IRValue *inst = func->newValue(IR_JUMP);
+                return parseTarget(inst) ? inst : nullptr;
+            }
+            if (mnemonic == "ret")
+            {
+                IRValue *inst = func->newValue(IR_RETURN);
+                // ret之后紧跟的若不是操作数（标签、下一条指令或函数结尾），则为无返回值
+                bool hasValue = peek().kind == TK_INT || isWord("undef") ||
+                                (peek().kind == TK_NAME && !isPunct('=', 1) && !isPunct(':', 1) && !isPunct('(', 1));
+                if (hasValue)
+                {
+                    inst->ops.resize(1);
+                    if (!parseOperand(inst->ops[0]))
+                        return nullptr;
+                }
+                return inst;
+            }
+            if (mnemonic == "call")
+            {
+                IRValue *inst = func->newValue(IR_CALL);
+                return parseCall(inst);
+            }
+            error("unsupported instruction " + mnemonic);
+            return nullptr;
+        }
+    };
+
+    // 输出时为临时值分配名字
+    class IRNamer
+    {
+    public:
+        explicit IRNamer(const IRFunction &func)
+        {
+            for (auto param : func.params)
+                reserved.insert(param->name);
+        }
+
+        string get(IRValue *v)
+        {
+            switch (v->kind)
+            {
+            case IR_INT:
+                return to_string(v->imm);
+            case IR_UNDEF:
+                return "undef";
+            case IR_FUNC_ARG:
+                return v->name;
+            case IR_ALLOC:
+                if (!v->name.empty())
+                    return v->name;
+                break;
+            default:
+                break;
+            }
+            auto it = names.find(v);
+            if (it != names.end())
+                return it->second;
+            string name;
+            do
+            {
+                name = (v->kind == IR_ALLOC ? "@t" : "%") + to_string(cnt++);
+            } while (reserved.count(name));
+            names.emplace(v, name);
+            return name;
+        }
+
+    private:
+        unordered_map<IRValue *, string> names;
+        unordered_set<string> reserved;
+        int cnt = 0;
+    };
+
+    void dumpTarget(ostringstream &ss, IRNamer &namer, IRValue *inst, size_t index)
+    {
+        ss << inst->targets[index]->name;
+        const auto &list = inst->args[index];
+        if (list.empty())
+            return;
+        ss << "(";
+        for (size_t i = 0; i < list.size(); ++i)
+            ss << (i ? ", " : "") << namer.get(list[i]);
+        ss << ")";
+    }
+
+    void dumpInst(ostringstream &ss, IRNamer &namer, IRValue *inst)
+    {
+        ss << "  ";
+        if (inst->hasResult)
+            ss << namer.get(inst) << " = ";
+        switch (inst->kind)
+        {
+        case IR_ALLOC:
+            ss << "alloc i32";
+            break;
+        case IR_LOAD:
+            ss << "load " << namer.get(inst->ops[0]);
+            break;
+        case IR_STORE:
+            ss << "store " << namer.get(inst->ops[0]) << ", " << namer.get(inst->ops[1]);
+            break;
+        case IR_BINARY:
+            ss << getBinOpName(inst->op) << " " << namer.get(inst->ops[0]) << ", " << namer.get(inst->ops[1]);
+            break;
+        case IR_BRANCH:
+            ss << "br " << namer.get(inst->ops[0]) << ", ";
+            dumpTarget(ss, namer, inst, 0);
+            ss << ", ";
+            dumpTarget(ss, namer, inst, 1);
+            break;
+        case IR_JUMP:
+            ss << "jump ";
+            dumpTarget(ss, namer, inst, 0);
+            break;
+        case IR_CALL:
+            ss << "call " << inst->callee << "(";
+            for (size_t i = 0; i < inst->ops.size(); ++i)
+                ss << (i ? ", " : "") << namer.get(inst->ops[i]);
+            ss << ")";
+            break;
+        case IR_RETURN:
+            ss << "ret";
+            if (!inst->ops.empty())
+                ss << " " << namer.get(inst->ops[0]);
+            break;
+        default:
+            ss << "// unknown inst";
+        }
+        ss << "\n";
+    }
+}
+
+bool parseIR(const string &text, IRProgram &prog)
+{
+    IRParser parser(text);
+    return parser.parse(prog);
+}
+
+string dumpFunction(const IRFunction &func)
+{
+    ostringstream ss;
+    IRNamer namer(func);
+    ss << "fun " << func.name << "(";
+    for (size_t i = 0; i < func.params.size(); ++i)
+        ss << (i ? ", " : "") << func.params[i]->name << ": i32";
+    ss << ")" << (func.retVoid ? "" : ": i32") << " {\n";
+    for (size_t i = 0; i < func.blocks.size(); ++i)
+    {
+        IRBlock *bb = func.blocks[i];
+        if (i)
+            ss << "\n";
+        ss << bb->name;
+        if (!bb->params.empty())
+        {
+            ss << "(";
+            for (size_t j = 0; j < bb->params.size(); ++j)
+                ss << (j ? ", " : "") << namer.get(bb->params[j]) << ": i32";
+            ss << ")";
+        }
+        ss << ":\n";
+        for (auto inst : bb->insts)
+            dumpInst(ss, namer, inst);
+    }
+    ss << "}\n";
+    return ss.str();
+}
+
+string dumpIR(const IRProgram &prog)
+{
+    string s;
+    for (auto &decl : prog.decls)
+    {
+        s += "decl " + decl.name + "(";
+        for (size_t i = 0; i < decl.paramTypes.size(); ++i)
+            s += (i ? ", " : "") + decl.paramTypes[i];
+        s += ")";
+        if (!decl.retType.empty())
+            s += ": " + decl.retType;
+        s += "\n";
+    }
+    if (!prog.decls.empty())
+        s += "\n";
+    for (size_t i = 0; i < prog.funcs.size(); ++i)
+    {
+        if (i)
+            s += "\n";
+        s += dumpFunction(*prog.funcs[i]);
+    }
+    return s;
+}
+
+// ---------------------------------------------------------------------------
+// 支配树
+// ---------------------------------------------------------------------------
+
+void DomTree::build(IRFunction &func)
+{
+    size_t n = func.blocks.size();
+    idom.assign(n, -1);
+    children.assign(n, {});
+    frontier.assign(n, {});
+    rpo.clear();
+    if (!n)
+        return;
+
+    // 迭代DFS求逆后序
+    vector<int> order(n, -1);
+    vector<int> post;
+    vector<bool> visited(n, false);
+    vector<pair<int, size_t>> stack = {{0, 0}};
+    visited[0] = true;
+    while (!stack.empty())
+    {
+        auto &top = stack.back();
+        IRBlock *bb = func.blocks[top.first];
+        if (top.second < bb->succs.size())
+        {
+            int succ = bb->succs[top.second++]->id;
+            if (!visited[succ])
+            {
+                visited[succ] = true;
+                stack.push_back({succ, 0});
+            }
+            continue;
+        }
+        post.push_back(top.first);
+        stack.pop_back();
+    }
+    rpo.assign(post.rbegin(), post.rend());
+    for (size_t i = 0; i < rpo.size(); ++i)
+        order[rpo[i]] = i;
+
+    auto intersect = [&](int a, int b)
+    {
+        while (a != b)
+        {
+            while (order[a] > order[b])
+                a = idom[a];
+            while (order[b] > order[a])
+                b = idom[b];
+        }
+        return a;
+    };
+    idom[0] = 0;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = 1; i < rpo.size(); ++i)
+        {
+            int b = rpo[i];
+            int new_idom = -1;
+            for (auto pred : func.blocks[b]->preds)
+            {
+                int p = pred->id;
+                if (idom[p] == -1)
+                    continue;
+                new_idom = new_idom == -1 ? p : intersect(p, new_idom);
+            }
+            if (new_idom != idom[b])
+            {
+                idom[b] = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    for (int b : rpo)
+    {
+        if (b)
+            children[idom[b]].push_back(b);
+    }
+    // 支配边界：汇合点沿前驱向上走到其直接支配者为止
+    for (int b : rpo)
+    {
+        auto &preds = func.blocks[b]->preds;
+        if (preds.size() < 2)
+            continue;
+        for (auto pred : preds)
+        {
+            int runner = pred->id;
+            if (idom[runner] == -1)
+                continue;
+            while (runner != idom[b])
+            {
+                auto &df = frontier[runner];
+                if (df.empty() || df.back() != b)
+                    df.push_back(b);
+                runner = idom[runner];
+            }
+        }
+    }
+
+    // 支配树时间戳
+    tin.assign(n, -1);
+    tout.assign(n, -1);
+    int timer = 0;
+    vector<pair<int, size_t>> dfs = {{0, 0}};
+    tin[0] = timer++;
+    while (!dfs.empty())
+    {
+        auto &top = dfs.back();
+        if (top.second < children[top.first].size())
+        {
+            int child = children[top.first][top.second++];
+            tin[child] = timer++;
+            dfs.push_back({child, 0});
+            continue;
+        }
+        tout[top.first] = timer++;
+        dfs.pop_back();
+    }
+}
+
+bool DomTree::dominates(int a, int b) const
+{
+    if (tin[a] == -1 || tin[b] == -1)
+        return false;
+    return tin[a] <= tin[b] && tout[b] <= tout[a];
+}
@@ -0,0 +1,237 @@
+// 优化器使用的内存IR：Koopa IR文本的结构化形式
+// 前端输出的IR字符串先解析到这里，经过各个pass变换后再输出为Koopa IR文本
+#ifndef IR_HPP
+#define IR_HPP
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+// 值的种类（对应koopa_raw_value_tag_t中用得到的部分）
+enum IRKind
+{
+    IR_INT,       // 整数常量
+    IR_UNDEF,     // 未定义值
+    IR_FUNC_ARG,  // 函数参数
+    IR_BLOCK_ARG, // 基本块参数（Koopa IR中代替phi）
+    IR_ALLOC,
+    IR_LOAD,
+    IR_STORE,
+    IR_BINARY,
+    IR_BRANCH,
+    IR_JUMP,
+    IR_CALL,
+    IR_RETURN
+};
+
+// 二元运算符，顺序与koopa_raw_binary_op_t一致
+enum IRBinOp
+{
+    IR_NE,
+    IR_EQ,
+    IR_GT,
+    IR_LT,
+    IR_GE,
+    IR_LE,
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_MOD,
+    IR_AND,
+    IR_OR,
+    IR_XOR,
+    IR_SHL,
+    IR_SHR,
+    IR_SAR
+};
+
+class IRBlock;
+
+class IRValue
+{
+public:
+    IRKind kind;
+    IRBinOp op = IR_ADD;
+    int32_t imm = 0;                // 整数常量的值；函数参数的下标
+    string name;                    // 具名值的名字（含@或%），alloc和函数参数使用
+    bool hasResult = false;         // 是否产生结果（非unit类型）
+    vector<IRValue *> ops;          // 操作数：load[src] store[value,dest] binary[lhs,rhs] br[cond] ret[value] call[args]
+    vector<IRBlock *> targets;      // 跳转目标：br[true,false] jump[target]
+    vector<vector<IRValue *>> args; // 每个跳转目标对应的基本块实参
+    string callee;                  // call的被调函数名
+    IRBlock *parent = nullptr;      // 所在基本块（常量、参数为空）
+    bool dead = false;              // 删除标记，由IRFunction::sweep统一回收
+
+    bool isTerminator() const { return kind == IR_BRANCH || kind == IR_JUMP || kind == IR_RETURN; }
+    // 是否有副作用（无结果使用时也不能删除）
+    bool hasSideEffect() const { return kind == IR_STORE || kind == IR_CALL || isTerminator(); }
+};
+
+class IRBlock
+{
+public:
+    string name;              // 标签名（含%）
+    vector<IRValue *> params; // 基本块参数
+    vector<IRValue *> insts;
+    vector<IRBlock *> preds; // 由IRFunction::buildCFG计算
+    vector<IRBlock *> succs;
+    int id = -1; // 在IRFunction::blocks中的下标
+    bool dead = false;
+
+    IRValue *terminator() const
+    {
+        if (insts.empty() || !insts.back()->isTerminator())
+            return nullptr;
+        return insts.back();
+    }
+};
+
+class IRFunction
+{
+public:
+    string name; // 函数名（含@）
+    vector<IRValue *> params;
+    bool retVoid = false;
+    vector<IRBlock *> blocks; // blocks[0]为入口块
+
+    IRValue *newValue(IRKind kind);
+    IRBlock *newBlock(const string &hint);    // 新建基本块（不加入blocks），名字由hint加序号构成且保证不重名
+    IRBlock *createBlock(const string &name); // 以给定名字新建基本块（不加入blocks）
+    IRValue *getInt(int32_t val);             // 同一函数内相同的整数常量只有一份
+    IRValue *getUndef();
+
+    void buildCFG();                // 重新计算preds/succs/id
+    bool removeUnreachableBlocks(); // 删除入口不可达的块，并重建CFG，返回是否删除了块
+    void sweep();                   // 回收dead标记的指令和块
+    // 块标签和具名alloc按出现顺序重新编号（去掉名字末尾的数字后加序号）
+    // 前端的标签和变量名带有全程序的计数器，重新编号后函数的文本只取决于函数本身
+    void canonicalizeNames();
+    // 按替换表改写所有操作数（支持链式替换 a->b->c）
+    void replaceUses(const unordered_map<IRValue *, IRValue *> &repl);
+
+private:
+    vector<unique_ptr<IRValue>> value_pool;
+    vector<unique_ptr<IRBlock>> block_pool;
+    unordered_map<int32_t, IRValue *> int_pool;
+    IRValue *undef = nullptr;
+    unordered_set<string> block_names;
+    int block_name_cnt = 0;
+};
+
+// 函数声明（decl @f(i32): i32）
+class IRDecl
+{
+public:
+    string name;
+    vector<string> paramTypes;
+    string retType; // 为空表示无返回值
+};
+
+class IRProgram
+{
+public:
+    vector<IRDecl> decls;
+    vector<unique_ptr<IRFunction>> funcs;
+};
+
+// 控制流边：(跳转指令, 目标下标)，实参为inst->args[index]
+typedef pair<IRValue *, size_t> IREdge;
+// 按块id收集所有跳入该块的边，要求func.buildCFG()已调用
+vector<vector<IREdge>> collectIncomingEdges(IRFunction &func);
+// 按keep掩码删除块参数，以及edges（所有跳入该块的边）上对应的实参
+void eraseBlockParams(IRBlock *bb, const vector<bool> &keep, vector<IREdge> &edges);
+
+// 依次访问指令的所有操作数（含跳转实参），回调可以直接改写操作数
+void forEachOperand(IRValue *inst, const function<void(IRValue *&)> &fn);
+// 二元运算符与Koopa IR助记符互转
+const char *getBinOpName(IRBinOp op);
+bool getBinOpByName(const string &name, IRBinOp &op);
+
+// 在编译期计算二元运算（32位回绕语义），除数为0或INT_MIN/-1时无法计算，返回false
+bool foldBinOp(IRBinOp op, int32_t lhs, int32_t rhs, int32_t &result);
+
+// 解析Koopa IR文本，失败时返回false并在cerr中说明原因
+bool parseIR(const string &text, IRProgram &prog);
+// 输出Koopa IR文本，临时值重新按%0, %1...编号
+string dumpIR(const IRProgram &prog);
+string dumpFunction(const IRFunction &func);
+
+// 支配树（Cooper-Harvey-Kennedy迭代算法），下标对应IRBlock::id
+class DomTree
+{
+public:
+    vector<int> idom;             // 直接支配者，入口块为自身，不可达块为-1
+    vector<vector<int>> children; // 支配树上的孩子
+    vector<vector<int>> frontier; // 支配边界
+    vector<int> rpo;              // 可达块的逆后序
+
+    void build(IRFunction &func); // 要求func.buildCFG()已调用
+    bool dominates(int a, int b) const;
+
+private:
+    vector<int> tin, tout; // 支配树DFS时间戳，用于O(1)判断支配关系
+};
+
+// 自然循环：由回边（跳向支配自己的块）确定，同一个header的回边合并为一个循环
+class Loop
+{
+public:
+    IRBlock *header = nullptr;
+    vector<IRBlock *> blocks;  // 循环中的块（含header），按逆后序排列
+    vector<IRBlock *> latches; // 回边的起点
+    Loop *parent = nullptr;    // 外层循环
+    vector<Loop *> children;
+    int depth = 1; // 嵌套深度，最外层为1
+
+    bool contains(IRBlock *bb) const { return block_set.count(bb); }
+    void addBlock(IRBlock *bb, IRBlock *before); // 把新建的块插到before之前（同时加入所有外层循环）
+
+private:
+    unordered_set<IRBlock *> block_set;
+    friend class LoopInfo;
+};
+
+class LoopInfo
+{
+public:
+    vector<unique_ptr<Loop>> loops; // 外层循环在前
+
+    void build(IRFunction &func, const DomTree &dom); // 要求dom由当前CFG构建
+    Loop *getLoop(IRBlock *bb) const;                 // bb所在的最内层循环，不在循环中返回nullptr
+    vector<Loop *> innermostFirst() const;            // 内层循环在前的顺序
+
+private:
+    unordered_map<IRBlock *, Loop *> block_loop;
+};
+
+// 返回循环的前置块（循环外唯一跳向header的块，且以jump结尾），没有时新建一个
+// 新建后CFG会重建，header的外部来边全部改为经过前置块
+IRBlock *insertPreheader(IRFunction &func, Loop &loop);
+
+// 基本归纳变量：header的参数param，从循环外传入初值init，经回边传入next = param + step
+class InductionVar
+{
+public:
+    IRValue *param;
+    size_t index; // 在header参数中的下标
+    IRValue *init;
+    IRValue *next;
+    int32_t step;
+};
+
+// 循环进入header的边：恰好一条来自循环外（entry），一条为回边（latch），否则返回false
+bool getLoopEdges(Loop &loop, IREdge &entry, IREdge &latch);
+// 识别循环的基本归纳变量（步长为常量），要求getLoopEdges成立
+vector<InductionVar> findInductionVars(Loop &loop);
+
+// 地址没有逃逸的alloc：只作为load/store的地址出现，只会被对它的store改写
+unordered_set<IRValue *> collectLocalAllocs(IRFunction &func);
+
+#endif // IR_HPP
@@ -0,0 +1,773 @@
+#include "irbin.hpp"
+#include <cctype>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    const char MAGIC[4] = {'K', 'I', 'R', 'B'};
+    const uint32_t VERSION = 1;
+    const size_t INDEX_ENTRY_SIZE = 20;
+
+    enum SectionId
+    {
+        SEC_STRINGS = 1,
+        SEC_DECLS = 2,
+        SEC_FUNCS = 3
+    };
+
+    // 操作数的低2位
+    enum OperandTag
+    {
+        OPND_VALUE = 0,
+        OPND_INT = 1,
+        OPND_UNDEF = 2
+    };
+
+    const uint8_t HAS_RESULT = 0x80; // 指令头字节：低位为IRKind
+
+    class ByteWriter
+    {
+    public:
+        string buf;
+
+        void u8(uint8_t v) { buf.push_back((char)v); }
+        void fixed(uint64_t v, int bytes)
+        {
+            for (int i = 0; i < bytes; ++i)
+                u8((uint8_t)(v >> (8 * i)));
+        }
+        void varint(uint64_t v)
+        {
+            while (v >= 0x80)
+            {
+                u8((uint8_t)(v | 0x80));
+                v >>= 7;
+            }
+            u8((uint8_t)v);
+        }
+    };
+
+    class ByteReader
+    {
+    public:
+        ByteReader(const char *data, size_t size) : p((const uint8_t *)data), end((const uint8_t *)data + size) {}
+
+        bool ok = true; // 读到末尾之外或数据不合法时为false，之后读到的都是0
+
+        uint8_t u8()
+        {
+            if (p == end)
+            {
+                ok = false;
+                return 0;
+            }
+            return *p++;
+        }
+        uint64_t fixed(int bytes)
+        {
+            uint64_t v = 0;
+            for (int i = 0; i < bytes; ++i)
+                v |= (uint64_t)u8() << (8 * i);
+            return v;
+        }
+        uint64_t varint()
+        {
+            uint64_t v = 0;
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                uint8_t b = u8();
+                v |= (uint64_t)(b & 0x7f) << shift;
+                if (!(b & 0x80))
+                    return v;
+            }
+            ok = false;
+            return 0;
+        }
+        // 个数不可能超过剩余的字节数，用来在分配之前拒绝损坏的数据
+        size_t count()
+        {
+            uint64_t n = varint();
+            if (n > (uint64_t)(end - p))
+            {
+                ok = false;
+                return 0;
+            }
+            return n;
+        }
+        string_view bytes(size_t n)
+        {
+            if (n > (size_t)(end - p))
+            {
+                ok = false;
+                return {};
+            }
+            string_view s((const char *)p, n);
+            p += n;
+            return s;
+        }
+        bool atEnd() const { return p == end; }
+
+    private:
+        const uint8_t *p, *end;
+    };
+
+    // 绝对值小的负数也只占一两个字节
+    uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+    int32_t unzigzag(uint64_t v) { return (int32_t)(((uint32_t)v >> 1) ^ (0u - ((uint32_t)v & 1))); }
+
+    class StringTable
+    {
+    public:
+        StringTable() { get(""); }
+
+        uint32_t get(const string &s)
+        {
+            auto it = ids.find(s);
+            if (it != ids.end())
+                return it->second;
+            uint32_t id = strs.size();
+            ids.emplace(s, id);
+            strs.push_back(s);
+            return id;
+        }
+
+        vector<string> strs;
+
+    private:
+        unordered_map<string, uint32_t> ids;
+    };
+
+    class BinaryWriter
+    {
+    public:
+        string write(const IRProgram &prog)
+        {
+            ByteWriter decls, funcs;
+            decls.varint(prog.decls.size());
+            for (auto &decl : prog.decls)
+            {
+                decls.varint(strings.get(decl.name));
+                decls.varint(decl.paramTypes.size());
+                for (auto &type : decl.paramTypes)
+                    decls.varint(strings.get(type));
+                decls.varint(strings.get(decl.retType));
+            }
+            funcs.varint(prog.funcs.size());
+            for (auto &func : prog.funcs)
+            {
+                string body = writeFunction(*func);
+                funcs.varint(body.size());
+                funcs.buf += body;
+            }
+            ByteWriter strtab;
+            strtab.varint(strings.strs.size());
+            for (auto &s : strings.strs)
+            {
+                strtab.varint(s.size());
+                strtab.buf += s;
+            }
+
+            vector<pair<SectionId, const string *>> sections = {
+                {SEC_STRINGS, &strtab.buf}, {SEC_DECLS, &decls.buf}, {SEC_FUNCS, &funcs.buf}};
+            ByteWriter out;
+            out.buf.append(MAGIC, 4);
+            out.fixed(VERSION, 4);
+            out.fixed(sections.size(), 4);
+            uint64_t offset = out.buf.size() + sections.size() * INDEX_ENTRY_SIZE;
+            for (auto &section : sections)
+            {
+                out.fixed(section.first, 4);
+                out.fixed(offset, 8);
+                out.fixed(section.second->size(), 8);
+                offset += section.second->size();
+            }
+            for (auto &section : sections)
+                out.buf += *section.second;
+            return out.buf;
+        }
+
+    private:
+        StringTable strings;
+        unordered_map<IRValue *, uint32_t> ids;
+
+        void operand(ByteWriter &w, IRValue *v)
+        {
+            if (v->kind == IR_INT)
+                w.varint((uint64_t)zigzag(v->imm) << 2 | OPND_INT);
+            else if (v->kind == IR_UNDEF)
+                w.varint(OPND_UNDEF);
+            else
+            {
+                auto it = ids.find(v);
+                if (it == ids.end())
+                {
+                    cerr << "IR binary: operand is not defined in the function\n";
+                    w.varint(OPND_UNDEF);
+                    return;
+                }
+                w.varint((uint64_t)it->second << 2 | OPND_VALUE);
+            }
+        }
+
+        void operands(ByteWriter &w, const vector<IRValue *> &list)
+        {
+            w.varint(list.size());
+            for (auto v : list)
+                operand(w, v);
+        }
+
+        void target(ByteWriter &w, IRValue *inst, size_t index, const unordered_map<IRBlock *, uint32_t> &blockIds)
+        {
+            w.varint(blockIds.at(inst->targets[index]));
+            operands(w, inst->args[index]);
+        }
+
+        string writeFunction(const IRFunction &func)
+        {
+            ids.clear();
+            unordered_map<IRBlock *, uint32_t> blockIds;
+            for (auto param : func.params)
+                ids.emplace(param, ids.size());
+            for (auto bb : func.blocks)
+            {
+                blockIds.emplace(bb, blockIds.size());
+                for (auto param : bb->params)
+                    ids.emplace(param, ids.size());
+                for (auto inst : bb->insts)
+                    ids.emplace(inst, ids.size());
+            }
+
+            ByteWriter w;
+            w.varint(strings.get(func.name));
+            w.u8(func.retVoid);
+            w.varint(func.params.size());
+            for (auto param : func.params)
+                w.varint(strings.get(param->name));
+            // 先写出所有块的头部，读入时可以先创建所有的值
+            w.varint(func.blocks.size());
+            for (auto bb : func.blocks)
+            {
+                w.varint(strings.get(bb->name));
+                w.varint(bb->params.size());
+                w.varint(bb->insts.size());
+            }
+            for (auto bb : func.blocks)
+            {
+                for (auto inst : bb->insts)
+                {
+                    w.u8(inst->kind | (inst->hasResult ? HAS_RESULT : 0));
+                    switch (inst->kind)
+                    {
+                    case IR_ALLOC:
+                        w.varint(strings.get(inst->name));
+                        break;
+                    case IR_LOAD:
+                        operand(w, inst->ops[0]);
+                        break;
+                    case IR_STORE:
+                        operand(w, inst->ops[0]);
+                        operand(w, inst->ops[1]);
+                        break;
+                    case IR_BINARY:
+                        w.u8(inst->op);
+                        operand(w, inst->ops[0]);
+                        operand(w, inst->ops[1]);
+                        break;
+                    case IR_BRANCH:
+                        operand(w, inst->ops[0]);
+                        target(w, inst, 0, blockIds);
+                        target(w, inst, 1, blockIds);
+                        break;
+                    case IR_JUMP:
+                        target(w, inst, 0, blockIds);
+                        break;
+                    case IR_CALL:
+                        w.varint(strings.get(inst->callee));
+                        operands(w, inst->ops);
+                        break;
+                    case IR_RETURN:
+                        operands(w, inst->ops);
+                        break;
+                    default:
+                        break;
+                    }
+                }
+            }
+            return w.buf;
+        }
+    };
+
+    bool isSymbol(const string &name, char sigil)
+    {
+        if (name.size() < 2 || name[0] != sigil)
+            return false;
+        for (size_t i = 1; i < name.size(); ++i)
+            if (!isalnum((unsigned char)name[i]) && name[i] != '_')
+                return false;
+        return true;
+    }
+
+    // 与dumpIR给未命名的值起的名字（%N、@tN）相同
+    bool isTempName(const string &name)
+    {
+        size_t digits = name.compare(0, 2, "@t") == 0 ? 2 : 1;
+        return name.size() > digits && name.find_first_not_of("0123456789", digits) == string::npos;
+    }
+
+    // 数据损坏但没有越界时读出的IR也可能不合法，输出为文本交给libkoopa之前在这里检查
+    // 检查块的结构、名字、结果和操作数的类型（i32或alloc得到的*i32）、调用和返回的签名、跳转实参的个数，以及定义支配使用
+    class IRChecker
+    {
+    public:
+        string msg;
+
+        bool init(const IRProgram &prog)
+        {
+            for (auto &decl : prog.decls)
+            {
+                for (auto &type : decl.paramTypes)
+                    if (type != "i32")
+                        return fail("bad parameter type in declaration of " + decl.name);
+                if (!decl.retType.empty() && decl.retType != "i32")
+                    return fail("bad return type in declaration of " + decl.name);
+                if (!addSignature(decl.name, decl.paramTypes.size(), !decl.retType.empty()))
+                    return false;
+            }
+            for (auto &func : prog.funcs)
+                if (!addSignature(func->name, func->params.size(), !func->retVoid))
+                    return false;
+            return true;
+        }
+
+        bool check(IRFunction &func)
+        {
+            if (func.blocks.empty())
+                return fail("function has no blocks");
+            unordered_set<string> names; // 参数和alloc的名字
+            for (auto param : func.params)
+                if ((!isSymbol(param->name, '@') && !isSymbol(param->name, '%')) || !names.insert(param->name).second)
+                    return fail("bad parameter name " + param->name);
+            unordered_set<string> labels;
+            for (size_t i = 0; i < func.blocks.size(); ++i)
+            {
+                IRBlock *bb = func.blocks[i];
+                if (!isSymbol(bb->name, '%') || !labels.insert(bb->name).second)
+                    return fail("bad block name " + bb->name);
+                if (i == 0 && !bb->params.empty())
+                    return fail("entry block has parameters");
+                if (bb->insts.empty())
+                    return fail("empty block " + bb->name);
+                for (size_t j = 0; j < bb->insts.size(); ++j)
+                    if (bb->insts[j]->isTerminator() != (j + 1 == bb->insts.size()))
+                        return fail("block " + bb->name + " does not end with exactly one terminator");
+            }
+            func.buildCFG();
+            dom.build(func);
+            defs.clear();
+            for (auto bb : func.blocks)
+            {
+                for (auto param : bb->params)
+                    defs[param] = {bb->id, -1};
+                for (size_t j = 0; j < bb->insts.size(); ++j)
+                    defs[bb->insts[j]] = {bb->id, (int)j};
+            }
+            for (auto bb : func.blocks)
+            {
+                for (size_t j = 0; j < bb->insts.size(); ++j)
+                {
+                    IRValue *inst = bb->insts[j];
+                    if (!checkInst(func, inst, bb, j, names))
+                        return fail(msg + " in block " + bb->name);
+                }
+            }
+            return true;
+        }
+
+    private:
+        class Signature
+        {
+        public:
+            size_t params;
+            bool retValue;
+        };
+
+        unordered_map<string, Signature> signatures;
+        DomTree dom;
+        unordered_map<IRValue *, pair<int, int>> defs; // 值定义在哪个块的第几条指令，块参数为-1
+
+        bool fail(const string &m)
+        {
+            msg = m;
+            return false;
+        }
+
+        bool addSignature(const string &name, size_t params, bool retValue)
+        {
+            if (!isSymbol(name, '@') || signatures.count(name))
+                return fail("bad or duplicate function name " + name);
+            signatures[name] = {params, retValue};
+            return true;
+        }
+
+        // v作为bb中第pos条指令的操作数：类型正确，并且定义支配这次使用（不可达的块不检查支配关系）
+        bool use(IRValue *v, bool pointer, IRBlock *bb, size_t pos)
+        {
+            bool isPointer = v->kind == IR_ALLOC;
+            bool isI32 = v->kind == IR_INT || v->kind == IR_UNDEF || v->kind == IR_FUNC_ARG ||
+                         (!isPointer && v->hasResult);
+            if (pointer ? !isPointer : !isI32)
+                return fail("operand type mismatch");
+            auto it = defs.find(v);
+            if (it == defs.end() || dom.idom[bb->id] == -1)
+                return true;
+            if (it->second.first == bb->id ? it->second.second >= (int)pos : !dom.dominates(it->second.first, bb->id))
+                return fail("value used before its definition");
+            return true;
+        }
+
+        bool target(IRValue *inst, size_t index, IRBlock *bb, size_t pos)
+        {
+            IRBlock *to = inst->targets[index];
+            if (to->id == 0)
+                return fail("jump to the entry block");
+            if (inst->args[index].size() != to->params.size())
+                return fail("wrong number of arguments for " + to->name);
+            for (auto arg : inst->args[index])
+                if (!use(arg, false, bb, pos))
+                    return false;
+            return true;
+        }
+
+        bool checkInst(IRFunction &func, IRValue *inst, IRBlock *bb, size_t pos, unordered_set<string> &names)
+        {
+            bool result = inst->kind == IR_ALLOC || inst->kind == IR_LOAD || inst->kind == IR_BINARY;
+            if (inst->kind == IR_CALL)
+            {
+                auto it = signatures.find(inst->callee);
+                if (it == signatures.end())
+                    return fail("call to undefined function " + inst->callee);
+                if (inst->ops.size() != it->second.params)
+                    return fail("wrong number of arguments for " + inst->callee);
+                result = it->second.retValue;
+            }
+            if (inst->hasResult != result)
+                return fail("bad result flag");
+            switch (inst->kind)
+            {
+            case IR_ALLOC:
+                if (!inst->name.empty() && (!isSymbol(inst->name, '@') || isTempName(inst->name) || !names.insert(inst->name).second))
+                    return fail("bad alloc name " + inst->name);
+                return true;
+            case IR_LOAD:
+                return use(inst->ops[0], true, bb, pos);
+            case IR_STORE:
+                return use(inst->ops[0], false, bb, pos) && use(inst->ops[1], true, bb, pos);
+            case IR_BINARY:
+                return use(inst->ops[0], false, bb, pos) && use(inst->ops[1], false, bb, pos);
+            case IR_BRANCH:
+                return use(inst->ops[0], false, bb, pos) && target(inst, 0, bb, pos) && target(inst, 1, bb, pos);
+            case IR_JUMP:
+                return target(inst, 0, bb, pos);
+            case IR_RETURN:
+                if (inst->ops.size() != (func.retVoid ? 0u : 1u))
+                    return fail("return value does not match the function type");
+                return inst->ops.empty() || use(inst->ops[0], false, bb, pos);
+            default: // IR_CALL
+                for (auto arg : inst->ops)
+                    if (!use(arg, false, bb, pos))
+                        return false;
+                return true;
+            }
+        }
+    };
+
+    class BinaryReader
+    {
+    public:
+        bool read(const char *data, size_t size, IRProgram &prog)
+        {
+            ByteReader header(data, size);
+            string_view magic = header.bytes(4);
+            if (!header.ok || memcmp(magic.data(), MAGIC, 4))
+                return error("not a binary IR file");
+            if (header.fixed(4) != VERSION)
+                return error("unsupported version");
+            uint32_t n = header.fixed(4);
+            string_view sections[SEC_FUNCS + 1];
+            for (uint32_t i = 0; i < n && header.ok; ++i)
+            {
+                uint32_t id = header.fixed(4);
+                uint64_t offset = header.fixed(8), len = header.fixed(8);
+                if (offset > size || len > size - offset)
+                    return error("section out of range");
+                if (id <= SEC_FUNCS)
+                    sections[id] = string_view(data + offset, len);
+            }
+            if (!header.ok)
+                return error("truncated section index");
+            if (!readStrings(sections[SEC_STRINGS]) || !readDecls(sections[SEC_DECLS], prog) ||
+                !readFuncs(sections[SEC_FUNCS], prog))
+                return false;
+            IRChecker checker;
+            if (!checker.init(prog))
+                return error(checker.msg);
+            for (auto &func : prog.funcs)
+                if (!checker.check(*func))
+                    return error("bad function " + func->name + ": " + checker.msg);
+            return true;
+        }
+
+    private:
+        vector<string_view> strings; // 指向原始数据，不复制
+
+        bool error(const string &msg)
+        {
+            cerr << "IR binary error: " << msg << "\n";
+            return false;
+        }
+
+        bool str(ByteReader &r, string &s)
+        {
+            uint64_t id = r.varint();
+            if (id >= strings.size())
+            {
+                r.ok = false;
+                return false;
+            }
+            s = strings[id];
+            return true;
+        }
+
+        bool readStrings(string_view section)
+        {
+            ByteReader r(section.data(), section.size());
+            size_t n = r.count();
+            strings.reserve(n);
+            for (size_t i = 0; i < n && r.ok; ++i)
+                strings.push_back(r.bytes(r.varint()));
+            if (!r.ok || strings.empty())
+                return error("bad string table");
+            return true;
+        }
+
+        bool readDecls(string_view section, IRProgram &prog)
+        {
+            ByteReader r(section.data(), section.size());
+            size_t n = r.count();
+            for (size_t i = 0; i < n && r.ok; ++i)
+            {
+                IRDecl decl;
+                str(r, decl.name);
+                decl.paramTypes.resize(r.count());
+                for (auto &type : decl.paramTypes)
+                    str(r, type);
+                str(r, decl.retType);
+                prog.decls.push_back(decl);
+            }
+            return r.ok ? true : error("bad declarations");
+        }
+
+        bool readFuncs(string_view section, IRProgram &prog)
+        {
+            ByteReader r(section.data(), section.size());
+            size_t n = r.count();
+            for (size_t i = 0; i < n && r.ok; ++i)
+            {
+                string_view body = r.bytes(r.varint());
+                prog.funcs.emplace_back(new IRFunction());
+                if (r.ok && !readFunction(body, *prog.funcs.back()))
+                    return error("bad function #" + to_string(i));
+            }
+            return r.ok ? true : error("bad function section");
+        }
+
+        IRValue *operand(ByteReader &r, IRFunction &func, const vector<IRValue *> &vals)
+        {
+            uint64_t x = r.varint();
+            switch (x & 3)
+            {
+            case OPND_INT:
+                return func.getInt(unzigzag(x >> 2));
+            case OPND_UNDEF:
+                return func.getUndef();
+            case OPND_VALUE:
+                if ((x >> 2) < vals.size())
+                    return vals[x >> 2];
+            }
+            r.ok = false;
+            return func.getUndef();
+        }
+
+        void operands(ByteReader &r, IRFunction &func, const vector<IRValue *> &vals, vector<IRValue *> &list)
+        {
+            list.resize(r.count());
+            for (auto &v : list)
+                v = operand(r, func, vals);
+        }
+
+        void target(ByteReader &r, IRFunction &func, const vector<IRValue *> &vals, IRValue *inst)
+        {
+            uint64_t index = r.varint();
+            if (index >= func.blocks.size())
+            {
+                r.ok = false;
+                return;
+            }
+            inst->targets.push_back(func.blocks[index]);
+            inst->args.emplace_back();
+            operands(r, func, vals, inst->args.back());
+        }
+
+        bool readFunction(string_view body, IRFunction &func)
+        {
+            ByteReader r(body.data(), body.size());
+            vector<IRValue *> vals; // 按编号排列的所有值，指令先创建占位，读到时再填写
+            str(r, func.name);
+            func.retVoid = r.u8();
+            size_t nparams = r.count();
+            for (size_t i = 0; i < nparams && r.ok; ++i)
+            {
+                IRValue *param = func.newValue(IR_FUNC_ARG);
+                str(r, param->name);
+                param->imm = i;
+                param->hasResult = true;
+                func.params.push_back(param);
+                vals.push_back(param);
+            }
+            size_t nblocks = r.count();
+            for (size_t i = 0; i < nblocks && r.ok; ++i)
+            {
+                string name;
+                str(r, name);
+                IRBlock *bb = func.createBlock(name);
+                func.blocks.push_back(bb);
+                size_t nargs = r.count(), ninsts = r.count();
+                for (size_t j = 0; j < nargs && r.ok; ++j)
+                {
+                    IRValue *param = func.newValue(IR_BLOCK_ARG);
+                    param->hasResult = true;
+                    param->parent = bb;
+                    bb->params.push_back(param);
+                    vals.push_back(param);
+                }
+                for (size_t j = 0; j < ninsts && r.ok; ++j)
+                {
+                    IRValue *inst = func.newValue(IR_UNDEF);
+                    inst->parent = bb;
+                    bb->insts.push_back(inst);
+                    vals.push_back(inst);
+                }
+            }
+            for (auto bb : func.blocks)
+            {
+                for (auto inst : bb->insts)
+                {
+                    if (!r.ok)
+                        return false;
+                    uint8_t head = r.u8();
+                    inst->kind = (IRKind)(head & ~HAS_RESULT);
+                    inst->hasResult = head & HAS_RESULT;
+                    switch (inst->kind)
+                    {
+                    case IR_ALLOC:
+                        str(r, inst->name);
+                        break;
+                    case IR_LOAD:
+                        inst->ops = {operand(r, func, vals)};
+                        break;
+                    case IR_STORE:
+                        inst->ops = {operand(r, func, vals)};
+                        inst->ops.push_back(operand(r, func, vals));
+                        break;
+                    case IR_BINARY:
+                    {
+                        uint8_t op = r.u8();
+                        if (op > IR_SAR)
+                            return false;
+                        inst->op = (IRBinOp)op;
+                        inst->ops = {operand(r, func, vals)};
+                        inst->ops.push_back(operand(r, func, vals));
+                        break;
+                    }
+                    case IR_BRANCH:
+                        inst->ops = {operand(r, func, vals)};
+                        target(r, func, vals, inst);
+                        target(r, func, vals, inst);
+                        break;
+                    case IR_JUMP:
+                        target(r, func, vals, inst);
+                        break;
+                    case IR_CALL:
+                        str(r, inst->callee);
+                        operands(r, func, vals, inst->ops);
+                        break;
+                    case IR_RETURN:
+                        operands(r, func, vals, inst->ops);
+                        break;
+                    default:
+                        return false; // 常量和参数不是指令
+                    }
+                }
+            }
+            return r.ok && r.atEnd(); // 是否合法以及buildCFG留给IRChecker
+        }
+    };
+}
+
+string writeIRBinary(const IRProgram &prog)
+{
+    BinaryWriter writer;
+    return writer.write(prog);
+}
+
+bool readIRBinary(const char *data, size_t size, IRProgram &prog)
+{
+    BinaryReader reader;
+    return reader.read(data, size, prog);
+}
+
+bool loadIRBinaryFile(const string &path, IRProgram &prog)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) || st.st_size == 0)
+    {
+        cerr << "Failed to open " << path << endl;
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        cerr << "Failed to map " << path << endl;
+        return false;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    bool ok = readIRBinary((const char *)data, st.st_size, prog);
+    munmap(data, st.st_size);
+    return ok;
+}
+
+bool isIRBinaryFile(const string &path)
+{
+    char magic[4];
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool match = read(fd, magic, 4) == 4 && !memcmp(magic, MAGIC, 4);
+    close(fd);
+    return match;
+}
@@ -0,0 +1,27 @@
+// 内存IR的二进制格式：保存优化前后的IR，读回时不用解析文本，也不用重新运行前端
+#ifndef IRBIN_HPP
+#define IRBIN_HPP
+
+#include <cstddef>
+#include <string>
+#include "ir.hpp"
+
+using namespace std;
+
+// 文件头：魔数"KIRB"、版本(u32)、段数(u32)，之后为段索引，每项为 段号(u32) 偏移(u64) 长度(u64)，小端序
+// 段：
+//   字符串表  个数，每个字符串为 长度+字节；0号为空串，其他地方的名字都是这里的下标
+//   声明      个数，每个为 名字 参数个数 各参数类型 返回类型
+//   函数      个数，每个函数前有它的字节数，可以跳过不读
+// 整数都是varint（LEB128），常量操作数用zigzag编码后直接放在操作数中
+// 函数内的值按 函数参数、各块的（块参数、指令） 的顺序编号，操作数可以引用后面的值
+string writeIRBinary(const IRProgram &prog);
+// 从内存中读入，失败时返回false并在cerr中说明原因；只依次扫描一遍数据，字符串表直接引用data
+// 读入后检查IR是否合法（块的结构、操作数的类型、调用的签名、定义支配使用等），损坏的文件不会产生非法的IR
+bool readIRBinary(const char *data, size_t size, IRProgram &prog);
+// mmap文件后读入
+bool loadIRBinaryFile(const string &path, IRProgram &prog);
+// 文件是否以二进制IR的魔数开头
+bool isIRBinaryFile(const string &path);
+
+#endif // IRBIN_HPP
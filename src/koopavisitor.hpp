@@ -2,6 +2,7 @@
 #define KOOPA_VISITOR_HPP
 
 #include "koopa.h"
+#include "mir.hpp"
 #include <string>
 
 using namespace std;
@@ -10,14 +11,25 @@ using namespace std;
 string alloc_reg();
 // 分配a寄存器组（a0~a7）
 string alloc_reg_a();
-// 扫描IR string，以获取栈尺寸
-void scanStackSize(string ir);
+// 计算函数所需的栈尺寸
+void computeStackSize(const koopa_raw_function_t&);
 // 判断该value是否分配了栈，并返回已分配好的栈位置
 inline int getStackPos(const koopa_raw_value_t&);
+// 读写value所在的栈位置
+void loadValue(const string&, const koopa_raw_value_t&);
+void storeValue(const string&, const koopa_raw_value_t&);
 
-// DFS读取Raw Program
+// 向当前函数追加机器指令/新块
+void emit(const string&, const vector<MOperand>&);
+void beginBlock(const string&);
 
-void VisitProgram(const koopa_raw_program_t&, const char*);
+// DFS读取Raw Program，翻译为机器IR
+
+void VisitProgram(const koopa_raw_program_t&, MachineProgram&);
+// 程序中有函数体的函数（按程序中的顺序）
+vector<koopa_raw_function_t> collectFunctions(const koopa_raw_program_t&);
+// 把一个函数翻译为机器IR；状态都是线程局部的，不同函数可以在不同线程中同时翻译
+void VisitFunction(const koopa_raw_function_t&, MachineFunction&);
 void VisitSlice(const koopa_raw_slice_t&);
 void VisitFunc(const koopa_raw_function_t &func);
 // void VisitType(const koopa_raw_type_t &type);
@@ -33,6 +45,10 @@ void VisitStore(const koopa_raw_store_t&);
 void VisitLoad(const koopa_raw_load_t&);
 
 void VisitBin(const koopa_raw_binary_t&);
+void VisitBranch(const koopa_raw_branch_t&);
+void VisitJump(const koopa_raw_jump_t&);
+void VisitCall(const koopa_raw_call_t&);
+void VisitBlockArgs(const koopa_raw_basic_block_t&, const koopa_raw_slice_t&);
 void VisitAlloc(const koopa_raw_global_alloc_t&);
 
 #endif // KOOPA_VISITOR_HPP
\ No newline at end of file
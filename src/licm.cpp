@@ -0,0 +1,111 @@
+#include "passes.hpp"
+
+using namespace std;
+
+// 循环不变量外提：操作数都在循环外定义（或本身不变）的纯运算，
+// 以及地址在循环内不会被改写的load，移动到循环的前置块中
+namespace
+{
+    // 循环可能执行0次，外提后的指令会被无条件执行，只外提不会出错的运算
+    bool isSafeToSpeculate(IRValue *inst)
+    {
+        if (inst->kind != IR_BINARY)
+            return true;
+        if (inst->op != IR_DIV && inst->op != IR_MOD)
+            return true;
+        IRValue *rhs = inst->ops[1];
+        return rhs->kind == IR_INT && rhs->imm != 0 && rhs->imm != -1;
+    }
+
+    class LICMPass
+    {
+    public:
+        LICMPass(IRFunction &func, LoopInfo &loops) : func(func), loops(loops)
+        {
+            local = collectLocalAllocs(func);
+        }
+
+        bool run()
+        {
+            bool changed = false;
+            for (auto loop : loops.innermostFirst())
+                changed |= hoist(*loop);
+            return changed;
+        }
+
+    private:
+        IRFunction &func;
+        LoopInfo &loops;
+        unordered_set<IRValue *> local;
+
+        bool hoist(Loop &loop)
+        {
+            // 循环内被改写的地址；写入未知地址或有call时，只有未逃逸的alloc可以外提load
+            unordered_set<IRValue *> stored;
+            bool clobber_all = false;
+            for (auto bb : loop.blocks)
+            {
+                for (auto inst : bb->insts)
+                {
+                    if (inst->kind == IR_STORE && local.count(inst->ops[1]))
+                        stored.insert(inst->ops[1]);
+                    else if (inst->kind == IR_STORE || inst->kind == IR_CALL)
+                        clobber_all = true;
+                }
+            }
+
+            unordered_set<IRValue *> invariant;
+            auto isInvariant = [&](IRValue *v)
+            {
+                if (!v->parent)
+                    return v->kind != IR_BLOCK_ARG;
+                return !loop.contains(v->parent) || invariant.count(v);
+            };
+            // 按逆后序遍历，操作数先于使用者被判定
+            vector<IRValue *> hoisted;
+            for (auto bb : loop.blocks)
+            {
+                for (auto inst : bb->insts)
+                {
+                    bool ok = false;
+                    if (inst->kind == IR_BINARY)
+                        ok = isInvariant(inst->ops[0]) && isInvariant(inst->ops[1]) && isSafeToSpeculate(inst);
+                    else if (inst->kind == IR_LOAD)
+                    {
+                        // 只外提alloc的load，地址一定有效
+                        IRValue *addr = inst->ops[0];
+                        bool is_local = local.count(addr);
+                        ok = addr->kind == IR_ALLOC && !stored.count(addr) && (is_local || !clobber_all);
+                    }
+                    if (!ok)
+                        continue;
+                    invariant.insert(inst);
+                    hoisted.push_back(inst);
+                }
+            }
+            if (hoisted.empty())
+                return false;
+
+            IRBlock *pre = insertPreheader(func, loop);
+            for (auto inst : hoisted)
+                inst->dead = true;
+            func.sweep();
+            IRValue *term = pre->insts.back();
+            pre->insts.pop_back();
+            for (auto inst : hoisted)
+            {
+                inst->dead = false;
+                inst->parent = pre;
+                pre->insts.push_back(inst);
+            }
+            pre->insts.push_back(term);
+            return true;
+        }
+    };
+}
+
+bool LICM(IRFunction &func, AnalysisManager &am)
+{
+    LICMPass pass(func, am.getLoopInfo(func));
+    return pass.run();
+}
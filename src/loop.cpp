@@ -0,0 +1,223 @@
+#include "ir.hpp"
+#include <algorithm>
+
+using namespace std;
+
+// 自然循环分析与循环相关的公共工具
+
+void Loop::addBlock(IRBlock *bb, IRBlock *before)
+{
+    for (Loop *loop = this; loop; loop = loop->parent)
+    {
+        loop->blocks.insert(find(loop->blocks.begin(), loop->blocks.end(), before), bb);
+        loop->block_set.insert(bb);
+    }
+}
+
+void LoopInfo::build(IRFunction &func, const DomTree &dom)
+{
+    loops.clear();
+    block_loop.clear();
+    vector<int> order(func.blocks.size(), -1);
+    for (size_t i = 0; i < dom.rpo.size(); ++i)
+        order[dom.rpo[i]] = i;
+
+    // 1. 找回边，按header合并
+    unordered_map<IRBlock *, Loop *> by_header;
+    vector<unique_ptr<Loop>> found;
+    for (int b : dom.rpo)
+    {
+        IRBlock *bb = func.blocks[b];
+        for (auto succ : bb->succs)
+        {
+            if (!dom.dominates(succ->id, b))
+                continue;
+            Loop *&loop = by_header[succ];
+            if (!loop)
+            {
+                found.emplace_back(new Loop());
+                loop = found.back().get();
+                loop->header = succ;
+            }
+            loop->latches.push_back(bb);
+        }
+    }
+
+    // 2. 从回边起点逆向搜索到header为止，得到循环体
+    for (auto &loop : found)
+    {
+        loop->block_set.insert(loop->header);
+        vector<IRBlock *> work;
+        for (auto latch : loop->latches)
+        {
+            if (loop->block_set.insert(latch).second)
+                work.push_back(latch);
+        }
+        while (!work.empty())
+        {
+            IRBlock *bb = work.back();
+            work.pop_back();
+            for (auto pred : bb->preds)
+            {
+                if (order[pred->id] != -1 && loop->block_set.insert(pred).second)
+                    work.push_back(pred);
+            }
+        }
+        loop->blocks.assign(loop->block_set.begin(), loop->block_set.end());
+        sort(loop->blocks.begin(), loop->blocks.end(), [&](IRBlock *a, IRBlock *b)
+             { return order[a->id] < order[b->id]; });
+    }
+
+    // 3. 自然循环要么嵌套要么不相交：按大小从大到小处理，后处理的是内层循环
+    stable_sort(found.begin(), found.end(), [](const unique_ptr<Loop> &a, const unique_ptr<Loop> &b)
+                { return a->blocks.size() > b->blocks.size(); });
+    for (auto &loop : found)
+    {
+        auto it = block_loop.find(loop->header);
+        if (it != block_loop.end())
+        {
+            loop->parent = it->second;
+            loop->depth = loop->parent->depth + 1;
+            loop->parent->children.push_back(loop.get());
+        }
+        for (auto bb : loop->blocks)
+            block_loop[bb] = loop.get();
+    }
+    loops = move(found);
+}
+
+Loop *LoopInfo::getLoop(IRBlock *bb) const
+{
+    auto it = block_loop.find(bb);
+    return it == block_loop.end() ? nullptr : it->second;
+}
+
+vector<Loop *> LoopInfo::innermostFirst() const
+{
+    vector<Loop *> result;
+    for (auto it = loops.rbegin(); it != loops.rend(); ++it)
+        result.push_back(it->get());
+    return result;
+}
+
+IRBlock *insertPreheader(IRFunction &func, Loop &loop)
+{
+    IRBlock *header = loop.header;
+    vector<IRBlock *> outside;
+    for (auto pred : header->preds)
+        if (!loop.contains(pred))
+            outside.push_back(pred);
+    if (outside.size() == 1)
+    {
+        IRValue *term = outside[0]->terminator();
+        if (term && term->kind == IR_JUMP)
+            return outside[0];
+    }
+
+    // 新建前置块，参数与header一一对应，外部来边改为跳向前置块
+    IRBlock *pre = func.newBlock("preheader");
+    IRValue *jump = func.newValue(IR_JUMP);
+    jump->parent = pre;
+    jump->targets = {header};
+    jump->args.emplace_back();
+    for (size_t i = 0; i < header->params.size(); ++i)
+    {
+        IRValue *param = func.newValue(IR_BLOCK_ARG);
+        param->hasResult = true;
+        param->parent = pre;
+        pre->params.push_back(param);
+        jump->args[0].push_back(param);
+    }
+    pre->insts.push_back(jump);
+    for (auto pred : outside)
+    {
+        IRValue *term = pred->terminator();
+        for (auto &target : term->targets)
+            if (target == header)
+                target = pre;
+    }
+    func.blocks.insert(find(func.blocks.begin(), func.blocks.end(), header), pre);
+    if (loop.parent)
+        loop.parent->addBlock(pre, header);
+    func.buildCFG();
+    return pre;
+}
+
+bool getLoopEdges(Loop &loop, IREdge &entry, IREdge &latch)
+{
+    int entry_cnt = 0, latch_cnt = 0;
+    for (auto pred : loop.header->preds)
+    {
+        IRValue *term = pred->terminator();
+        for (size_t k = 0; k < term->targets.size(); ++k)
+        {
+            if (term->targets[k] != loop.header)
+                continue;
+            if (loop.contains(pred))
+            {
+                latch = {term, k};
+                ++latch_cnt;
+            }
+            else
+            {
+                entry = {term, k};
+                ++entry_cnt;
+            }
+        }
+    }
+    return entry_cnt == 1 && latch_cnt == 1;
+}
+
+vector<InductionVar> findInductionVars(Loop &loop)
+{
+    vector<InductionVar> result;
+    IREdge entry, latch;
+    if (!getLoopEdges(loop, entry, latch))
+        return result;
+    for (size_t i = 0; i < loop.header->params.size(); ++i)
+    {
+        IRValue *param = loop.header->params[i];
+        IRValue *next = latch.first->args[latch.second][i];
+        if (next->kind != IR_BINARY || !next->parent || !loop.contains(next->parent))
+            continue;
+        IRValue *lhs = next->ops[0], *rhs = next->ops[1];
+        int32_t step;
+        // p + c、c + p、p - c
+        if (next->op == IR_ADD && lhs == param && rhs->kind == IR_INT)
+            step = rhs->imm;
+        else if (next->op == IR_ADD && rhs == param && lhs->kind == IR_INT)
+            step = lhs->imm;
+        else if (next->op == IR_SUB && lhs == param && rhs->kind == IR_INT)
+            step = (int32_t)(0u - (uint32_t)rhs->imm);
+        else
+            continue;
+        if (step == 0)
+            continue;
+        result.push_back({param, i, entry.first->args[entry.second][i], next, step});
+    }
+    return result;
+}
+
+unordered_set<IRValue *> collectLocalAllocs(IRFunction &func)
+{
+    unordered_set<IRValue *> allocs, escaped;
+    for (auto bb : func.blocks)
+    {
+        for (auto inst : bb->insts)
+        {
+            if (inst->kind == IR_ALLOC)
+                allocs.insert(inst);
+            for (size_t i = 0; i < inst->ops.size(); ++i)
+            {
+                bool addr = (inst->kind == IR_LOAD && i == 0) || (inst->kind == IR_STORE && i == 1);
+                if (!addr)
+                    escaped.insert(inst->ops[i]);
+            }
+            for (auto &list : inst->args)
+                escaped.insert(list.begin(), list.end());
+        }
+    }
+    for (auto v : escaped)
+        allocs.erase(v);
+    return allocs;
+}
@@ -1,14 +1,34 @@
 #include <cassert>
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <memory>
+#include <sstream>
 #include <string>
 #include <string.h>
 #include "ast.hpp"
 #include "koopa.h"
 #include "koopavisitor.hpp"
+#include "passmgr.hpp"
+#include "passes.hpp"
+#include "cache.hpp"
+#include "irbin.hpp"
+#include "rvsim.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <time.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -18,15 +38,36 @@ using namespace std;
 // 你的代码编辑器/IDE 很可能找不到这个文件, 然后会给你报错 (虽然编译不会出错)
 // 看起来会很烦人, 于是干脆采用这种看起来 dirty 但实际很有效的手段
 extern FILE *yyin;                            // in fe.tab.hpp generated
-extern int yyparse(unique_ptr<BaseAST> &ast); // in parser generated
+extern int yyparse(unique_ptr<BaseAST> &ast, const function<void(const string &)> &emitFunc); // in parser generated
+extern void yyrestart(FILE *file);                                                          // in lexer generated
+extern void resetFrontend();                                                                // in fe.y
 const char *outFilePath;
-bool debugAutotest = true; // 是否输出autotest下的内容到本层级文件夹
+bool debugAutotest = false; // 是否输出autotest下的内容到本层级文件夹（-debug-dumps）
+// 生成目标文件（--emit=obj）使用的汇编器（-assembler=CMD），按空白拆分为程序名和参数，不经过shell
+const char *const DEFAULT_ASSEMBLER = "riscv64-unknown-elf-as -march=rv32im -mabi=ilp32";
+vector<string> assembler;
+int unrollBudget = 64;     // 循环展开的指令数预算（-unroll-budget=N）
+int inlineThreshold = 20;  // 内联的代价阈值（-inline-threshold=N）
+PassManager passManager;   // 优化流水线（-O0/-O1/-O2，默认-O2）
+CompileCache compileCache; // 编译结果的磁盘缓存（-cache-dir=DIR）
+ThreadPool threadPool;     // 函数级的优化和代码生成并行运行（-jobs=N，默认为CPU核数）
+bool pipelined = false;    // 解析与优化、代码生成同时进行（-pipeline）
+bool simRun = false;       // 编译后在模拟器中运行生成的汇编（-run）
+SimModel simModel;         // 模拟器估计周期数使用的流水线模型（-sim-model=...）
+uint64_t simLimit = 0;     // 模拟器最多执行的指令数，0为不限（-sim-limit=N）
 
 // 调用 parser 函数, parser 函数会进一步调用 lexer 解析输入文件的
 unique_ptr<BaseAST> ast;
+streambuf *stdoutBuf = cout.rdbuf(); // 输出文件为-时写到这里，cout改写到stderr
+bool serving = false; // 批量/服务模式：stdin和stdout不属于某个作业（服务模式下是作业的协议），作业不能使用-
 
 void writeToFile(string content, const char *path)
 {
+    if (!strcmp(path, "-"))
+    {
+        ostream(stdoutBuf) << content << endl;
+        return;
+    }
     // 输出到文件
     fstream fout;
     fout.open(path, ios_base::out);
@@ -41,19 +82,37 @@ void writeToFile(string content, const char *path)
     fout.clear();
 }
 
+// 将前端生成的IR解析为内存形式，经过优化后重新输出为文本
+string OptimizeKoopaIR(const string &ir)
+{
+    if (passManager.irPipeline.empty())
+        return ir;
+    IRProgram prog;
+    if (!parseIR(ir, prog))
+    {
+        cerr << "Failed to parse generated IR, skipping optimization\n";
+        return ir;
+    }
+    passManager.run(prog);
+    return dumpIR(prog);
+}
+
 string GenerateKoopaIR()
 {
-    string koopa_str = ast->Dump();
-    cout << "Generated Koopa IR str: \n"
-         << koopa_str << endl;
-    cout << endl;
+    string koopa_str = OptimizeKoopaIR(ast->Dump());
+    if (debugAutotest)
+    {
+        cout << "Generated Koopa IR str: \n"
+             << koopa_str << endl;
+        cout << endl;
+    }
     return koopa_str;
 }
 
-void GenerateRISCVFile(string koopaIR)
+// 将Koopa IR翻译为汇编，每个函数的翻译、机器IR上的优化和输出是线程池中的一个任务
+// 返回按程序顺序排列的各函数的汇编，names为对应的函数名
+vector<string> GenerateRISCVFunctions(const string &koopaIR, vector<string> &names)
 {
-    cout << "Generating RISCV(raw program) ...\n";
-
     // 将KoopaIR字符串解析为KoopaIR程序
     koopa_program_t program;
     koopa_error_code_t res = koopa_parse_from_string(koopaIR.data(), &program);
@@ -66,51 +125,1068 @@ void GenerateRISCVFile(string koopaIR)
     // 释放 Koopa IR 程序占用的内存
     koopa_delete_program(program);
 
-    // 处理 raw program
-    // ...
-    scanStackSize(koopaIR);
-    VisitProgram(raw, outFilePath);
-    if (debugAutotest)
+    // 处理 raw program：全局变量顺序访问，函数并行翻译，大的函数先开始
+    VisitSlice(raw.values);
+    vector<koopa_raw_function_t> funcs = collectFunctions(raw);
+    vector<size_t> order(funcs.size()), cost(funcs.size());
+    for (size_t i = 0; i < funcs.size(); ++i)
     {
-        stringstream ss;
-        ss << time(nullptr);
-        VisitProgram(raw, (ss.str() + ".riscv").data()); // debug autotest
+        order[i] = i;
+        for (size_t j = 0; j < funcs[i]->bbs.len; ++j)
+            cost[i] += reinterpret_cast<koopa_raw_basic_block_t>(funcs[i]->bbs.buffer[j])->insts.len;
     }
-    cout << "SUCCESS!\n";
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                { return cost[a] > cost[b]; });
+    vector<string> bodies(funcs.size());
+    names.assign(funcs.size(), "");
+    threadPool.parallelFor(order, [&](size_t i)
+                           {
+                               MachineFunction mfunc;
+                               VisitFunction(funcs[i], mfunc);
+                               passManager.run(mfunc);
+                               names[i] = mfunc.name;
+                               bodies[i] = dumpMachineFunction(mfunc);
+                           });
 
     // 处理完成, 释放 raw program builder 占用的内存
     // 注意, raw program 中所有的指针指向的内存均为 raw program builder 的内存
     // 所以不要在 raw program 处理完毕之前释放 builder
     koopa_delete_raw_program_builder(builder);
+    return bodies;
 }
 
-int main(int argc, const char *argv[])
+string GenerateRISCV(const string &koopaIR)
 {
-    // 解析命令行参数. 测试脚本/评测平台要求你的编译器能接收如下参数:
-    // compiler 模式 输入文件 -o 输出文件
-    assert(argc == 5);
+    cout << "Generating RISCV(raw program) ...\n";
+    vector<string> names;
+    vector<string> bodies = GenerateRISCVFunctions(koopaIR, names);
+    string riscv = dumpMachineHeader(names);
+    for (auto &body : bodies)
+        riscv += body;
+    return riscv;
+}
+
+// 一种输出及其文件名（--emit=koopa,riscv,obj,kir）
+class EmitTarget
+{
+public:
+    string kind; // koopa、riscv、obj或kir
+    string path;
+};
+
+// 各种输出的扩展名，未知的种类返回nullptr
+const char *EmitExtension(const string &kind)
+{
+    if (kind == "koopa")
+        return ".koopa";
+    if (kind == "riscv")
+        return ".s";
+    if (kind == "obj")
+        return ".o";
+    if (kind == "kir")
+        return ".kir";
+    return nullptr;
+}
+
+// 解析--emit的列表，每项为 种类 或 种类=文件名，没有文件名时把-o的文件名的扩展名换为该种类的扩展名
+// 与模式相同且没有文件名的项就是-o的输出；出错时返回false
+bool ParseEmit(const string &list, vector<EmitTarget> &targets)
+{
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ','))
+    {
+        EmitTarget target;
+        size_t eq = item.find('=');
+        target.kind = item.substr(0, eq);
+        const char *ext = EmitExtension(target.kind);
+        if (!ext)
+        {
+            cerr << "Unknown output kind: " << target.kind << endl;
+            return false;
+        }
+        if (eq != string::npos)
+            target.path = item.substr(eq + 1);
+        else if (target.kind == targets[0].kind)
+            continue;
+        else if (!strcmp(outFilePath, "-"))
+        {
+            cerr << "--emit=" << target.kind << " needs a file name when writing to stdout" << endl;
+            return false;
+        }
+        else
+        {
+            target.path = outFilePath;
+            size_t slash = target.path.rfind('/'), dot = target.path.rfind('.');
+            if (dot != string::npos && (slash == string::npos || dot > slash))
+                target.path.erase(dot);
+            target.path += ext;
+        }
+        if (target.kind == "obj" && target.path == "-")
+        {
+            cerr << "Object output needs a file name" << endl;
+            return false;
+        }
+        targets.push_back(target);
+    }
+    return true;
+}
+
+// 按空白拆分命令行（不支持引号）
+vector<string> SplitCommand(const string &cmd)
+{
+    stringstream ss(cmd);
+    vector<string> args;
+    string arg;
+    while (ss >> arg)
+        args.push_back(arg);
+    return args;
+}
+
+// 把汇编写到临时文件，由汇编器生成目标文件
+// 直接fork/execvp汇编器，文件名原样作为参数，含空格或shell元字符也不会被解释
+bool Assemble(const string &riscv, const string &objPath)
+{
+    char tmp[] = "/tmp/fe-asm-XXXXXX.s";
+    int fd = mkstemps(tmp, 2);
+    if (fd < 0)
+    {
+        cerr << "Failed to create temporary file for the assembler" << endl;
+        return false;
+    }
+    close(fd);
+    writeToFile(riscv, tmp);
+    vector<string> args = assembler;
+    args.insert(args.end(), {"-o", objPath, tmp});
+    vector<char *> argv;
+    for (auto &arg : args)
+        argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        execvp(argv[0], argv.data());
+        _exit(127); // 找不到汇编器
+    }
+    int status = 0;
+    pid_t waited = -1;
+    if (pid > 0)
+        while ((waited = waitpid(pid, &status, 0)) < 0 && errno == EINTR)
+            ;
+    unlink(tmp);
+    if (waited != pid || !WIFEXITED(status) || WEXITSTATUS(status))
+    {
+        cerr << "Assembler failed";
+        if (waited == pid && WIFEXITED(status))
+            cerr << " (exit status " << WEXITSTATUS(status) << ")";
+        cerr << ":";
+        for (auto &arg : args)
+            cerr << " " << arg;
+        cerr << endl;
+        return false;
+    }
+    return true;
+}
+
+// 二进制IR（--emit=kir）
+bool WriteIRBinaryFile(const string &ir, const string &path)
+{
+    IRProgram prog;
+    if (!parseIR(ir, prog))
+        return false;
+    string data = writeIRBinary(prog);
+    if (path == "-")
+    {
+        ostream(stdoutBuf).write(data.data(), data.size());
+        return true;
+    }
+    ofstream fout(path, ios_base::binary);
+    fout << data;
+    if (!fout.good())
+    {
+        cerr << "Failed to write " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+// 模拟器的选项，不是模拟器的选项时返回false，参数不合法时ok为false
+bool ParseSimOption(const char *arg, bool &ok)
+{
+    ok = true;
+    if (!strncmp(arg, "-sim-model=", 11))
+        ok = simModel.parse(arg + 11);
+    else if (!strncmp(arg, "-sim-limit=", 11))
+        simLimit = strtoull(arg + 11, nullptr, 10);
+    else
+        return false;
+    return true;
+}
+
+// 在模拟器中运行汇编的main，统计写到cout
+bool RunSimulation(const string &riscv)
+{
+    SimStats stats;
+    if (!simulateRISCV(riscv, simModel, stats, "main", simLimit))
+        return false;
+    stats.report(cout);
+    return true;
+}
+
+// 由同一次编译得到的IR和汇编写出所有要求的输出
+bool EmitOutputs(const vector<EmitTarget> &targets, const string &ir, const string &riscv)
+{
+    for (auto &target : targets)
+    {
+        if (target.kind == "koopa")
+            writeToFile(ir, target.path.c_str());
+        else if (target.kind == "riscv")
+            writeToFile(riscv, target.path.c_str());
+        else if (target.kind == "kir")
+        {
+            if (!WriteIRBinaryFile(ir, target.path))
+                return false;
+        }
+        else if (!Assemble(riscv, target.path))
+            return false;
+    }
+    cout << "SUCCESS!\n";
+    return true;
+}
+
+// 缓存中的结果：IR的长度、换行、IR、汇编
+string PackOutputs(const string &ir, const string &riscv)
+{
+    return to_string(ir.size()) + "\n" + ir + riscv;
+}
+
+void UnpackOutputs(const string &data, string &ir, string &riscv)
+{
+    size_t start = data.find('\n') + 1;
+    size_t len = stoul(data);
+    ir = data.substr(start, len);
+    riscv = data.substr(start + len);
+}
+
+// 增量编译的单位：最后一个模块级pass之后的函数，之后的优化和代码生成只取决于函数本身
+class FunctionUnit
+{
+public:
+    string key;
+    bool cached = false;
+    string ir;    // 优化后的Koopa IR
+    string riscv; // 汇编（-riscv时）
+};
+
+// 逐个函数查找缓存，只对未命中的函数运行函数级pass和代码生成
+// 得到整个程序的Koopa IR和（genRISCV时的）汇编，前端的IR无法解析时返回false
+bool CompileIncrementally(const string &frontIR, bool genRISCV, string &ir, string &riscv)
+{
+    IRProgram prog;
+    if (!parseIR(frontIR, prog))
+    {
+        cerr << "Failed to parse generated IR, skipping incremental compilation\n";
+        return false;
+    }
+    passManager.runModulePrefix(prog);
+    vector<FunctionUnit> units(prog.funcs.size());
+    IRProgram rest; // 需要生成代码的函数，命中的函数只保留声明供调用
+    rest.decls = prog.decls;
+    for (size_t i = 0; i < prog.funcs.size(); ++i)
+    {
+        IRFunction &func = *prog.funcs[i];
+        FunctionUnit &unit = units[i];
+        func.canonicalizeNames();
+        unit.key = compileCache.functionKey(dumpFunction(func));
+        string data;
+        if (compileCache.lookupFunction(unit.key, data))
+        {
+            UnpackOutputs(data, unit.ir, unit.riscv);
+            unit.cached = true;
+            IRDecl decl;
+            decl.name = func.name;
+            decl.paramTypes.assign(func.params.size(), "i32");
+            decl.retType = func.retVoid ? "" : "i32";
+            rest.decls.push_back(decl);
+            continue;
+        }
+        passManager.runFunctionSuffix(func);
+        unit.ir = dumpFunction(func);
+    }
+
+    IRProgram decls;
+    decls.decls = prog.decls;
+    ir = dumpIR(decls);
+    vector<string> names;
+    for (size_t i = 0; i < units.size(); ++i)
+    {
+        ir += (i ? "\n" : "") + units[i].ir;
+        names.push_back(prog.funcs[i]->name.substr(1));
+        if (!units[i].cached)
+            rest.funcs.push_back(move(prog.funcs[i]));
+    }
+
+    if (genRISCV)
+    {
+        if (!rest.funcs.empty())
+        {
+            vector<string> rest_names;
+            vector<string> bodies = GenerateRISCVFunctions(dumpIR(rest), rest_names);
+            size_t j = 0;
+            for (auto &unit : units)
+            {
+                if (unit.cached)
+                    continue;
+                assert(j < bodies.size());
+                unit.riscv = bodies[j++];
+            }
+        }
+        riscv = dumpMachineHeader(names);
+        for (auto &unit : units)
+            riscv += unit.riscv;
+    }
+    for (auto &unit : units)
+    {
+        if (!unit.cached)
+            compileCache.storeFunction(unit.key, PackOutputs(unit.ir, unit.riscv));
+    }
+    return true;
+}
+
+// 流水线中的一个函数：解析器线程产生前端IR，后端线程完成函数级pass和代码生成
+class PipelineUnit
+{
+public:
+    string frontIR;
+    IRProgram prog; // 只含这一个函数
+    string ir;      // 优化后的Koopa IR（没有模块级pass时）
+    string riscv;   // 汇编（没有模块级pass且-riscv时）
+    string name;    // 汇编中的函数名
+    bool done = false;
+};
+
+// 解析器每归约出一个函数就翻译为IR放入有界队列，后端线程取出后运行第一个模块级pass之前的函数级pass
+// 没有模块级pass时后端线程接着生成该函数的汇编；否则等解析完成后合并为整个程序，运行其余的pass并生成汇编
+// 得到整个程序的Koopa IR和（genRISCV时的）汇编，结果与非流水线模式相同，有语法或语义错误时返回false
+// stream非空时（要求passManager.canStream()）按源码顺序把完成的函数写到stream后立即释放，不填写ir和riscv；
+// 流水线中有inline时逐个函数内联已经完成的被调函数，只保留可能被内联的函数的副本，结果可能与不流式输出时不同
+bool CompilePipelined(bool genRISCV, string &ir, string &riscv, ostream *stream = nullptr)
+{
+    // 解析器占一个线程；-print-after时只用一个后端线程，输出不交错
+    int backends = passManager.printAfter.empty() ? max(1, threadPool.getThreads() - 1) : 1;
+    BoundedQueue<PipelineUnit *> queue(2 * backends);   // 解析器最多领先后端这么多个函数
+    vector<unique_ptr<PipelineUnit>> units;
+    map<string, IRDecl> signatures; // 已解析的函数，生成单个函数的汇编时作为被调用函数的声明
+    mutex lock;                     // 保护units、signatures和流式内联的inlined、inlineBodies
+    bool streamInline = stream && passManager.hasModulePass();
+    bool perFunction = !passManager.hasModulePass() || streamInline;
+    assert(!stream || passManager.canStream());
+    // 流式内联：已经完成内联的函数，其中可能被内联的函数保留内联后的副本
+    set<string> inlined;
+    map<string, unique_ptr<IRProgram>> inlineBodies;
+    condition_variable inlineDone;
+    const char *separator = passManager.irPipeline.empty() ? "\n\n" : "\n"; // 函数之间，与非流水线模式一致
+
+    // 流式输出：前面的函数没完成时后面完成的函数要等待，在内存中的函数个数有上限
+    size_t flushed = 0; // units中已写出并释放的个数
+    size_t limit = 4 * backends;
+    condition_variable drained;
+    auto flush = [&]() // 持有lock时调用
+    {
+        for (; flushed < units.size() && units[flushed]->done; ++flushed)
+        {
+            PipelineUnit &unit = *units[flushed];
+            if (genRISCV)
+                *stream << "  .globl " << unit.name << "\n"
+                        << unit.riscv;
+            else
+                *stream << (flushed ? separator : "") << unit.ir;
+            units[flushed].reset();
+        }
+        stream->flush();
+        drained.notify_all();
+    };
+    auto complete = [&](PipelineUnit *unit)
+    {
+        if (!stream)
+            return;
+        lock_guard<mutex> guard(lock);
+        unit->done = true;
+        flush();
+    };
+    if (stream && genRISCV)
+        *stream << "  .text \n"; // 不能先列出所有函数名，每个函数前各自.globl
+
+    auto backend = [&]()
+    {
+        PipelineUnit *unit;
+        while (queue.pop(unit))
+        {
+            if (!parseIR(unit->frontIR, unit->prog) || unit->prog.funcs.size() != 1)
+            {
+                cerr << "Failed to parse generated IR of function:\n"
+                     << unit->frontIR << endl;
+                assert(false);
+            }
+            IRFunction &func = *unit->prog.funcs[0];
+            passManager.runFunctionPrefix(func);
+            if (!perFunction)
+                continue;
+            if (streamInline)
+            {
+                // 被调用的函数都在这个函数之前定义，已经被其他后端线程取出，等它们完成内联
+                unordered_map<string, IRFunction *> callees;
+                {
+                    unique_lock<mutex> guard(lock);
+                    for (auto bb : func.blocks)
+                        for (auto inst : bb->insts)
+                        {
+                            if (inst->kind != IR_CALL || inst->callee == func.name || !signatures.count(inst->callee))
+                                continue;
+                            inlineDone.wait(guard, [&]
+                                            { return inlined.count(inst->callee) > 0; });
+                            auto it = inlineBodies.find(inst->callee);
+                            if (it != inlineBodies.end())
+                                callees[inst->callee] = it->second->funcs[0].get();
+                        }
+                }
+                passManager.runInline(func, callees);
+                unique_ptr<IRProgram> copy;
+                if (MayInline(func, inlineThreshold))
+                {
+                    copy.reset(new IRProgram());
+                    if (!parseIR(dumpFunction(func), *copy) || copy->funcs.size() != 1)
+                    {
+                        cerr << "Failed to copy function " << func.name << " for inlining" << endl;
+                        assert(false);
+                    }
+                }
+                {
+                    lock_guard<mutex> guard(lock);
+                    if (copy)
+                        inlineBodies[func.name] = move(copy);
+                    inlined.insert(func.name);
+                }
+                inlineDone.notify_all();
+                passManager.runFunctionAfterInline(func);
+            }
+            // 与OptimizeKoopaIR一致：没有pass时直接输出前端的IR
+            unit->ir = passManager.irPipeline.empty() ? move(unit->frontIR) : dumpFunction(func);
+            string().swap(unit->frontIR);
+            if (!genRISCV)
+            {
+                complete(unit);
+                continue;
+            }
+            // 被调用的函数都在这个函数之前定义（递归调用除外），其声明已经登记
+            IRProgram piece;
+            {
+                lock_guard<mutex> guard(lock);
+                for (auto bb : func.blocks)
+                    for (auto &inst : bb->insts)
+                    {
+                        if (inst->kind != IR_CALL || inst->callee == func.name)
+                            continue;
+                        auto it = signatures.find(inst->callee);
+                        assert(it != signatures.end());
+                        bool seen = false;
+                        for (auto &decl : piece.decls)
+                            seen = seen || decl.name == inst->callee;
+                        if (!seen)
+                            piece.decls.push_back(it->second);
+                    }
+            }
+            piece.funcs.push_back(move(unit->prog.funcs[0]));
+            vector<string> names;
+            vector<string> bodies = GenerateRISCVFunctions(dumpIR(piece), names);
+            assert(bodies.size() == 1);
+            unit->riscv = bodies[0];
+            unit->name = names[0];
+            unit->prog.funcs.clear();
+            complete(unit);
+        }
+    };
+    vector<thread> threads;
+    for (int i = 0; i < backends; ++i)
+        threads.emplace_back(backend);
+
+    // 在解析器线程中调用
+    auto emit = [&](const string &frontIR)
+    {
+        unique_ptr<PipelineUnit> unit(new PipelineUnit());
+        unit->frontIR = frontIR;
+        // 第一行为 fun @name(@x: i32, ...): i32 {
+        IRDecl decl;
+        size_t lparen = frontIR.find('('), rparen = frontIR.find(')');
+        decl.name = frontIR.substr(4, lparen - 4);
+        size_t params = count(frontIR.begin() + lparen, frontIR.begin() + rparen, ':');
+        decl.paramTypes.assign(params, "i32");
+        decl.retType = frontIR.compare(rparen + 1, 2, ": ") ? "" : "i32";
+        PipelineUnit *raw = unit.get();
+        {
+            unique_lock<mutex> guard(lock);
+            if (stream)
+                drained.wait(guard, [&]
+                             { return units.size() - flushed < limit; });
+            signatures[decl.name] = decl;
+            units.push_back(move(unit));
+        }
+        queue.push(raw);
+    };
+    // 前端的错误在这里捕获，先等后端线程处理完已经入队的函数再返回
+    int ret;
+    try
+    {
+        ret = yyparse(ast, emit);
+    }
+    catch (const CompileError &)
+    {
+        ret = 1;
+    }
+    queue.close();
+    for (auto &t : threads)
+        t.join();
+    if (ret)
+        return false;
+
+    if (stream)
+    {
+        *stream << endl;
+        return true;
+    }
+    if (perFunction)
+    {
+        vector<string> names;
+        for (size_t i = 0; i < units.size(); ++i)
+        {
+            if (i)
+                ir += separator;
+            ir += units[i]->ir;
+            names.push_back(units[i]->name);
+        }
+        if (genRISCV)
+        {
+            riscv = dumpMachineHeader(names);
+            for (auto &unit : units)
+                riscv += unit->riscv;
+        }
+        return true;
+    }
+    IRProgram prog;
+    for (auto &unit : units)
+        prog.funcs.push_back(move(unit->prog.funcs[0]));
+    passManager.runModuleSuffix(prog);
+    ir = dumpIR(prog);
+    if (genRISCV)
+    {
+        vector<string> names;
+        vector<string> bodies = GenerateRISCVFunctions(ir, names);
+        riscv = dumpMachineHeader(names);
+        for (auto &body : bodies)
+            riscv += body;
+    }
+    return true;
+}
+
+// 编译一个作业，argv与单独运行时的命令行相同（argv[0]不使用），成功时返回0
+// 批量/服务模式下同一进程中依次编译多个作业，开始时恢复所有选项的默认值
+int CompileJob(int argc, const char *argv[])
+{
+    if (argc < 5 || strcmp(argv[3], "-o"))
+    {
+        cerr << "Usage: compiler mode input -o output [options...]" << endl;
+        return 1;
+    }
     auto mode = argv[1];
     auto input = argv[2];
     outFilePath = argv[4];
+    passManager.reset();
+    passManager.pool = &threadPool;
+    threadPool.setThreads(thread::hardware_concurrency());
+    unrollBudget = 64;
+    inlineThreshold = 20;
+    compileCache = CompileCache();
+    pipelined = false;
+    simRun = false;
+    simModel = SimModel();
+    simLimit = 0;
+    debugAutotest = false;
+    assembler = SplitCommand(DEFAULT_ASSEMBLER);
+    if (strcmp(mode, "-koopa") && strcmp(mode, "-riscv"))
+    {
+        cerr << "Unknown mode: " << mode << endl;
+        return 1;
+    }
+    vector<EmitTarget> targets = {{mode + 1, outFilePath}}; // 模式对应的输出写到-o的文件
+    string options = mode; // 影响输出的选项，作为缓存键的一部分
+    for (int i = 5; i < argc; ++i)
+    {
+        if (!strncmp(argv[i], "-cache-dir=", 11))
+        {
+            compileCache.dir = argv[i] + 11;
+            continue;
+        }
+        if (!strncmp(argv[i], "-cache-size=", 12))
+        {
+            compileCache.maxBytes = strtoull(argv[i] + 12, nullptr, 10) << 20;
+            continue;
+        }
+        if (!strcmp(argv[i], "-cache-stats"))
+        {
+            compileCache.printStats = true;
+            continue;
+        }
+        if (!strncmp(argv[i], "-jobs=", 6)) // 不影响输出，不计入缓存的键
+        {
+            threadPool.setThreads(atoi(argv[i] + 6));
+            continue;
+        }
+        if (!strcmp(argv[i], "-pipeline"))
+        {
+            pipelined = true;
+            continue;
+        }
+        if (!strcmp(argv[i], "-debug-dumps"))
+        {
+            debugAutotest = true;
+            continue;
+        }
+        if (!strcmp(argv[i], "-run")) // 缓存的结果中要有汇编，计入缓存的键
+        {
+            simRun = true;
+            options += " -run";
+            continue;
+        }
+        bool simOk;
+        if (ParseSimOption(argv[i], simOk))
+        {
+            if (!simOk)
+                return 1;
+            continue;
+        }
+        options += " ";
+        options += argv[i];
+        if (!strncmp(argv[i], "-unroll-budget=", 15))
+            unrollBudget = atoi(argv[i] + 15);
+        else if (!strncmp(argv[i], "-inline-threshold=", 18))
+            inlineThreshold = atoi(argv[i] + 18);
+
+        else if (!strcmp(argv[i], "-O0") || !strcmp(argv[i], "-O1") || !strcmp(argv[i], "-O2"))
+            passManager.setOptLevel(argv[i][2] - '0');
+        else if (!strncmp(argv[i], "-passes=", 8))
+        {
+            if (!passManager.setPipeline(argv[i] + 8))
+            {
+                cerr << "Unknown pass in: " << argv[i] << endl;
+                return 1;
+            }
+        }
+        else if (!strncmp(argv[i], "-print-after=", 13))
+        {
+            if (!PassManager::isKnownPass(argv[i] + 13))
+            {
+                cerr << "Unknown pass: " << argv[i] + 13 << endl;
+                return 1;
+            }
+            passManager.printAfter.push_back(argv[i] + 13);
+        }
+        else if (!strcmp(argv[i], "-time-passes"))
+            passManager.timePasses = true;
+        else if (!strncmp(argv[i], "--emit=", 7))
+        {
+            if (!ParseEmit(argv[i] + 7, targets))
+                return 1;
+        }
+        else if (!strncmp(argv[i], "-assembler=", 11))
+        {
+            assembler = SplitCommand(argv[i] + 11);
+            if (assembler.empty())
+            {
+                cerr << "Empty assembler command" << endl;
+                return 1;
+            }
+        }
+        else
+        {
+            cerr << "Unknown option: " << argv[i] << endl;
+            return 1;
+        }
+    }
+
+    // 输入为-时从stdin读入；输出为-时写到stdout，编译过程中的提示改写到stderr
+    bool fromStdin = !strcmp(input, "-");
+    bool toStdout = !strcmp(outFilePath, "-");
+    bool anyStdout = false;
+    for (auto &target : targets)
+        anyStdout = anyStdout || target.path == "-";
+    if (serving && (fromStdin || anyStdout))
+    {
+        cerr << "Jobs in batch/server mode cannot read stdin or write stdout" << endl;
+        return 1;
+    }
+    if (toStdout)
+        cout.rdbuf(cerr.rdbuf());
+    if (fromStdin && compileCache.enabled())
+    {
+        cerr << "Compile cache is not used when reading from stdin" << endl;
+        compileCache.dir.clear();
+    }
 
-    // 打开输入文件, 并且指定 lexer 在解析的时候读取这个文件
-    yyin = fopen(input, "r");
-    assert(yyin);
+    if (compileCache.enabled())
+    {
+        ifstream fin(input, ios_base::binary);
+        if (!fin.is_open())
+        {
+            cerr << "Failed to open " << input << endl;
+            return 1;
+        }
+        stringstream source;
+        source << fin.rdbuf();
+        compileCache.setKey(source.str(), options);
+        string output;
+        if (compileCache.lookup(output))
+        {
+            string ir, riscv;
+            UnpackOutputs(output, ir, riscv);
+            if (!EmitOutputs(targets, ir, riscv))
+                return 1;
+            if (simRun && !RunSimulation(riscv))
+                return 1;
+            compileCache.finish();
+            if (compileCache.printStats)
+                compileCache.report(cerr);
+            return 0;
+        }
+    }
 
-    auto ret = yyparse(ast);
-    assert(!ret);
+    // 输入为二进制IR（--emit=kir的输出）时跳过前端，从IR开始优化和生成代码
+    bool binaryInput = !fromStdin && isIRBinaryFile(input);
+    if (!binaryInput)
+    {
+        // 打开输入文件, 并且指定 lexer 在解析的时候读取这个文件
+        yyin = fromStdin ? stdin : fopen(input, "r");
+        if (!yyin)
+        {
+            cerr << "Failed to open " << input << endl;
+            return 1;
+        }
+        yyrestart(yyin); // 丢弃上一个作业在lexer中剩余的输入
+    }
 
-    string ir = GenerateKoopaIR();
+    // 流水线模式和使用缓存时的按函数增量编译，汇编与IR一起生成
+    bool genRISCV = false;
+    for (auto &target : targets)
+        genRISCV = genRISCV || target.kind == "riscv" || target.kind == "obj";
+    genRISCV = genRISCV || simRun;
+    string ir, riscv;
+    // 只输出到stdout时流式输出：每个函数完成后立即写出，不保留整个程序的AST、IR和汇编
+    // 默认的-O2中的inline改为逐个函数内联已经完成的被调函数；inline以外的模块级pass需要整个程序，编译完成后再写出
+    // 使用缓存时要保存整个结果，也不流式输出
+    bool stream = toStdout && targets.size() == 1 && targets[0].kind != "kir" && !binaryInput && !simRun &&
+                  !compileCache.enabled();
+    if (stream && !passManager.canStream())
+        cerr << "Note: the pass pipeline needs the whole program, output is written after compiling all functions" << endl;
+    else if (stream)
+    {
+        ostream out(stdoutBuf);
+        if (!CompilePipelined(genRISCV, ir, riscv, &out))
+            return 1;
+        if (passManager.timePasses)
+            passManager.printStats(cerr);
+        return 0;
+    }
+    bool generated = false; // IR和汇编是否已经一起生成
+    if (binaryInput)
+    {
+        IRProgram prog;
+        if (!loadIRBinaryFile(input, prog))
+            return 1;
+        if (!passManager.irPipeline.empty())
+            passManager.run(prog);
+        ir = dumpIR(prog);
+    }
+    else if (pipelined)
+    {
+        if (!CompilePipelined(genRISCV, ir, riscv))
+            return 1;
+        generated = true;
+    }
+    else
+    {
+        if (yyparse(ast, nullptr))
+            return 1;
+        generated = compileCache.enabled() && CompileIncrementally(ast->Dump(), genRISCV, ir, riscv);
+        if (!generated)
+            ir = GenerateKoopaIR();
+    }
+    if (genRISCV && !generated)
+        riscv = GenerateRISCV(ir);
+    // 所有的输出都来自同一次编译
+    if (!EmitOutputs(targets, ir, riscv))
+        return 1;
+    if (simRun && !RunSimulation(riscv))
+        return 1;
     if (debugAutotest)
     {
         stringstream ss;
         ss << time(nullptr);
         writeToFile(ir, (ss.str() + ".koopa").data());
+        if (genRISCV)
+            writeToFile(riscv, (ss.str() + ".riscv").data()); // debug autotest
+    }
+    if (passManager.timePasses)
+        passManager.printStats(cerr);
+    if (compileCache.enabled())
+    {
+        compileCache.store(PackOutputs(ir, riscv));
+        compileCache.finish();
+        if (compileCache.printStats)
+            compileCache.report(cerr);
+    }
+
+    return 0;
+}
+
+// 一个作业结束后释放AST并清空前端的状态，AST节点池、线程池、指令合并的规则表等留给下一个作业
+void FinishJob()
+{
+    ast.reset();
+    resetFrontend();
+    if (yyin && yyin != stdin)
+        fclose(yyin);
+    yyin = nullptr;
+}
+
+// 作业的格式与命令行相同：模式 输入文件 -o 输出文件 [选项...]，公共选项插在作业自己的选项之前
+int RunJob(const string &line, const vector<string> &common)
+{
+    vector<string> words;
+    stringstream ss(line);
+    string word;
+    while (ss >> word)
+        words.push_back(word);
+    if (words.size() > 4)
+        words.insert(words.begin() + 4, common.begin(), common.end());
+    else
+        words.insert(words.end(), common.begin(), common.end());
+    vector<const char *> argv = {"compiler"};
+    for (auto &w : words)
+        argv.push_back(w.c_str());
+    streambuf *coutBuf = cout.rdbuf();
+    int ret;
+    try
+    {
+        ret = CompileJob(argv.size(), argv.data());
+    }
+    catch (const CompileError &)
+    {
+        ret = 1; // 前端的状态由FinishJob清空
     }
-    if (!strcmp(mode, "-koopa"))
-        writeToFile(ir, outFilePath);
-    else if (!strcmp(mode, "-riscv"))
-        GenerateRISCVFile(ir);
+    FinishJob();
+    cout.rdbuf(coutBuf);
+    return ret;
+}
+
+static bool isBlankOrComment(const string &line)
+{
+    size_t i = line.find_first_not_of(" \t\r");
+    return i == string::npos || line[i] == '#';
+}
 
+// 依次编译清单中的每个作业，全部成功时返回0
+int RunBatch(const char *manifest, const vector<string> &common)
+{
+    ifstream fin(manifest);
+    if (!fin.is_open())
+    {
+        cerr << "Failed to open " << manifest << endl;
+        return 1;
+    }
+    string line;
+    int failed = 0, total = 0;
+    while (getline(fin, line))
+    {
+        if (isBlankOrComment(line))
+            continue;
+        ++total;
+        if (RunJob(line, common))
+        {
+            cerr << "Job failed: " << line << endl;
+            ++failed;
+        }
+    }
+    cerr << "batch: " << total - failed << " of " << total << " jobs succeeded" << endl;
+    return failed ? 1 : 0;
+}
+
+// 逐行读入作业，每个作业完成后回复一行ok或error；读到quit时返回true
+bool ServeJobs(FILE *in, FILE *out, const vector<string> &common)
+{
+    char *buf = nullptr;
+    size_t cap = 0;
+    bool quit = false;
+    while (getline(&buf, &cap, in) > 0)
+    {
+        string line = buf;
+        if (isBlankOrComment(line))
+            continue;
+        if (line.compare(0, 4, "quit") == 0)
+        {
+            quit = true;
+            break;
+        }
+        fputs(RunJob(line, common) ? "error\n" : "ok\n", out);
+        fflush(out);
+    }
+    free(buf);
+    return quit;
+}
+
+// 常驻进程：socketPath为空时从stdin读入作业、回复写到stdout（编译过程中的输出改写到stderr）
+// 否则监听该Unix套接字，依次处理每个连接，直到某个连接发送quit
+// 选项、输入文件、语法和语义错误都只让该作业失败，回复error后继续处理下一个作业
+int RunServer(const string &socketPath, const vector<string> &common)
+{
+    signal(SIGPIPE, SIG_IGN); // 客户端提前断开时不退出
+    if (socketPath.empty())
+    {
+        cout.rdbuf(cerr.rdbuf());
+        ServeJobs(stdin, stdout, common);
+        return 0;
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (listener < 0 || socketPath.size() >= sizeof(addr.sun_path))
+    {
+        cerr << "Failed to create socket " << socketPath << endl;
+        return 1;
+    }
+    strcpy(addr.sun_path, socketPath.c_str());
+    // 只删除上次留下的套接字，路径上已有的其他文件（如写错的-server=foo.fe）不能覆盖
+    struct stat st;
+    if (!lstat(socketPath.c_str(), &st))
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            cerr << socketPath << " exists and is not a socket" << endl;
+            close(listener);
+            return 1;
+        }
+        unlink(socketPath.c_str());
+    }
+    if (bind(listener, (sockaddr *)&addr, sizeof(addr)) || listen(listener, 16))
+    {
+        cerr << "Failed to listen on " << socketPath << endl;
+        close(listener);
+        return 1;
+    }
+    bool quit = false;
+    while (!quit)
+    {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        FILE *in = fdopen(fd, "r");
+        FILE *out = fdopen(dup(fd), "w");
+        quit = ServeJobs(in, out, common);
+        fclose(in);
+        fclose(out);
+    }
+    close(listener);
+    unlink(socketPath.c_str());
     return 0;
-}
\ No newline at end of file
+}
+
+// 在模拟器中运行汇编文件：compiler -sim 汇编文件 [-sim-model=...] [-sim-limit=N]
+int RunSimulator(int argc, const char *argv[])
+{
+    if (argc < 3)
+    {
+        cerr << "Usage: compiler -sim input.s [-sim-model=...] [-sim-limit=N]" << endl;
+        return 1;
+    }
+    for (int i = 3; i < argc; ++i)
+    {
+        bool ok;
+        if (!ParseSimOption(argv[i], ok))
+        {
+            cerr << "Unknown option: " << argv[i] << endl;
+            return 1;
+        }
+        if (!ok)
+            return 1;
+    }
+    stringstream source;
+    if (!strcmp(argv[2], "-"))
+        source << cin.rdbuf();
+    else
+    {
+        ifstream fin(argv[2]);
+        if (!fin.is_open())
+        {
+            cerr << "Failed to open " << argv[2] << endl;
+            return 1;
+        }
+        source << fin.rdbuf();
+    }
+    return RunSimulation(source.str()) ? 0 : 1;
+}
+
+int main(int argc, const char *argv[])
+{
+    // 解析命令行参数. 测试脚本/评测平台要求你的编译器能接收如下参数:
+    // compiler 模式 输入文件 -o 输出文件
+    // 之后可以跟优化选项：
+    //   -O0/-O1/-O2            预定义的优化流水线
+    //   -passes=p1,p2,...      自定义IR上的pass序列
+    //   -print-after=pass|all  pass运行后把函数输出到stderr（可重复）
+    //   -time-passes           结束时在stderr输出每个pass的统计
+    //   -unroll-budget=N       循环展开的指令数预算
+    //   -inline-threshold=N    内联的代价阈值，越大内联越多
+    //   -jobs=N                函数级的优化和代码生成使用N个线程，-jobs=1时顺序执行
+    //   -pipeline              解析的同时在其他线程中优化和生成已解析完的函数，输出与不加时相同
+    //   -cache-dir=DIR         在DIR中缓存编译结果，源文件和选项都没变时不再编译，否则只重新编译改动过的函数
+    //   -cache-size=MB         缓存的总大小上限，超过时删除最久未使用的结果
+    //   -cache-stats           结束时在stderr输出缓存的命中统计
+    //   --emit=koopa,riscv,obj 同一次编译同时输出多种结果，可写作 种类=文件名，默认由-o的文件名换扩展名得到
+    //                          kir为二进制的IR，可以代替源文件作为输入，跳过前端
+    //   -assembler=CMD         --emit=obj时调用的汇编器，按空白拆分为程序和参数后直接执行（不经过shell）
+    //   -debug-dumps           另外输出带时间戳的.koopa/.riscv文件以及stdout上的调试信息
+    //   -run                   编译后在内置的RV32IM模拟器中运行main，输出返回值、指令数、访存数、分支数和估计的周期数
+    //   -sim-model=load=2,...  模拟器的流水线模型：alu/load/mul/div的延迟，branch/jump的跳转代价，depth流水线级数
+    //   -sim-limit=N           模拟器最多执行N条指令
+    // 输入文件为-时从stdin读入，输出文件为-时写到stdout，每个函数完成后立即输出，
+    // 内存只取决于最大的函数（和保留的可内联的小函数），例如 gen | compiler -riscv - -o - | as
+    // 此时-O2的inline只把已经完成的被调函数内联进来，不按单一调用点内联，也不删除被内联的函数，
+    // 结果可能与输出到文件时不同；流水线中有inline以外的模块级pass时不流式输出，并在stderr说明
+    // 批量和常驻模式，避免每个文件都付出进程启动和加载libkoopa的开销：
+    //   compiler -batch 清单 [公共选项...]          清单每行一个作业（格式同上），#开头的行为注释
+    //   compiler -server[=套接字] [公共选项...]     从stdin或Unix套接字逐行读入作业，每个作业回复ok或error，quit结束
+    //   作业的输入和输出不能为-；某个作业出错时回复error（批量模式下记为失败），继续处理其余的作业
+    // 单独运行汇编（例如比较不同优化下生成的代码）：compiler -sim 汇编文件 [-sim-model=...] [-sim-limit=N]
+    if (argc >= 2 && !strcmp(argv[1], "-sim"))
+        return RunSimulator(argc, argv);
+    if (argc >= 2 && (!strcmp(argv[1], "-batch") || !strncmp(argv[1], "-server", 7)))
+    {
+        bool batch = !strcmp(argv[1], "-batch");
+        if (batch && argc < 3)
+        {
+            cerr << "Usage: compiler -batch manifest [options...]" << endl;
+            return 1;
+        }
+        vector<string> common(argv + (batch ? 3 : 2), argv + argc);
+        serving = true;
+        if (batch)
+            return RunBatch(argv[2], common);
+        return RunServer(argv[1][7] == '=' ? argv[1] + 8 : "", common);
+    }
+    try
+    {
+        return CompileJob(argc, argv);
+    }
+    catch (const CompileError &)
+    {
+        return 1;
+    }
+}
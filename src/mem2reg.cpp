@@ -0,0 +1,300 @@
+#include "passes.hpp"
+#include <algorithm>
+
+using namespace std;
+
+// 判断alloc是否只作为load的地址或store的目标出现（地址没有逃逸）
+static vector<IRValue *> collectPromotableAllocs(IRFunction &func)
+{
+    unordered_map<IRValue *, bool> promotable;
+    for (auto bb : func.blocks)
+        for (auto inst : bb->insts)
+            if (inst->kind == IR_ALLOC)
+                promotable[inst] = true;
+
+    for (auto bb : func.blocks)
+    {
+        for (auto inst : bb->insts)
+        {
+            for (size_t i = 0; i < inst->ops.size(); ++i)
+            {
+                IRValue *op = inst->ops[i];
+                if (op->kind != IR_ALLOC)
+                    continue;
+                bool ok = (inst->kind == IR_LOAD && i == 0) || (inst->kind == IR_STORE && i == 1);
+                if (!ok)
+                    promotable[op] = false;
+            }
+            for (auto &list : inst->args)
+                for (auto arg : list)
+                    if (arg->kind == IR_ALLOC)
+                        promotable[arg] = false;
+        }
+    }
+
+    vector<IRValue *> result;
+    for (auto bb : func.blocks)
+        for (auto inst : bb->insts)
+            if (inst->kind == IR_ALLOC && promotable[inst])
+                result.push_back(inst);
+    return result;
+}
+
+bool Mem2Reg(IRFunction &func, AnalysisManager &am)
+{
+    // 不可达块中对alloc的访问不会被重命名，先删除
+    bool removed = func.removeUnreachableBlocks();
+    if (removed)
+        am.invalidate(func);
+    vector<IRValue *> allocs = collectPromotableAllocs(func);
+    if (allocs.empty())
+        return removed;
+    unordered_map<IRValue *, int> alloc_index;
+    for (size_t i = 0; i < allocs.size(); ++i)
+        alloc_index[allocs[i]] = i;
+
+    DomTree &dom = am.getDomTree(func);
+    size_t n = func.blocks.size();
+
+    // 1. 在定值块的迭代支配边界处插入基本块参数
+    // block_allocs[b]记录块b新增的参数依次对应哪个alloc
+    vector<vector<int>> block_allocs(n);
+    vector<vector<int>> def_blocks(allocs.size());
+    for (auto bb : func.blocks)
+    {
+        for (auto inst : bb->insts)
+        {
+            if (inst->kind != IR_STORE)
+                continue;
+            auto it = alloc_index.find(inst->ops[1]);
+            if (it == alloc_index.end())
+                continue;
+            auto &defs = def_blocks[it->second];
+            if (defs.empty() || defs.back() != bb->id)
+                defs.push_back(bb->id);
+        }
+    }
+    vector<int> has_param(n, -1), in_work(n, -1);
+    for (size_t a = 0; a < allocs.size(); ++a)
+    {
+        vector<int> work = def_blocks[a];
+        for (int b : work)
+            in_work[b] = a;
+        while (!work.empty())
+        {
+            int b = work.back();
+            work.pop_back();
+            for (int d : dom.frontier[b])
+            {
+                if (has_param[d] == (int)a)
+                    continue;
+                has_param[d] = a;
+                block_allocs[d].push_back(a);
+                IRValue *param = func.newValue(IR_BLOCK_ARG);
+                param->hasResult = true;
+                param->parent = func.blocks[d];
+                func.blocks[d]->params.push_back(param);
+                if (in_work[d] != (int)a)
+                {
+                    in_work[d] = a;
+                    work.push_back(d);
+                }
+            }
+        }
+    }
+
+    // 2. 沿支配树重命名：load替换为当前值，store压入新值
+    unordered_map<IRValue *, IRValue *> repl;
+    auto resolve = [&](IRValue *v)
+    {
+        auto it = repl.find(v);
+        while (it != repl.end())
+        {
+            v = it->second;
+            it = repl.find(v);
+        }
+        return v;
+    };
+    vector<vector<IRValue *>> stacks(allocs.size());
+    auto current = [&](int a)
+    {
+        return stacks[a].empty() ? func.getInt(0) : stacks[a].back();
+    };
+
+    struct Frame
+    {
+        int block;
+        size_t child;
+        vector<int> pushed;
+    };
+    vector<Frame> dfs;
+    dfs.push_back({0, 0, {}});
+    bool entering = true;
+    while (!dfs.empty())
+    {
+        Frame &frame = dfs.back();
+        IRBlock *bb = func.blocks[frame.block];
+        if (entering)
+        {
+            size_t first_new = bb->params.size() - block_allocs[bb->id].size();
+            for (size_t i = 0; i < block_allocs[bb->id].size(); ++i)
+            {
+                int a = block_allocs[bb->id][i];
+                stacks[a].push_back(bb->params[first_new + i]);
+                frame.pushed.push_back(a);
+            }
+            for (auto inst : bb->insts)
+            {
+                if (inst->kind == IR_ALLOC && alloc_index.count(inst))
+                {
+                    inst->dead = true;
+                }
+                else if (inst->kind == IR_LOAD && alloc_index.count(inst->ops[0]))
+                {
+                    repl[inst] = current(alloc_index[inst->ops[0]]);
+                    inst->dead = true;
+                }
+                else if (inst->kind == IR_STORE && alloc_index.count(inst->ops[1]))
+                {
+                    int a = alloc_index[inst->ops[1]];
+                    stacks[a].push_back(resolve(inst->ops[0]));
+                    frame.pushed.push_back(a);
+                    inst->dead = true;
+                }
+            }
+            // 为后继块新增的参数传入当前值
+            IRValue *term = bb->terminator();
+            if (term)
+            {
+                for (size_t k = 0; k < term->targets.size(); ++k)
+                {
+                    IRBlock *target = term->targets[k];
+                    for (int a : block_allocs[target->id])
+                        term->args[k].push_back(current(a));
+                }
+            }
+            entering = false;
+        }
+        if (frame.child < dom.children[frame.block].size())
+        {
+            int child = dom.children[frame.block][frame.child++];
+            dfs.push_back({child, 0, {}});
+            entering = true;
+            continue;
+        }
+        for (int a : frame.pushed)
+            stacks[a].pop_back();
+        dfs.pop_back();
+    }
+
+    func.sweep();
+    func.replaceUses(repl);
+    PruneBlockParams(func);
+    return true;
+}
+
+bool PruneBlockParams(IRFunction &func)
+{
+    func.buildCFG();
+    bool changed = true, any = false;
+    while (changed)
+    {
+        changed = false;
+        auto incoming = collectIncomingEdges(func);
+
+        // 1. 平凡参数：除自身外所有来源都是同一个值，直接用该值替换
+        unordered_map<IRValue *, IRValue *> repl;
+        for (auto bb : func.blocks)
+        {
+            if (bb->params.empty() || incoming[bb->id].empty())
+                continue;
+            vector<bool> keep(bb->params.size(), true);
+            bool erased = false;
+            for (size_t i = 0; i < bb->params.size(); ++i)
+            {
+                IRValue *param = bb->params[i];
+                IRValue *same = nullptr;
+                bool trivial = true;
+                for (auto &edge : incoming[bb->id])
+                {
+                    IRValue *v = edge.first->args[edge.second][i];
+                    auto it = repl.find(v);
+                    while (it != repl.end())
+                    {
+                        v = it->second;
+                        it = repl.find(v);
+                    }
+                    if (v == param || v == same)
+                        continue;
+                    if (same)
+                    {
+                        trivial = false;
+                        break;
+                    }
+                    same = v;
+                }
+                if (!trivial || !same)
+                    continue;
+                repl[param] = same;
+                keep[i] = false;
+                erased = true;
+            }
+            if (erased)
+            {
+                eraseBlockParams(bb, keep, incoming[bb->id]);
+                changed = true;
+            }
+        }
+        func.replaceUses(repl);
+
+        // 2. 无用参数：只作为实参流向其他无用参数的参数
+        unordered_map<IRValue *, pair<IRBlock *, size_t>> param_pos;
+        for (auto bb : func.blocks)
+            for (size_t i = 0; i < bb->params.size(); ++i)
+                param_pos[bb->params[i]] = {bb, i};
+        unordered_set<IRValue *> live;
+        vector<IRValue *> work;
+        for (auto bb : func.blocks)
+        {
+            for (auto inst : bb->insts)
+            {
+                for (auto op : inst->ops)
+                {
+                    if (op->kind == IR_BLOCK_ARG && live.insert(op).second)
+                        work.push_back(op);
+                }
+            }
+        }
+        while (!work.empty())
+        {
+            IRValue *param = work.back();
+            work.pop_back();
+            auto pos = param_pos[param];
+            for (auto &edge : incoming[pos.first->id])
+            {
+                IRValue *arg = edge.first->args[edge.second][pos.second];
+                if (arg->kind == IR_BLOCK_ARG && live.insert(arg).second)
+                    work.push_back(arg);
+            }
+        }
+        for (auto bb : func.blocks)
+        {
+            vector<bool> keep(bb->params.size(), true);
+            bool erased = false;
+            for (size_t i = 0; i < bb->params.size(); ++i)
+            {
+                if (live.count(bb->params[i]))
+                    continue;
+                keep[i] = false;
+                erased = true;
+            }
+            if (erased)
+            {
+                eraseBlockParams(bb, keep, incoming[bb->id]);
+                changed = true;
+            }
+        }
+        any |= changed;
+    }
+    return any;
+}
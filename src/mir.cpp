@@ -0,0 +1,521 @@
+#include "mir.hpp"
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+MOperand mreg(const string &reg)
+{
+    return {MO_REG, reg, 0};
+}
+
+MOperand mimm(int32_t imm)
+{
+    return {MO_IMM, "", imm};
+}
+
+MOperand mmem(const string &base, int32_t offset)
+{
+    return {MO_MEM, base, offset};
+}
+
+MOperand mlabel(const string &label)
+{
+    return {MO_LABEL, label, 0};
+}
+
+size_t countMachineInsts(const MachineFunction &func)
+{
+    size_t n = 0;
+    for (auto &bb : func.blocks)
+        n += bb.insts.size();
+    return n;
+}
+
+static void dumpOperand(stringstream &ss, const MOperand &op)
+{
+    switch (op.kind)
+    {
+    case MO_REG:
+    case MO_LABEL:
+        ss << op.name;
+        break;
+    case MO_IMM:
+        ss << op.imm;
+        break;
+    case MO_MEM:
+        ss << op.imm << "(" << op.name << ")";
+        break;
+    }
+}
+
+string dumpMachineFunction(const MachineFunction &func)
+{
+    stringstream ss;
+    ss << func.name << ":\n";
+    for (auto &bb : func.blocks)
+    {
+        if (!bb.label.empty())
+            ss << bb.label << ":\n";
+        for (auto &inst : bb.insts)
+        {
+            ss << inst.opcode;
+            for (size_t i = 0; i < inst.ops.size(); ++i)
+            {
+                ss << (i ? ", " : " ");
+                dumpOperand(ss, inst.ops[i]);
+            }
+            ss << "\n";
+        }
+    }
+    return ss.str();
+}
+
+string dumpMachineHeader(const vector<string> &names)
+{
+    stringstream ss;
+    ss << "  .text \n";
+    ss << "  .globl";
+    for (auto &name : names)
+        ss << " " << name;
+    ss << "\n";
+    return ss.str();
+}
+
+string dumpMachineProgram(const MachineProgram &prog)
+{
+    vector<string> names;
+    for (auto &func : prog.funcs)
+        names.push_back(func->name);
+    string s = dumpMachineHeader(names);
+    for (auto &func : prog.funcs)
+        s += dumpMachineFunction(*func);
+    return s;
+}
+
+// 以sp为基址的lw/sw（大偏移经由t2访问的不处理）
+static bool isStackAccess(const MachineInst &inst)
+{
+    return (inst.opcode == "lw" || inst.opcode == "sw") && inst.ops[1].kind == MO_MEM && inst.ops[1].name == "sp";
+}
+
+bool MachinePeephole(MachineFunction &func)
+{
+    bool changed = false;
+    for (auto &bb : func.blocks)
+    {
+        vector<MachineInst> out;
+        for (auto &inst : bb.insts)
+        {
+            if (inst.opcode == "mv" && inst.ops[0] == inst.ops[1])
+            {
+                changed = true;
+                continue;
+            }
+            if (!out.empty() && isStackAccess(out.back()) && isStackAccess(inst) && out.back().ops[1] == inst.ops[1])
+            {
+                MachineInst &prev = out.back();
+                // sw a, M; lw b, M：值还在a中
+                if (prev.opcode == "sw" && inst.opcode == "lw")
+                {
+                    changed = true;
+                    if (prev.ops[0] == inst.ops[0])
+                        continue;
+                    MachineInst mv = {"mv", {inst.ops[0], prev.ops[0]}};
+                    out.push_back(mv);
+                    continue;
+                }
+                // lw a, M; sw a, M：写回的就是内存中的值
+                if (prev.opcode == "lw" && inst.opcode == "sw" && prev.ops[0] == inst.ops[0])
+                {
+                    changed = true;
+                    continue;
+                }
+            }
+            out.push_back(inst);
+        }
+        bb.insts = move(out);
+    }
+    return changed;
+}
+
+// 块的最后一条指令是否为无条件的控制转移（执行不会落入下一块）
+static bool endsWithJump(const MachineBlock &bb)
+{
+    return !bb.insts.empty() && (bb.insts.back().opcode == "j" || bb.insts.back().opcode == "ret");
+}
+
+static bool branchOptStep(MachineFunction &func)
+{
+    bool changed = false;
+
+    // 1. 跳向只含一条j的块时直接跳到最终目标
+    unordered_map<string, string> forward;
+    for (auto &bb : func.blocks)
+    {
+        if (!bb.label.empty() && bb.insts.size() == 1 && bb.insts[0].opcode == "j")
+            forward[bb.label] = bb.insts[0].ops[0].name;
+    }
+    for (auto &bb : func.blocks)
+    {
+        for (auto &inst : bb.insts)
+        {
+            for (auto &op : inst.ops)
+            {
+                if (op.kind != MO_LABEL)
+                    continue;
+                // 只含j的块构成的环无法跳过，停在环上
+                string target = op.name;
+                unordered_set<string> visited;
+                while (forward.count(target) && visited.insert(target).second)
+                    target = forward[target];
+                if (target == op.name)
+                    continue;
+                op.name = target;
+                changed = true;
+            }
+        }
+    }
+
+    // 2. 删除没有被引用、也不会从上一块顺序执行进入的块
+    unordered_set<string> used;
+    for (auto &bb : func.blocks)
+        for (auto &inst : bb.insts)
+            for (auto &op : inst.ops)
+                if (op.kind == MO_LABEL)
+                    used.insert(op.name);
+    vector<MachineBlock> kept;
+    for (auto &bb : func.blocks)
+    {
+        if (!kept.empty() && !bb.label.empty() && !used.count(bb.label) && endsWithJump(kept.back()))
+        {
+            changed = true;
+            continue;
+        }
+        kept.push_back(move(bb));
+    }
+    func.blocks = move(kept);
+
+    // 3. 删除跳向紧随其后的块的j
+    for (size_t i = 0; i + 1 < func.blocks.size(); ++i)
+    {
+        auto &insts = func.blocks[i].insts;
+        if (!insts.empty() && insts.back().opcode == "j" && insts.back().ops[0].name == func.blocks[i + 1].label)
+        {
+            insts.pop_back();
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool MachineBranchOpt(MachineFunction &func)
+{
+    bool changed = false;
+    while (branchOptStep(func))
+        changed = true;
+    return changed;
+}
+
+// 机器IR的块中间可能有条件跳转，块间的边用（跳转指令, 目标块）表示，顺序执行进入下一块的边没有跳转指令
+class MachineCFG
+{
+public:
+    vector<int> target;        // 按块内指令下标：跳转到的块，不是跳转时为-1
+    vector<vector<int>> preds; // 所有跳入该块的块（可能重复）
+    vector<vector<int>> targets;
+
+    MachineCFG(const MachineFunction &func)
+    {
+        unordered_map<string, int> index;
+        for (size_t i = 0; i < func.blocks.size(); ++i)
+            if (!func.blocks[i].label.empty())
+                index[func.blocks[i].label] = i;
+        preds.resize(func.blocks.size());
+        targets.resize(func.blocks.size());
+        for (size_t i = 0; i < func.blocks.size(); ++i)
+        {
+            auto &bb = func.blocks[i];
+            for (auto &inst : bb.insts)
+            {
+                int t = -1;
+                if (inst.opcode != "call")
+                {
+                    for (auto &op : inst.ops)
+                        if (op.kind == MO_LABEL && index.count(op.name))
+                            t = index[op.name];
+                }
+                targets[i].push_back(t);
+                if (t >= 0)
+                    preds[t].push_back(i);
+            }
+            if (fallsThrough(func, i))
+                preds[i + 1].push_back(i);
+        }
+    }
+
+    static bool fallsThrough(const MachineFunction &func, size_t i)
+    {
+        return !endsWithJump(func.blocks[i]) && i + 1 < func.blocks.size();
+    }
+};
+
+// 指令是否把结果写入第一个操作数
+static bool writesFirstReg(const MachineInst &inst)
+{
+    static const unordered_set<string> no_def = {"sw", "bnez", "beqz", "j", "call", "ret"};
+    return !inst.ops.empty() && inst.ops[0].kind == MO_REG && !no_def.count(inst.opcode);
+}
+
+namespace
+{
+    // 栈位置（相对sp的偏移）-> 保存着该位置的值的寄存器
+    typedef unordered_map<int32_t, string> SlotRegs;
+
+    class MemOpt
+    {
+    public:
+        MemOpt(MachineFunction &func) : func(func), cfg(func)
+        {
+            // sp之外的访存地址未知（大栈帧经由t2访问）
+            for (auto &bb : func.blocks)
+                for (auto &inst : bb.insts)
+                    if ((inst.opcode == "lw" || inst.opcode == "sw") && !isStackAccess(inst))
+                        unknown_access = true;
+        }
+
+        bool run()
+        {
+            bool changed = forwardLoads();
+            if (unknown_access)
+                return changed;
+            cfg = MachineCFG(func); // 删除了指令，重新建立下标
+            return eliminateDeadStores() || changed;
+        }
+
+    private:
+        MachineFunction &func;
+        MachineCFG cfg;
+        bool unknown_access = false;
+
+        // 按指令更新state；rewrite为true时把值已在寄存器中的lw改为mv，或在寄存器相同时删除（erase）
+        bool transfer(MachineInst &inst, SlotRegs &state, bool rewrite, bool &erase)
+        {
+            erase = false;
+            if (inst.opcode == "call")
+            {
+                // 调用者保存的寄存器都可能被改写
+                state.clear();
+                return false;
+            }
+            if (inst.opcode == "sw")
+            {
+                if (!isStackAccess(inst))
+                    state.clear();
+                else
+                    state[inst.ops[1].imm] = inst.ops[0].name;
+                return false;
+            }
+            if (!writesFirstReg(inst))
+                return false;
+            string def = inst.ops[0].name;
+            if (def == "sp")
+            {
+                state.clear();
+                return false;
+            }
+            bool changed = false;
+            bool known = false;
+            if (isStackAccess(inst) && inst.opcode == "lw")
+            {
+                auto it = state.find(inst.ops[1].imm);
+                known = it != state.end();
+                if (known && it->second == def)
+                {
+                    erase = rewrite;
+                    return rewrite;
+                }
+                if (known && rewrite)
+                {
+                    inst = {"mv", {inst.ops[0], mreg(it->second)}};
+                    changed = true;
+                }
+            }
+            for (auto it = state.begin(); it != state.end();)
+            {
+                if (it->second == def)
+                    it = state.erase(it);
+                else
+                    ++it;
+            }
+            // 值已在其他寄存器中时保留原来的对应
+            if (!known && isStackAccess(inst) && inst.opcode == "lw")
+                state[inst.ops[1].imm] = def;
+            return changed;
+        }
+
+        // 前向数据流：块入口的状态为所有跳入该块的边上状态的交集
+        bool forwardLoads()
+        {
+            size_t n = func.blocks.size();
+            // 每个块出发的边：(目标块, 跳转时的状态)
+            vector<vector<pair<int, SlotRegs>>> exits(n);
+            vector<bool> visited(n, false);
+            auto getIn = [&](size_t b)
+            {
+                SlotRegs in;
+                if (b == 0)
+                    return in;
+                bool first = true;
+                for (auto p : cfg.preds[b])
+                {
+                    if (!visited[p])
+                        continue;
+                    for (auto &edge : exits[p])
+                    {
+                        if (edge.first != (int)b)
+                            continue;
+                        if (first)
+                        {
+                            in = edge.second;
+                            first = false;
+                            continue;
+                        }
+                        for (auto it = in.begin(); it != in.end();)
+                        {
+                            auto other = edge.second.find(it->first);
+                            if (other == edge.second.end() || other->second != it->second)
+                                it = in.erase(it);
+                            else
+                                ++it;
+                        }
+                    }
+                }
+                return in;
+            };
+            // 模拟块的执行，rewrite为true时同时改写指令
+            auto simulate = [&](size_t b, bool rewrite)
+            {
+                SlotRegs state = getIn(b);
+                vector<pair<int, SlotRegs>> edges;
+                vector<MachineInst> kept;
+                bool changed = false;
+                auto &insts = func.blocks[b].insts;
+                for (size_t i = 0; i < insts.size(); ++i)
+                {
+                    MachineInst inst = insts[i];
+                    bool erase;
+                    changed |= transfer(inst, state, rewrite, erase);
+                    if (cfg.targets[b][i] >= 0)
+                        edges.emplace_back(cfg.targets[b][i], state);
+                    if (!erase)
+                        kept.push_back(move(inst));
+                }
+                if (MachineCFG::fallsThrough(func, b))
+                    edges.emplace_back(b + 1, state);
+                if (rewrite)
+                    insts = move(kept);
+                else if (!visited[b] || edges != exits[b])
+                {
+                    visited[b] = true;
+                    exits[b] = move(edges);
+                    changed = true;
+                }
+                return changed;
+            };
+            bool unstable = true;
+            while (unstable)
+            {
+                unstable = false;
+                for (size_t b = 0; b < n; ++b)
+                    unstable |= simulate(b, false);
+            }
+            // 改写时不更新exits，各块的入口状态仍是不动点的结果
+            bool changed = false;
+            for (size_t b = 0; b < n; ++b)
+                changed |= simulate(b, true);
+            return changed;
+        }
+
+        // 后向数据流：栈位置的活跃性，sw写入的位置在之后不活跃时为死存储
+        void transferLive(const MachineInst &inst, unordered_set<int32_t> &live)
+        {
+            if (inst.opcode == "ret" || (writesFirstReg(inst) && inst.ops[0].name == "sp"))
+                live.clear(); // 栈帧在此释放或尚未建立
+            else if (inst.opcode == "call")
+            {
+                for (int32_t off = 0; off < func.outArgSize; off += 4)
+                    live.insert(off);
+            }
+            else if (isStackAccess(inst) && inst.opcode == "sw")
+                live.erase(inst.ops[1].imm);
+            else if (isStackAccess(inst) && inst.opcode == "lw")
+                live.insert(inst.ops[1].imm);
+        }
+
+        bool eliminateDeadStores()
+        {
+            size_t n = func.blocks.size();
+            vector<unordered_set<int32_t>> live_in(n);
+            // 从块尾向前求活跃性，跳转处并入目标块入口的活跃位置；remove非空时记录死存储
+            auto simulate = [&](size_t b, vector<bool> *remove)
+            {
+                unordered_set<int32_t> live;
+                if (MachineCFG::fallsThrough(func, b))
+                    live = live_in[b + 1];
+                auto &insts = func.blocks[b].insts;
+                for (size_t i = insts.size(); i-- > 0;)
+                {
+                    int t = cfg.targets[b][i];
+                    if (t >= 0)
+                        live.insert(live_in[t].begin(), live_in[t].end());
+                    if (remove && isStackAccess(insts[i]) && insts[i].opcode == "sw" && !live.count(insts[i].ops[1].imm))
+                    {
+                        (*remove)[i] = true;
+                        continue;
+                    }
+                    transferLive(insts[i], live);
+                }
+                return live;
+            };
+            bool unstable = true;
+            while (unstable)
+            {
+                unstable = false;
+                for (size_t b = n; b-- > 0;)
+                {
+                    unordered_set<int32_t> live = simulate(b, nullptr);
+                    if (live != live_in[b])
+                    {
+                        live_in[b] = move(live);
+                        unstable = true;
+                    }
+                }
+            }
+            bool changed = false;
+            for (size_t b = 0; b < n; ++b)
+            {
+                auto &insts = func.blocks[b].insts;
+                vector<bool> dead(insts.size(), false);
+                simulate(b, &dead);
+                vector<MachineInst> kept;
+                for (size_t i = 0; i < insts.size(); ++i)
+                {
+                    if (dead[i])
+                        changed = true;
+                    else
+                        kept.push_back(move(insts[i]));
+                }
+                insts = move(kept);
+            }
+            return changed;
+        }
+    };
+}
+
+bool MachineMemOpt(MachineFunction &func)
+{
+    MemOpt pass(func);
+    return pass.run();
+}
@@ -0,0 +1,82 @@
+// 机器IR：RISC-V汇编的结构化表示
+// 后端先把raw program翻译为机器IR，经过机器IR上的pass后再输出为汇编文本
+#ifndef MIR_HPP
+#define MIR_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+enum MOperandKind
+{
+    MO_REG,
+    MO_IMM,
+    MO_MEM,   // offset(base)
+    MO_LABEL,
+};
+
+class MOperand
+{
+public:
+    MOperandKind kind;
+    string name;     // 寄存器名、访存的基址寄存器名或标签名
+    int32_t imm = 0; // 立即数或访存偏移
+
+    bool operator==(const MOperand &other) const
+    {
+        return kind == other.kind && name == other.name && imm == other.imm;
+    }
+};
+
+MOperand mreg(const string &reg);
+MOperand mimm(int32_t imm);
+MOperand mmem(const string &base, int32_t offset);
+MOperand mlabel(const string &label);
+
+class MachineInst
+{
+public:
+    string opcode;
+    vector<MOperand> ops;
+};
+
+class MachineBlock
+{
+public:
+    string label; // 为空表示没有标签（函数入口处的序言）
+    vector<MachineInst> insts;
+};
+
+class MachineFunction
+{
+public:
+    string name;
+    vector<MachineBlock> blocks;
+    int outArgSize = 0; // 栈底传给被调函数的参数区大小，call会读取这部分栈
+};
+
+class MachineProgram
+{
+public:
+    vector<unique_ptr<MachineFunction>> funcs;
+};
+
+size_t countMachineInsts(const MachineFunction &func);
+string dumpMachineFunction(const MachineFunction &func);
+string dumpMachineProgram(const MachineProgram &prog);
+// 程序开头的.text和.globl，之后依次接各函数的dumpMachineFunction
+string dumpMachineHeader(const vector<string> &names);
+
+// 机器IR上的pass，返回是否修改了函数
+
+// 窥孔优化：删除 mv r, r；紧跟在sw之后读取同一栈位置的lw改为寄存器复制；写回刚读出的值的sw直接删除
+bool MachinePeephole(MachineFunction &func);
+// 跳转优化：跳向只含一条j的块时直接跳到最终目标，删除跳向下一块的j和不会被执行到的块
+bool MachineBranchOpt(MachineFunction &func);
+// 栈访问优化：沿控制流记录各栈位置的值在哪个寄存器中，已知的lw改为mv或删除；写入后不会再被读取的sw删除
+bool MachineMemOpt(MachineFunction &func);
+
+#endif // MIR_HPP
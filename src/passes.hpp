@@ -0,0 +1,37 @@
+// IR优化pass声明
+#ifndef PASSES_HPP
+#define PASSES_HPP
+
+#include "ir.hpp"
+#include "passmgr.hpp"
+
+// 各pass返回是否修改了IR；需要支配树或循环信息的pass从AnalysisManager获取
+
+// 将只被load/store访问的alloc提升为SSA值，汇合点处以基本块参数代替phi
+bool Mem2Reg(IRFunction &func, AnalysisManager &am);
+// 删除无用的基本块参数（未被使用，或所有来源都相同）
+bool PruneBlockParams(IRFunction &func);
+// 自底向上的函数内联：单一调用点和很小的叶子函数总是内联，其余按代价模型与threshold比较，不内联递归调用
+bool Inline(IRProgram &prog, int threshold);
+// 流式编译时只内联到func：callees为已经处理过的被调函数，没有列出的不内联；不用单一调用点的规则，不删除函数
+bool InlineCalls(IRFunction &func, const unordered_map<string, IRFunction *> &callees, int threshold);
+// func作为被调函数时是否可能被InlineCalls内联，流式编译只需要保留这些函数
+bool MayInline(const IRFunction &func, int threshold);
+// 稀疏条件常量传播：沿变量和分支传播常量，常量条件的分支改为jump并删除不可达的块
+bool SCCP(IRFunction &func);
+// 指令合并：按改写规则表做代数化简、常量重结合和布尔值规范化，迭代到不动点
+bool InstCombine(IRFunction &func);
+// 全局值编号：合并支配路径上重复的纯运算（考虑交换律）和未被改写的重复load
+bool GVN(IRFunction &func, AnalysisManager &am);
+// 循环不变量外提：把循环内的不变运算和未被改写地址的load移到前置块
+bool LICM(IRFunction &func, AnalysisManager &am);
+// 归纳变量强度削弱：循环内的 p * f（p为归纳变量，f不变）改写为每次迭代累加的新归纳变量
+bool StrengthReduce(IRFunction &func, AnalysisManager &am);
+// 计数循环展开：budget为展开后循环体指令数的上限，超出预算的循环不展开
+bool LoopUnroll(IRFunction &func, AnalysisManager &am, int budget);
+// 死代码删除：删除结果未被使用的指令、无用的块参数和写入后从不读取的store
+bool DCE(IRFunction &func);
+// 控制流图化简：退化分支改为jump、跳过空块、合并只有唯一前驱的块，并删除不可达块
+bool SimplifyCFG(IRFunction &func);
+
+#endif // PASSES_HPP
@@ -0,0 +1,448 @@
+#include "passmgr.hpp"
+#include "passes.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+extern int unrollBudget;
+extern int inlineThreshold;
+
+namespace
+{
+    typedef chrono::steady_clock Clock;
+
+    double secondsSince(Clock::time_point start)
+    {
+        return chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    const vector<IRPass> &getIRPasses()
+    {
+        static const vector<IRPass> passes = {
+            {"mem2reg", {"domtree"}, true, [](IRFunction &func, AnalysisManager &am)
+             { return Mem2Reg(func, am); }},
+            {"inline", {}, false, nullptr, [](IRProgram &prog, AnalysisManager &)
+             { return Inline(prog, inlineThreshold); }},
+            {"sccp", {}, false, [](IRFunction &func, AnalysisManager &)
+             { return SCCP(func); }},
+            {"instcombine", {}, true, [](IRFunction &func, AnalysisManager &)
+             { return InstCombine(func); }},
+            {"gvn", {"domtree"}, true, [](IRFunction &func, AnalysisManager &am)
+             { return GVN(func, am); }},
+            {"licm", {"loops"}, false, [](IRFunction &func, AnalysisManager &am)
+             { return LICM(func, am); }},
+            {"strength-reduce", {"loops"}, false, [](IRFunction &func, AnalysisManager &am)
+             { return StrengthReduce(func, am); }},
+            {"loop-unroll", {"loops"}, false, [](IRFunction &func, AnalysisManager &am)
+             { return LoopUnroll(func, am, unrollBudget); }},
+            {"dce", {}, true, [](IRFunction &func, AnalysisManager &)
+             { return DCE(func); }},
+            {"simplifycfg", {}, false, [](IRFunction &func, AnalysisManager &)
+             { return SimplifyCFG(func); }},
+        };
+        return passes;
+    }
+
+    const vector<MachinePass> &getMachinePasses()
+    {
+        static const vector<MachinePass> passes = {
+            {"peephole", MachinePeephole},
+            {"branch-opt", MachineBranchOpt},
+            {"mem-opt", MachineMemOpt},
+        };
+        return passes;
+    }
+
+    const IRPass *findIRPass(const string &name)
+    {
+        for (auto &pass : getIRPasses())
+            if (pass.name == name)
+                return &pass;
+        return nullptr;
+    }
+
+    const MachinePass *findMachinePass(const string &name)
+    {
+        for (auto &pass : getMachinePasses())
+            if (pass.name == name)
+                return &pass;
+        return nullptr;
+    }
+
+    size_t countInsts(const IRFunction &func)
+    {
+        size_t n = 0;
+        for (auto bb : func.blocks)
+            n += bb->insts.size();
+        return n;
+    }
+
+    size_t countInsts(const IRProgram &prog)
+    {
+        size_t n = 0;
+        for (auto &func : prog.funcs)
+            n += countInsts(*func);
+        return n;
+    }
+
+    // 函数的下标按指令数从多到少排列，并行时先开始大的函数
+    vector<size_t> orderByCost(const IRProgram &prog)
+    {
+        vector<size_t> order(prog.funcs.size());
+        vector<size_t> cost(prog.funcs.size());
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            order[i] = i;
+            cost[i] = countInsts(*prog.funcs[i]);
+        }
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                    { return cost[a] > cost[b]; });
+        return order;
+    }
+}
+
+DomTree &AnalysisManager::getDomTree(IRFunction &func)
+{
+    Cache &entry = cache[&func];
+    if (entry.dom)
+    {
+        ++reused;
+        return *entry.dom;
+    }
+    auto start = Clock::now();
+    func.buildCFG();
+    entry.dom.reset(new DomTree());
+    entry.dom->build(func);
+    ++computed;
+    seconds += secondsSince(start);
+    return *entry.dom;
+}
+
+LoopInfo &AnalysisManager::getLoopInfo(IRFunction &func)
+{
+    Cache &entry = cache[&func];
+    if (entry.loops)
+    {
+        ++reused;
+        return *entry.loops;
+    }
+    DomTree &dom = getDomTree(func);
+    auto start = Clock::now();
+    entry.loops.reset(new LoopInfo());
+    entry.loops->build(func, dom);
+    ++computed;
+    seconds += secondsSince(start);
+    return *entry.loops;
+}
+
+void AnalysisManager::invalidate(IRFunction &func)
+{
+    cache.erase(&func);
+}
+
+void AnalysisManager::clear()
+{
+    cache.clear();
+}
+
+void AnalysisManager::addCounters(const AnalysisManager &other)
+{
+    computed += other.computed;
+    reused += other.reused;
+    seconds += other.seconds;
+}
+
+void PassManager::setOptLevel(int level)
+{
+    irPipeline.clear();
+    machinePipeline.clear();
+    if (level >= 2)
+    {
+        // 展开后的副本之间有大量可传播的常量和公共子表达式，再做一遍sccp、instcombine和gvn
+        // 内联放在sccp之前，常量实参可以传播进被内联的函数体
+        irPipeline = {"mem2reg", "inline", "sccp", "instcombine", "gvn", "licm", "strength-reduce",
+                      "loop-unroll", "sccp", "instcombine", "gvn", "dce", "simplifycfg"};
+        machinePipeline = {"peephole", "branch-opt", "mem-opt"};
+    }
+    else if (level == 1)
+    {
+        irPipeline = {"mem2reg", "sccp", "instcombine", "dce", "simplifycfg"};
+        machinePipeline = {"peephole", "mem-opt"};
+    }
+}
+
+void PassManager::reset()
+{
+    setOptLevel(2);
+    printAfter.clear();
+    timePasses = false;
+    stats.clear();
+    am.clear();
+    am.computed = am.reused = 0;
+    am.seconds = 0;
+}
+
+bool PassManager::setPipeline(const string &passes)
+{
+    irPipeline.clear();
+    stringstream ss(passes);
+    string name;
+    while (getline(ss, name, ','))
+    {
+        if (!findIRPass(name))
+            return false;
+        irPipeline.push_back(name);
+    }
+    return true;
+}
+
+bool PassManager::isKnownPass(const string &name)
+{
+    return name == "all" || findIRPass(name) || findMachinePass(name);
+}
+
+PassStat &PassManager::getStat(const string &name)
+{
+    for (auto &stat : stats)
+        if (stat.name == name)
+            return stat;
+    stats.emplace_back();
+    stats.back().name = name;
+    return stats.back();
+}
+
+bool PassManager::shouldPrint(const string &name) const
+{
+    for (auto &p : printAfter)
+        if (p == name || p == "all")
+            return true;
+    return false;
+}
+
+void PassManager::runOnFunction(IRFunction &func, const IRPass &pass, AnalysisManager &fam)
+{
+    // 先准备好声明依赖的分析，pass中请求时直接命中缓存
+    for (auto &analysis : pass.required)
+    {
+        if (analysis == "domtree")
+            fam.getDomTree(func);
+        else if (analysis == "loops")
+            fam.getLoopInfo(func);
+    }
+    long before = countInsts(func);
+    auto start = Clock::now();
+    bool changed = pass.run(func, fam);
+    double seconds = secondsSince(start);
+    if (changed && !pass.preservesCFG)
+        fam.invalidate(func);
+    recordFunctionPass(pass.name, func, before, seconds, changed);
+}
+
+void PassManager::recordFunctionPass(const string &name, IRFunction &func, long before, double seconds, bool changed)
+{
+    lock_guard<mutex> guard(lock);
+    PassStat &stat = getStat(name);
+    stat.seconds += seconds;
+    ++stat.runs;
+    stat.instDelta += (long)countInsts(func) - before;
+    if (changed)
+        ++stat.changed;
+    if (shouldPrint(name))
+        cerr << "; *** IR after " << name << " ***\n"
+             << dumpFunction(func) << "\n";
+}
+
+// 连续的函数级pass在一个函数上依次运行，分析结果只在这一段中复用
+void PassManager::runFunctionPasses(IRFunction &func, size_t begin, size_t end)
+{
+    AnalysisManager fam;
+    for (size_t k = begin; k < end; ++k)
+        runOnFunction(func, *findIRPass(irPipeline[k]), fam);
+    lock_guard<mutex> guard(lock);
+    am.addCounters(fam);
+}
+
+void PassManager::runOnModule(IRProgram &prog, const IRPass &pass)
+{
+    PassStat &stat = getStat(pass.name);
+    long before = countInsts(prog);
+    auto start = Clock::now();
+    bool changed = pass.runOnModule(prog, am);
+    stat.seconds += secondsSince(start);
+    ++stat.runs;
+    stat.instDelta += (long)countInsts(prog) - before;
+    if (changed)
+        ++stat.changed;
+    am.clear();
+    if (shouldPrint(pass.name))
+        cerr << "; *** IR after " << pass.name << " ***\n"
+             << dumpIR(prog) << "\n";
+}
+
+void PassManager::run(IRProgram &prog)
+{
+    runRange(prog, 0, irPipeline.size());
+}
+
+size_t PassManager::suffixBegin() const
+{
+    size_t i = irPipeline.size();
+    while (i > 0 && !findIRPass(irPipeline[i - 1])->runOnModule)
+        --i;
+    return i;
+}
+
+void PassManager::runModulePrefix(IRProgram &prog)
+{
+    runRange(prog, 0, suffixBegin());
+}
+
+void PassManager::runFunctionSuffix(IRFunction &func)
+{
+    runFunctionPasses(func, suffixBegin(), irPipeline.size());
+}
+
+size_t PassManager::prefixEnd() const
+{
+    size_t i = 0;
+    while (i < irPipeline.size() && !findIRPass(irPipeline[i])->runOnModule)
+        ++i;
+    return i;
+}
+
+bool PassManager::hasModulePass() const
+{
+    return prefixEnd() < irPipeline.size();
+}
+
+void PassManager::runFunctionPrefix(IRFunction &func)
+{
+    runFunctionPasses(func, 0, prefixEnd());
+}
+
+void PassManager::runModuleSuffix(IRProgram &prog)
+{
+    runRange(prog, prefixEnd(), irPipeline.size());
+}
+
+bool PassManager::canStream() const
+{
+    size_t i = prefixEnd();
+    if (i == irPipeline.size())
+        return true;
+    if (irPipeline[i] != "inline")
+        return false;
+    for (++i; i < irPipeline.size(); ++i)
+        if (findIRPass(irPipeline[i])->runOnModule)
+            return false;
+    return true;
+}
+
+void PassManager::runInline(IRFunction &func, const unordered_map<string, IRFunction *> &callees)
+{
+    long before = countInsts(func);
+    auto start = Clock::now();
+    bool changed = InlineCalls(func, callees, inlineThreshold);
+    recordFunctionPass("inline", func, before, secondsSince(start), changed);
+}
+
+void PassManager::runFunctionAfterInline(IRFunction &func)
+{
+    runFunctionPasses(func, min(prefixEnd() + 1, irPipeline.size()), irPipeline.size());
+}
+
+void PassManager::runRange(IRProgram &prog, size_t begin, size_t end)
+{
+    // 相邻的函数级pass逐个函数连续运行，遇到模块级pass时整个程序运行一次
+    size_t i = begin;
+    while (i < end)
+    {
+        const IRPass *pass = findIRPass(irPipeline[i]);
+        if (pass->runOnModule)
+        {
+            runOnModule(prog, *pass);
+            ++i;
+            continue;
+        }
+        size_t j = i;
+        while (j < end && !findIRPass(irPipeline[j])->runOnModule)
+            ++j;
+        // 各函数互不影响，可以并行；输出IR时顺序运行，保持输出的顺序
+        auto body = [&](size_t f)
+        {
+            runFunctionPasses(*prog.funcs[f], i, j);
+        };
+        vector<size_t> order = orderByCost(prog);
+        if (pool && printAfter.empty())
+            pool->parallelFor(order, body);
+        else
+        {
+            for (size_t f = 0; f < prog.funcs.size(); ++f)
+                body(f);
+        }
+        i = j;
+    }
+}
+
+void PassManager::run(MachineProgram &prog)
+{
+    for (auto &func : prog.funcs)
+        run(*func);
+}
+
+void PassManager::run(MachineFunction &func)
+{
+    for (auto &name : machinePipeline)
+    {
+        const MachinePass *pass = findMachinePass(name);
+        long before = countMachineInsts(func);
+        auto start = Clock::now();
+        bool changed = pass->run(func);
+        double seconds = secondsSince(start);
+        lock_guard<mutex> guard(lock);
+        PassStat &stat = getStat(name);
+        stat.seconds += seconds;
+        ++stat.runs;
+        stat.instDelta += (long)countMachineInsts(func) - before;
+        if (changed)
+            ++stat.changed;
+        if (shouldPrint(name))
+            cerr << "# *** MIR after " << name << " ***\n"
+                 << dumpMachineFunction(func) << "\n";
+    }
+}
+
+void PassManager::printStats(ostream &os) const
+{
+    char line[128];
+    os << "===== Pass statistics =====\n";
+    snprintf(line, sizeof(line), "%-18s %6s %8s %10s %10s\n", "pass", "runs", "changed", "insts", "time(ms)");
+    os << line;
+    double total = am.seconds;
+    // 按流水线中的顺序输出（并行运行时第一次运行的顺序不确定）
+    vector<string> names = irPipeline;
+    names.insert(names.end(), machinePipeline.begin(), machinePipeline.end());
+    auto rank = [&](const PassStat &stat)
+    {
+        return find(names.begin(), names.end(), stat.name) - names.begin();
+    };
+    vector<PassStat> sorted = stats;
+    stable_sort(sorted.begin(), sorted.end(), [&](const PassStat &a, const PassStat &b)
+                { return rank(a) < rank(b); });
+    for (auto &stat : sorted)
+    {
+        snprintf(line, sizeof(line), "%-18s %6d %8d %+10ld %10.3f\n",
+                 stat.name.c_str(), stat.runs, stat.changed, stat.instDelta, stat.seconds * 1000);
+        os << line;
+        total += stat.seconds;
+    }
+    snprintf(line, sizeof(line), "%-18s %6d %8s %10s %10.3f\n", "(analyses)", am.computed, "", "", am.seconds * 1000);
+    os << line;
+    os << "analyses computed " << am.computed << ", reused from cache " << am.reused << "\n";
+    snprintf(line, sizeof(line), "total %.3f ms\n", total * 1000);
+    os << line;
+}
@@ -0,0 +1,120 @@
+// pass管理器：按名字组织IR与机器IR上的pass，缓存函数级分析结果，并统计每个pass的效果
+#ifndef PASSMGR_HPP
+#define PASSMGR_HPP
+
+#include "ir.hpp"
+#include "mir.hpp"
+#include "threadpool.hpp"
+#include <functional>
+#include <mutex>
+#include <ostream>
+
+using namespace std;
+
+// 函数级分析结果的缓存：结果未失效时重复请求直接复用
+// 改变了控制流图的pass运行后必须调用invalidate
+class AnalysisManager
+{
+public:
+    DomTree &getDomTree(IRFunction &func);
+    LoopInfo &getLoopInfo(IRFunction &func); // 依赖支配树
+    void invalidate(IRFunction &func);
+    void clear(); // 模块级pass可能删除或改写任意函数，丢弃全部缓存
+    void addCounters(const AnalysisManager &other); // 合并其他线程中的统计
+
+    int computed = 0;    // 实际计算的次数
+    int reused = 0;      // 命中缓存的次数
+    double seconds = 0;  // 计算分析所用的时间
+
+private:
+    class Cache
+    {
+    public:
+        unique_ptr<DomTree> dom;
+        unique_ptr<LoopInfo> loops;
+    };
+    unordered_map<IRFunction *, Cache> cache;
+};
+
+// IR上的pass
+class IRPass
+{
+public:
+    string name;
+    vector<string> required; // 运行前需要的分析（domtree、loops）
+    bool preservesCFG;       // 不改变控制流图，运行后分析结果仍然有效
+    function<bool(IRFunction &, AnalysisManager &)> run;
+    function<bool(IRProgram &, AnalysisManager &)> runOnModule; // 模块级pass（如内联）设置此项而不设置run
+};
+
+// 机器IR上的pass
+class MachinePass
+{
+public:
+    string name;
+    function<bool(MachineFunction &)> run;
+};
+
+// 每个pass的统计信息（-time-passes）
+class PassStat
+{
+public:
+    string name;
+    int runs = 0;
+    int changed = 0;     // 报告修改了IR的次数
+    long instDelta = 0;  // 指令数的变化
+    double seconds = 0;  // 各线程中运行时间之和
+};
+
+class PassManager
+{
+public:
+    vector<string> irPipeline;
+    vector<string> machinePipeline;
+    vector<string> printAfter; // 这些pass运行后把函数输出到stderr，"all"表示所有pass
+    bool timePasses = false;
+    ThreadPool *pool = nullptr; // 不同函数上的函数级pass并行运行（-jobs=N），为空时顺序运行
+
+    // 预定义的流水线：-O0不做优化，-O1只做基本的标量优化，-O2包括循环优化和展开
+    void setOptLevel(int level);
+    // 以逗号分隔的pass名设置IR流水线，有未知的pass时返回false
+    bool setPipeline(const string &passes);
+    static bool isKnownPass(const string &name);
+    // 恢复默认选项（-O2）并清空统计，批量/服务模式下每个作业开始时调用
+    void reset();
+
+    void run(IRProgram &prog);
+    void run(MachineProgram &prog);
+    void run(MachineFunction &func); // 可以在多个线程中对不同的函数同时调用
+    // 流水线分为两段：最后一个模块级pass及其之前的部分对整个程序运行，
+    // 之后只剩函数级pass，每个函数的结果只取决于函数本身（增量编译以此为单位）
+    void runModulePrefix(IRProgram &prog);
+    void runFunctionSuffix(IRFunction &func);
+    // 另一种分法：第一个模块级pass之前只有函数级pass，可以在整个程序生成完之前逐个函数运行（流水线模式）
+    bool hasModulePass() const;
+    void runFunctionPrefix(IRFunction &func); // 可以在多个线程中对不同的函数同时调用
+    void runModuleSuffix(IRProgram &prog);
+    // 流式输出：唯一的模块级pass是inline时（如-O2），在该处逐个函数内联已经完成的被调函数（InlineCalls），
+    // 其余的pass照常逐个函数运行；三者都可以在多个线程中对不同的函数同时调用
+    bool canStream() const; // 没有模块级pass，或者只有一个inline
+    void runInline(IRFunction &func, const unordered_map<string, IRFunction *> &callees);
+    void runFunctionAfterInline(IRFunction &func);
+    void printStats(ostream &os) const;
+
+private:
+    AnalysisManager am;     // 模块级pass使用，并汇总函数级pass的分析统计
+    vector<PassStat> stats;
+    mutex lock;             // 并行运行时保护am的统计、stats和stderr的输出
+
+    PassStat &getStat(const string &name);
+    size_t suffixBegin() const;
+    size_t prefixEnd() const;
+    void runRange(IRProgram &prog, size_t begin, size_t end);
+    void runOnFunction(IRFunction &func, const IRPass &pass, AnalysisManager &fam);
+    void recordFunctionPass(const string &name, IRFunction &func, long before, double seconds, bool changed);
+    void runFunctionPasses(IRFunction &func, size_t begin, size_t end);
+    void runOnModule(IRProgram &prog, const IRPass &pass);
+    bool shouldPrint(const string &name) const;
+};
+
+#endif // PASSMGR_HPP
@@ -1,8 +1,8 @@
 #include "koopavisitor.hpp"
 #include "koopa.h"
 #include <cassert>
+#include <cstdint>
 #include <iostream>
-#include <fstream>
 #include <sstream>
 #include <stack>
 #include <set>
@@ -10,17 +10,35 @@
 
 using namespace std;
 
-fstream fout;
+// 代码生成的状态都是线程局部的，不同的函数可以在不同线程中同时翻译
+thread_local MachineFunction *cur_mfunc; // 正在生成的函数，指令追加到其最后一个块
 
-int stack_size; // 维护每个函数的栈空间长度（16字节对齐）
+thread_local int stack_size;   // 维护每个函数的栈空间长度（16字节对齐）
+thread_local int scratch_base; // 基本块实参中转区在栈上的起始偏移
+thread_local int out_arg_size; // 栈底传递第9个及以后实参的区域大小
+thread_local bool has_call;    // 函数中是否有call（需要保存ra）
+thread_local string cur_func_name; // 当前函数名（不含@），用于生成函数内唯一的标签
+thread_local int edge_label_cnt = 0; // 分支边标签计数器
 
-string reg_prev_prev = ""; // 上上个用到的寄存器
-string reg_prev = "";      // 上一个用到的寄存器
+// 向当前块末尾追加一条机器指令
+void emit(const string &opcode, const vector<MOperand> &ops)
+{
+    cur_mfunc->blocks.back().insts.push_back({opcode, ops});
+}
+
+// 开始一个新的带标签的块
+void beginBlock(const string &label)
+{
+    cur_mfunc->blocks.push_back({label, {}});
+}
+
+thread_local string reg_prev_prev = ""; // 上上个用到的寄存器
+thread_local string reg_prev = "";      // 上一个用到的寄存器
 
 // 只需要记录寄存器是否使用，无需存储具体值
-bool reg_t_used[7];
+thread_local bool reg_t_used[7];
 // 只需要记录寄存器是否使用，无需存储具体值
-bool reg_a_used[8];
+thread_local bool reg_a_used[8];
 
 string alloc_reg()
 {
@@ -45,128 +63,159 @@ string alloc_reg()
         return reg_prev;
     }
     cerr << "Reg Error: NO FREE REG_A!\n";
-    fout.close();
     assert(false);
 }
 
-// 将直接数注册到寄存器中
+// 将直接数（编译期算出的结果）写入t0，与其他指令的结果一样随后存入栈
 inline void save_reg(int32_t imm)
 {
-    if (imm == 0)
+    reg_prev_prev = reg_prev;
+    reg_prev = "t0";
+    emit("li", {mreg("t0"), mimm(imm)});
+}
+
+// 访问栈上偏移为offset的位置，超出12位立即数范围时借助t2计算地址
+void emitStackAccess(const string &inst, const string &reg, int offset)
+{
+    if (offset < 2048)
     {
-        reg_prev_prev = reg_prev;
-        reg_prev = "x0";
+        emit(inst, {mreg(reg), mmem("sp", offset)});
+        return;
+    }
+    emit("li", {mreg("t2"), mimm(offset)});
+    emit("add", {mreg("t2"), mreg("sp"), mreg("t2")});
+    emit(inst, {mreg(reg), mmem("t2", 0)});
+}
+
+// 将value的值读入寄存器：直接数用li，第9个及以后的形参在调用者的栈帧中，其余从其栈位置读取
+void loadValue(const string &reg, const koopa_raw_value_t &value)
+{
+    if (value->kind.tag == KOOPA_RVT_INTEGER)
+        emit("li", {mreg(reg), mimm(value->kind.data.integer.value)});
+    else if (value->kind.tag == KOOPA_RVT_FUNC_ARG_REF && value->kind.data.func_arg_ref.index >= 8)
+        emitStackAccess("lw", reg, stack_size + 4 * (value->kind.data.func_arg_ref.index - 8));
+    else
+        emitStackAccess("lw", reg, getStackPos(value));
+}
+
+// 将寄存器写回value的栈位置
+void storeValue(const string &reg, const koopa_raw_value_t &value)
+{
+    emitStackAccess("sw", reg, getStackPos(value));
+}
+
+// 移动栈指针（Prologue/Epilogue），超出立即数范围时借助t0
+void adjustSp(int delta)
+{
+    if (delta >= -2048 && delta < 2048)
+    {
+        emit("addi", {mreg("sp"), mreg("sp"), mimm(delta)});
         return;
     }
-    fout << "li " << alloc_reg() << ", " << imm << "\n";
+    emit("li", {mreg("t0"), mimm(delta)});
+    emit("add", {mreg("sp"), mreg("sp"), mreg("t0")});
+}
+
+// 基本块在汇编中的标签（.L开头的局部标签，加上函数名避免不同函数的块重名）
+inline string getBlockLabel(const koopa_raw_basic_block_t &bb)
+{
+    return ".L" + cur_func_name + "_" + string(bb->name + 1);
 }
 
 // 配套try_save_reg使用
-string reg_l, reg_r;
+thread_local string reg_l, reg_r;
 
-int max_stack_pos = -4; // 分配的最大stack_pos
+thread_local int max_stack_pos = -4; // 分配的最大stack_pos
 // 判断左右操作数是否为直接数，将直接数存入寄存器再进行计算
 void try_save_reg(const koopa_raw_binary_t &bin_inst)
 {
-    if (bin_inst.lhs->kind.tag != KOOPA_RVT_INTEGER)
-    {
-        // fout << "lhs addr: " << bin_inst.lhs;
-        fout << "lw t0, " << getStackPos(bin_inst.lhs) << "(sp)\n";
-    }
-    else
-    {
-        // save_reg(bin_inst.lhs->kind.data.integer.value);
-        fout << "li t0, " << bin_inst.lhs->kind.data.integer.value << "\n";
-    }
-    reg_l = reg_prev;
-    if (bin_inst.rhs->kind.tag != KOOPA_RVT_INTEGER)
-    {
-        // fout << "rhs addr: " << bin_inst.rhs;
-        fout << "lw t1, " << getStackPos(bin_inst.rhs) << "(sp)\n";
-    }
-    else
-    {
-        fout << "li t1, " << bin_inst.rhs->kind.data.integer.value << "\n";
-    }
-    reg_r = reg_prev;
+    loadValue("t0", bin_inst.lhs);
+    reg_l = "t0";
+    loadValue("t1", bin_inst.rhs);
+    reg_r = "t1";
 }
 
-// 变量->栈位置的映射
-unordered_map<string, int> id_map;
+// 值->栈位置的映射（每个函数重新分配）
+// 以value指针为键：临时值和块参数可能没有名字，而具名值在不同函数中可能重名
+thread_local unordered_map<koopa_raw_value_t, int> id_map;
 
 inline int getStackPos(const koopa_raw_value_t &value)
 {
-    string value_name;
-    // %开头的变量没有value->name，使用value自身十六进制代号命名
-    if (value->name == nullptr)
-    {
-        stringstream ss;
-        ss << value;
-        // fout << "allocing" << ss.str();
-        value_name = ss.str();
-    } else value_name = value->name;
-    if (id_map.count(value_name))
-    {
-        // fout << "existing name: " << value_name << " " << id_map[value_name] << " ";
-        return id_map[value_name];
-    }
-    else
-    {
-        // fout << "adding name: " << value_name << " " << id_map[value_name] << " ";
-        max_stack_pos += 4;
-        id_map.insert(make_pair(value_name, max_stack_pos));
-        return max_stack_pos;
-    }
+    auto it = id_map.find(value);
+    if (it != id_map.end())
+        return it->second;
+    max_stack_pos += 4;
+    id_map.insert(make_pair(value, max_stack_pos));
+    return max_stack_pos;
 }
 
-void scanStackSize(string ir)
+// 计算函数的栈尺寸，16字节对齐。从栈底开始依次为：
+// 传给被调函数的第9个及以后的实参、每个有结果的指令/块参数/由寄存器传入的形参各4字节、
+// 块实参中转区、ra（有call时）
+void computeStackSize(const koopa_raw_function_t &func)
 {
-    stringstream ss(ir);
-    string word;
-    set<string> identifiers; // 存储所有变量（不重复）
-    // 按空格切分ir
-    while (ss >> word)
+    size_t slots = min<size_t>(func->params.len, 8), max_args = 0, max_call_args = 0;
+    has_call = false;
+    for (size_t i = 0; i < func->bbs.len; ++i)
     {
-        if (word[0] == '@' || word[0] == '%')
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        slots += bb->params.len;
+        for (size_t j = 0; j < bb->insts.len; ++j)
         {
-            // 去掉末尾的逗号
-            if (word.back() == ',')
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+            if (inst->ty->tag != KOOPA_RTT_UNIT)
+                ++slots;
+            if (inst->kind.tag == KOOPA_RVT_BRANCH)
             {
-                word = word.substr(0, word.size() - 1);
+                max_args = max<size_t>(max_args, inst->kind.data.branch.true_args.len);
+                max_args = max<size_t>(max_args, inst->kind.data.branch.false_args.len);
+            }
+            else if (inst->kind.tag == KOOPA_RVT_JUMP)
+                max_args = max<size_t>(max_args, inst->kind.data.jump.args.len);
+            else if (inst->kind.tag == KOOPA_RVT_CALL)
+            {
+                has_call = true;
+                max_call_args = max<size_t>(max_call_args, inst->kind.data.call.args.len);
             }
-            identifiers.insert(word);
         }
     }
-    cerr << "stack size: " << identifiers.size() << endl;
-    stack_size = (identifiers.size() << 2); // 每个元素为4字节
+    out_arg_size = max_call_args > 8 ? (max_call_args - 8) * 4 : 0;
+    scratch_base = out_arg_size + slots * 4;
+    stack_size = (scratch_base + max_args * 4 + (has_call ? 4 : 0) + 15) / 16 * 16;
+    cerr << "stack size: " << stack_size << endl;
 }
 
-void VisitProgram(const koopa_raw_program_t &program, const char *filePath)
+// 翻译整个程序，每个函数生成一个MachineFunction
+void VisitProgram(const koopa_raw_program_t &program, MachineProgram &mprog)
 {
-    fout.open(filePath, ios_base::out);
-    // 执行一些其他的必要操作
-    // ...
-
-    // 列出所有.text量
-    fout << "  .text ";
-    fout << endl;
     // 访问所有全局变量
     VisitSlice(program.values);
 
-    // 列出所有.globl量
-    fout << "  .globl";
+    // 访问所有函数
+    for (auto func : collectFunctions(program))
+    {
+        mprog.funcs.emplace_back(new MachineFunction());
+        VisitFunction(func, *mprog.funcs.back());
+    }
+}
+
+vector<koopa_raw_function_t> collectFunctions(const koopa_raw_program_t &program)
+{
+    vector<koopa_raw_function_t> funcs;
     for (size_t i = 0; i < program.funcs.len; ++i)
     {
-        koopa_raw_function_t func = (koopa_raw_function_t)program.funcs.buffer[i];
-        fout << " " << (func->name + 1);
+        auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+        if (func->bbs.len) // 只有声明的函数没有基本块，不生成代码
+            funcs.push_back(func);
     }
-    fout << endl;
-    // 访问所有函数
-    VisitSlice(program.funcs);
-    fout << endl;
+    return funcs;
+}
 
-    fout.clear();
-    fout.close();
+void VisitFunction(const koopa_raw_function_t &func, MachineFunction &mfunc)
+{
+    cur_mfunc = &mfunc;
+    VisitFunc(func);
+    cur_mfunc = nullptr;
 }
 
 void VisitSlice(const koopa_raw_slice_t &slice)
@@ -195,7 +244,6 @@ void VisitSlice(const koopa_raw_slice_t &slice)
         //     break;
         default:
             // 我们暂时不会遇到其他内容, 于是不对其做任何处理
-            fout.close();
             assert(false);
         }
     }
@@ -204,8 +252,21 @@ void VisitSlice(const koopa_raw_slice_t &slice)
 // 访问函数
 void VisitFunc(const koopa_raw_function_t &func)
 {
-    fout << func->name + 1 << ":\n";
-    fout << "addi sp, sp, -" << stack_size << endl; // Prologue-为函数分配栈空间
+    cur_func_name = func->name + 1;
+    edge_label_cnt = 0; // 标签带有函数名，每个函数从0编号，生成的代码只取决于函数本身
+    id_map.clear();
+    computeStackSize(func);
+    max_stack_pos = out_arg_size - 4;
+    cur_mfunc->name = func->name + 1;
+    cur_mfunc->outArgSize = out_arg_size;
+    beginBlock(""); // 序言没有标签
+    if (stack_size)
+        adjustSp(-stack_size); // Prologue-为函数分配栈空间
+    if (has_call)
+        emitStackAccess("sw", "ra", stack_size - 4);
+    // 由寄存器传入的形参写入各自的栈位置
+    for (size_t i = 0; i < func->params.len && i < 8; ++i)
+        storeValue("a" + to_string(i), reinterpret_cast<koopa_raw_value_t>(func->params.buffer[i]));
     // Visit(func->params);    // raw slice类型
     // 访问所有基本块（一个函数可能含有多个基本块）
     VisitSlice(func->bbs);
@@ -219,7 +280,8 @@ void VisitFunc(const koopa_raw_function_t &func)
 // 访问基本块
 void VisitBlock(const koopa_raw_basic_block_t &bb)
 {
-    // Visit(bb->params);
+    // 块参数不生成指令，其值由跳转方写入参数的栈位置
+    beginBlock(getBlockLabel(bb));
     VisitSlice(bb->insts);
 }
 
@@ -262,7 +324,6 @@ void VisitValue(const koopa_raw_value_t &value)
     //     break;
     /// Memory load.
     case KOOPA_RVT_LOAD:
-        fout << "lw t0, ";
         VisitLoad(kind.data.load);
         break;
     // /// Memory store.
@@ -281,64 +342,135 @@ void VisitValue(const koopa_raw_value_t &value)
     case KOOPA_RVT_BINARY:
         VisitBin(kind.data.binary);
         break;
-    // /// Conditional branch.
-    // case KOOPA_RVT_BRANCH:
-    //     Visit(kind.data.branch);
-    //     break;
-    // /// Unconditional jump.
-    // case KOOPA_RVT_JUMP:
-    //     Visit(kind.data.jump);
-    //     break;
-    // /// Function call.
-    // case KOOPA_RVT_CALL:
-    //     Visit(kind.data.call);
-    //     break;
+    /// Conditional branch.
+    case KOOPA_RVT_BRANCH:
+        VisitBranch(kind.data.branch);
+        break;
+    /// Unconditional jump.
+    case KOOPA_RVT_JUMP:
+        VisitJump(kind.data.jump);
+        break;
+    /// Function call.
+    case KOOPA_RVT_CALL:
+        VisitCall(kind.data.call);
+        // 返回值在a0中，移入t0后与其他指令的结果一样存入栈
+        if (value->ty->tag != KOOPA_RTT_UNIT)
+            emit("mv", {mreg("t0"), mreg("a0")});
+        break;
     /// Function return.
     case KOOPA_RVT_ALLOC:
         VisitAlloc(kind.data.global_alloc);
         break;
     case KOOPA_RVT_RETURN:
-        if(kind.data.ret.value->kind.tag==KOOPA_RVT_INTEGER) {
-            fout << "li a0, " << kind.data.ret.value->kind.data.integer.value << "\n";
-        } else {
-            fout << "lw a0, ";
-            fout << getStackPos(kind.data.ret.value) << "(sp)\n";
-        }
+        if (kind.data.ret.value)
+            loadValue("a0", kind.data.ret.value);
         VisitReturn(kind.data.ret);
         break;
     default:
         cerr << "Inst Error: INST KIND: " << kind.tag << endl;
-        fout.close();
         assert(false);
     }
     // 除了调用函数时的栈操作外，所有有返回值指令结果都要存入内存
     if (value->ty->tag != KOOPA_RTT_UNIT && kind.tag != KOOPA_RVT_ALLOC)
     {
-        // fout << "sw target: "<< value << " " << *(&value) << " ";
-        fout << "sw t0, " << getStackPos(value) << "(sp)\n";
+        storeValue("t0", value);
     }
 }
 
 void VisitInt(const koopa_raw_integer_t &_int)
 {
-    fout << _int.value << "\n";
+    // 整数常量不会单独作为指令出现，使用处直接li
 }
 
 void VisitLoad(const koopa_raw_load_t &load)
 {
-    fout << getStackPos(load.src) << "(sp)" << endl;
+    loadValue("t0", load.src);
 }
 
 void VisitStore(const koopa_raw_store_t &store)
 {
     // 操作数如果是直接数，要先加载到寄存器
-    if (store.value->kind.tag == KOOPA_RVT_INTEGER)
-        fout << "li t0, " << store.value->kind.data.integer.value << endl;
-    else
-        fout << "lw t0, " << getStackPos(store.value) << "(sp)\n";
-
+    loadValue("t0", store.value);
     // 再将寄存器存入内存地址
-    fout << "sw t0, " << getStackPos(store.dest) << "(sp)\n";
+    storeValue("t0", store.dest);
+}
+
+// 将跳转实参写入目标块参数的栈位置
+void VisitBlockArgs(const koopa_raw_basic_block_t &target, const koopa_raw_slice_t &args)
+{
+    // 实参可能正是目标块的另一个参数（如循环中交换两个变量），
+    // 此时逐个复制会先写后读，需要先把所有实参暂存到中转区
+    bool conflict = false;
+    for (size_t i = 0; i < args.len && !conflict; ++i)
+    {
+        auto arg = reinterpret_cast<koopa_raw_value_t>(args.buffer[i]);
+        if (arg->kind.tag != KOOPA_RVT_BLOCK_ARG_REF)
+            continue;
+        for (size_t j = 0; j < target->params.len; ++j)
+        {
+            if (j != i && target->params.buffer[j] == arg)
+                conflict = true;
+        }
+    }
+    for (size_t i = 0; i < args.len; ++i)
+    {
+        auto arg = reinterpret_cast<koopa_raw_value_t>(args.buffer[i]);
+        auto param = reinterpret_cast<koopa_raw_value_t>(target->params.buffer[i]);
+        if (arg == param)
+            continue;
+        loadValue("t0", arg);
+        if (conflict)
+            emitStackAccess("sw", "t0", scratch_base + 4 * i);
+        else
+            storeValue("t0", param);
+    }
+    if (!conflict)
+        return;
+    for (size_t i = 0; i < args.len; ++i)
+    {
+        auto arg = reinterpret_cast<koopa_raw_value_t>(args.buffer[i]);
+        auto param = reinterpret_cast<koopa_raw_value_t>(target->params.buffer[i]);
+        if (arg == param)
+            continue;
+        emitStackAccess("lw", "t0", scratch_base + 4 * i);
+        storeValue("t0", param);
+    }
+}
+
+void VisitBranch(const koopa_raw_branch_t &branch)
+{
+    // 两条出边各自传递实参，因此真分支先跳到本地的边标签
+    string true_edge = ".L" + cur_func_name + "." + to_string(edge_label_cnt++);
+    loadValue("t0", branch.cond);
+    emit("bnez", {mreg("t0"), mlabel(true_edge)});
+    VisitBlockArgs(branch.false_bb, branch.false_args);
+    emit("j", {mlabel(getBlockLabel(branch.false_bb))});
+    beginBlock(true_edge);
+    VisitBlockArgs(branch.true_bb, branch.true_args);
+    emit("j", {mlabel(getBlockLabel(branch.true_bb))});
+}
+
+// 前8个实参放入a0~a7，其余写到栈底
+void VisitCall(const koopa_raw_call_t &call)
+{
+    for (size_t i = 0; i < call.args.len; ++i)
+    {
+        auto arg = reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i]);
+        if (i < 8)
+            loadValue("a" + to_string(i), arg);
+        else
+        {
+            loadValue("t0", arg);
+            emitStackAccess("sw", "t0", 4 * (i - 8));
+        }
+    }
+    emit("call", {mlabel(call.callee->name + 1)});
+}
+
+void VisitJump(const koopa_raw_jump_t &jump)
+{
+    VisitBlockArgs(jump.target, jump.args);
+    emit("j", {mlabel(getBlockLabel(jump.target))});
 }
 
 void VisitBin(const koopa_raw_binary_t &bin_inst)
@@ -360,8 +492,8 @@ void VisitBin(const koopa_raw_binary_t &bin_inst)
             try_save_reg(bin_inst);
             // fout << "sub " << alloc_reg() << ", " << reg_l << ", " << reg_r << "\n";
             // fout << "seqz " << reg_prev << ", " << reg_prev << "\n";
-            fout << "sub t0, t0, t1\n";
-            fout << "seqz t0, t0\n";
+            emit("sub", {mreg("t0"), mreg("t0"), mreg("t1")});
+            emit("seqz", {mreg("t0"), mreg("t0")});
         }
         break;
     case KOOPA_RBO_NOT_EQ: // riscv没有直接neq指令
@@ -375,8 +507,8 @@ void VisitBin(const koopa_raw_binary_t &bin_inst)
             try_save_reg(bin_inst);
             // fout << "sub " << alloc_reg() << ", " << reg_l << ", " << reg_r << "\n";
             // fout << "snez " << reg_prev << ", " << reg_prev << "\n";
-            fout << "sub t0, t0, t1\n";
-            fout << "snez t0, t0\n";
+            emit("sub", {mreg("t0"), mreg("t0"), mreg("t1")});
+            emit("snez", {mreg("t0"), mreg("t0")});
         }
         break;
     case KOOPA_RBO_ADD:
@@ -390,7 +522,7 @@ void VisitBin(const koopa_raw_binary_t &bin_inst)
         {
             try_save_reg(bin_inst);
             // fout << "add " << alloc_reg() << ", " << reg_l << ", " << reg_r << "\n";
-            fout << "add t0, t0, t1\n";
+            emit("add", {mreg("t0"), mreg("t0"), mreg("t1")});
         }
         break;
     case KOOPA_RBO_SUB:
@@ -403,7 +535,7 @@ void VisitBin(const koopa_raw_binary_t &bin_inst)
         {
             try_save_reg(bin_inst);
             // fout << "sub " << alloc_reg() << ", " << reg_l << ", " << reg_r << "\n";
-            fout << "sub t0, t0, t1\n";
+            emit("sub", {mreg("t0"), mreg("t0"), mreg("t1")});
         }
         break;
     case KOOPA_RBO_MUL: // 二元乘法
@@ -416,7 +548,7 @@ void VisitBin(const koopa_raw_binary_t &bin_inst)
         {
             try_save_reg(bin_inst);
             // fout << "mul " << alloc_reg() << ", " << reg_l << ", " << reg_r << "\n";
-            fout << "mul t0, t0, t1\n";
+            emit("mul", {mreg("t0"), mreg("t0"), mreg("t1")});
         }
         break;
     case KOOPA_RBO_GE:
@@ -428,8 +560,9 @@ void VisitBin(const koopa_raw_binary_t &bin_inst)
         else
         {
             try_save_reg(bin_inst);
-            // fout << "sge " << alloc_reg() << ", " << reg_l << ", " << reg_r << "\n";
-            fout << "sge t0, t0, t1\n";
+            // RISC-V没有sge，用slt取反
+            emit("slt", {mreg("t0"), mreg("t0"), mreg("t1")});
+            emit("xori", {mreg("t0"), mreg("t0"), mimm(1)});
         }
         break;
     case KOOPA_RBO_GT:
@@ -443,7 +576,7 @@ void VisitBin(const koopa_raw_binary_t &bin_inst)
             try_save_reg(bin_inst);
             // sgt is pseudo instruct(RISCV-SPEC-20191213-P130)
             // fout << "sgt " << alloc_reg() << ", " << reg_l << ", " << reg_r << "\n";
-            fout << "sgt t0, t0, t1\n";
+            emit("sgt", {mreg("t0"), mreg("t0"), mreg("t1")});
         }
         break;
     case KOOPA_RBO_LE:
@@ -455,8 +588,9 @@ void VisitBin(const koopa_raw_binary_t &bin_inst)
         else
         {
             try_save_reg(bin_inst);
-            // fout << "sle " << alloc_reg() << ", " << reg_l << ", " << reg_r << "\n";
-            fout << "sle t0, t0, t1\n";
+            // RISC-V没有sle，用sgt取反
+            emit("sgt", {mreg("t0"), mreg("t0"), mreg("t1")});
+            emit("xori", {mreg("t0"), mreg("t0"), mimm(1)});
         }
         break;
     case KOOPA_RBO_LT:
@@ -469,19 +603,34 @@ void VisitBin(const koopa_raw_binary_t &bin_inst)
         {
             try_save_reg(bin_inst);
             // fout << "slt " << alloc_reg() << ", " << reg_l << ", " << reg_r << "\n";
-            fout << "slt t0, t0, t1\n";
+            emit("slt", {mreg("t0"), mreg("t0"), mreg("t1")});
+        }
+        break;
+    case KOOPA_RBO_DIV:
+        // 除数为0或INT_MIN/-1时不在编译期计算，交给运行时
+        if ((bin_inst.lhs->kind.tag == KOOPA_RVT_INTEGER) &&
+            (bin_inst.rhs->kind.tag == KOOPA_RVT_INTEGER) &&
+            r != 0 && !(l == INT32_MIN && r == -1))
+        {
+            save_reg(l / r);
+        }
+        else
+        {
+            try_save_reg(bin_inst);
+            emit("div", {mreg("t0"), mreg("t0"), mreg("t1")});
         }
         break;
     case KOOPA_RBO_MOD:
         if ((bin_inst.lhs->kind.tag == KOOPA_RVT_INTEGER) &&
-            (bin_inst.rhs->kind.tag == KOOPA_RVT_INTEGER))
+            (bin_inst.rhs->kind.tag == KOOPA_RVT_INTEGER) &&
+            r != 0 && !(l == INT32_MIN && r == -1))
         {
-            save_reg(l & r);
+            save_reg(l % r);
         }
         else
         {
             try_save_reg(bin_inst);
-            fout << "rem t0, t0, t1\n";
+            emit("rem", {mreg("t0"), mreg("t0"), mreg("t1")});
         }
         break;
     case KOOPA_RBO_AND:
@@ -494,7 +643,7 @@ void VisitBin(const koopa_raw_binary_t &bin_inst)
         {
             try_save_reg(bin_inst);
             // fout << "and " << alloc_reg() << ", " << reg_l << ", " << reg_r << "\n";
-            fout << "and t0, t0, t1\n";
+            emit("and", {mreg("t0"), mreg("t0"), mreg("t1")});
         }
         break;
     case KOOPA_RBO_OR:
@@ -507,7 +656,7 @@ void VisitBin(const koopa_raw_binary_t &bin_inst)
         {
             try_save_reg(bin_inst);
             // fout << "or " << alloc_reg() << ", " << reg_l << ", " << reg_r << "\n";
-            fout << "or t0, t0, t1\n";
+            emit("or", {mreg("t0"), mreg("t0"), mreg("t1")});
         }
         break;
     default:
@@ -532,8 +681,11 @@ void VisitReturn(const koopa_raw_return_t &ret)
     //     save_reg(ret.value->kind.data.integer.value);
     // 返回值类型为void
     // fout << "mv a0, " << reg_prev << "\n";
-    fout << "addi sp, sp, " << stack_size << endl; // Epilogue-为函数清理栈空间
-    fout << "ret\n";
+    if (has_call)
+        emitStackAccess("lw", "ra", stack_size - 4);
+    if (stack_size)
+        adjustSp(stack_size); // Epilogue-为函数清理栈空间
+    emit("ret", {});
 }
 
 // 访问对应类型指令的函数定义略
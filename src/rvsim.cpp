@@ -0,0 +1,804 @@
+#include "rvsim.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    // 地址空间：代码从TEXT_BASE开始，每条指令4字节；数据段从DATA_BASE开始；栈从STACK_TOP向下
+    // DATA_BASE以下（包括空指针）不可读写；返回到EXIT_ADDR时结束
+    const uint32_t TEXT_BASE = 0x10000;
+    const uint32_t DATA_BASE = 0x10000000;
+    const uint32_t STACK_TOP = 0x7ff00000;
+    const uint32_t EXIT_ADDR = 0;
+    const uint32_t PAGE_BITS = 12;
+    const uint32_t PAGE_SIZE = 1u << PAGE_BITS;
+
+    enum SimOp
+    {
+        // R型
+        OP_ADD, OP_SUB, OP_SLL, OP_SLT, OP_SLTU, OP_XOR, OP_SRL, OP_SRA, OP_OR, OP_AND,
+        OP_MUL, OP_MULH, OP_MULHSU, OP_MULHU, OP_DIV, OP_DIVU, OP_REM, OP_REMU,
+        // I型
+        OP_ADDI, OP_SLTI, OP_SLTIU, OP_XORI, OP_ORI, OP_ANDI, OP_SLLI, OP_SRLI, OP_SRAI,
+        OP_LUI, OP_AUIPC,
+        OP_LB, OP_LH, OP_LW, OP_LBU, OP_LHU,
+        OP_SB, OP_SH, OP_SW,
+        OP_BEQ, OP_BNE, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU,
+        OP_JAL, OP_JALR,
+    };
+
+    // 汇编后的指令；分支和jal的imm为目标地址
+    class SimInst
+    {
+    public:
+        SimOp op;
+        uint8_t rd = 0, rs1 = 0, rs2 = 0;
+        int32_t imm = 0;
+    };
+
+    const unordered_map<string, SimOp> R_OPS = {
+        {"add", OP_ADD}, {"sub", OP_SUB}, {"sll", OP_SLL}, {"slt", OP_SLT}, {"sltu", OP_SLTU},
+        {"xor", OP_XOR}, {"srl", OP_SRL}, {"sra", OP_SRA}, {"or", OP_OR}, {"and", OP_AND},
+        {"mul", OP_MUL}, {"mulh", OP_MULH}, {"mulhsu", OP_MULHSU}, {"mulhu", OP_MULHU},
+        {"div", OP_DIV}, {"divu", OP_DIVU}, {"rem", OP_REM}, {"remu", OP_REMU},
+    };
+    const unordered_map<string, SimOp> I_OPS = {
+        {"addi", OP_ADDI}, {"slti", OP_SLTI}, {"sltiu", OP_SLTIU}, {"xori", OP_XORI},
+        {"ori", OP_ORI}, {"andi", OP_ANDI}, {"slli", OP_SLLI}, {"srli", OP_SRLI}, {"srai", OP_SRAI},
+    };
+    const unordered_map<string, SimOp> LOAD_OPS = {
+        {"lb", OP_LB}, {"lh", OP_LH}, {"lw", OP_LW}, {"lbu", OP_LBU}, {"lhu", OP_LHU},
+    };
+    const unordered_map<string, SimOp> STORE_OPS = {
+        {"sb", OP_SB}, {"sh", OP_SH}, {"sw", OP_SW},
+    };
+    const unordered_map<string, SimOp> BRANCH_OPS = {
+        {"beq", OP_BEQ}, {"bne", OP_BNE}, {"blt", OP_BLT}, {"bge", OP_BGE}, {"bltu", OP_BLTU}, {"bgeu", OP_BGEU},
+    };
+    // 与零比较的分支伪指令：操作数在左边还是右边
+    const unordered_map<string, pair<SimOp, bool>> BRANCH_ZERO_OPS = {
+        {"beqz", {OP_BEQ, true}}, {"bnez", {OP_BNE, true}}, {"bltz", {OP_BLT, true}},
+        {"bgez", {OP_BGE, true}}, {"blez", {OP_BGE, false}}, {"bgtz", {OP_BLT, false}},
+    };
+    // 交换操作数的分支伪指令
+    const unordered_map<string, SimOp> BRANCH_SWAP_OPS = {
+        {"bgt", OP_BLT}, {"ble", OP_BGE}, {"bgtu", OP_BLTU}, {"bleu", OP_BGEU},
+    };
+
+    int regIndex(const string &name)
+    {
+        static const char *const ABI[32] = {
+            "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+            "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
+        for (int i = 0; i < 32; ++i)
+            if (name == ABI[i])
+                return i;
+        if (name == "fp")
+            return 8;
+        if (name.size() >= 2 && name[0] == 'x')
+        {
+            char *end;
+            long i = strtol(name.c_str() + 1, &end, 10);
+            if (!*end && i >= 0 && i < 32)
+                return (int)i;
+        }
+        return -1;
+    }
+
+    bool fitsImm12(int64_t v) { return v >= -2048 && v < 2048; }
+
+    // 一行汇编：标签已经去掉
+    class AsmLine
+    {
+    public:
+        int lineno;
+        bool text;       // 在代码段中
+        string op;
+        vector<string> args;
+    };
+
+    class SimMemory
+    {
+    public:
+        // 按页分配，未写过的内存读出0；非法地址返回nullptr
+        uint8_t *at(uint32_t addr)
+        {
+            if (addr < DATA_BASE)
+                return nullptr;
+            uint32_t page = addr >> PAGE_BITS;
+            if (page != lastPage || !last)
+            {
+                auto &data = pages[page];
+                if (!data)
+                    data.reset(new uint8_t[PAGE_SIZE]());
+                lastPage = page;
+                last = data.get();
+            }
+            return last + (addr & (PAGE_SIZE - 1));
+        }
+
+        bool load(uint32_t addr, int size, uint32_t &value)
+        {
+            value = 0;
+            for (int i = 0; i < size; ++i)
+            {
+                uint8_t *p = at(addr + i);
+                if (!p)
+                    return false;
+                value |= (uint32_t)*p << (8 * i);
+            }
+            return true;
+        }
+
+        bool store(uint32_t addr, int size, uint32_t value)
+        {
+            for (int i = 0; i < size; ++i)
+            {
+                uint8_t *p = at(addr + i);
+                if (!p)
+                    return false;
+                *p = (uint8_t)(value >> (8 * i));
+            }
+            return true;
+        }
+
+    private:
+        unordered_map<uint32_t, unique_ptr<uint8_t[]>> pages;
+        uint32_t lastPage = 0;
+        uint8_t *last = nullptr;
+    };
+
+    // 两遍汇编：第一遍确定标签的地址，第二遍生成指令和数据
+    class Assembler
+    {
+    public:
+        vector<SimInst> text;
+        unordered_map<string, uint32_t> symbols;
+        bool ok = true;
+
+        bool assemble(const string &source, SimMemory &memory)
+        {
+            split(source);
+            uint32_t pc = TEXT_BASE, data = DATA_BASE;
+            for (auto &line : lines)
+            {
+                if (!line.op.empty() && line.op.back() == ':')
+                {
+                    string label = line.op.substr(0, line.op.size() - 1);
+                    if (symbols.count(label))
+                        error(line, "duplicate label " + label);
+                    symbols[label] = line.text ? pc : data;
+                }
+                else if (line.text)
+                    pc += 4 * instCount(line);
+                else
+                    data = dataDirective(line, data, nullptr);
+            }
+            data = DATA_BASE;
+            for (auto &line : lines)
+            {
+                if (!line.op.empty() && line.op.back() == ':')
+                    continue;
+                if (line.text)
+                    encode(line);
+                else
+                    data = dataDirective(line, data, &memory);
+            }
+            return ok;
+        }
+
+    private:
+        vector<AsmLine> lines;
+
+        void error(const AsmLine &line, const string &msg)
+        {
+            if (ok)
+                cerr << "simulator: line " << line.lineno << ": " << msg << endl;
+            ok = false;
+        }
+
+        // 拆分为行，去掉注释，标签单独作为一行（op以:结尾）
+        void split(const string &source)
+        {
+            stringstream ss(source);
+            string raw;
+            bool text = true;
+            for (int lineno = 1; getline(ss, raw); ++lineno)
+            {
+                raw = raw.substr(0, raw.find('#'));
+                size_t pos = 0;
+                while (true)
+                {
+                    pos = raw.find_first_not_of(" \t\r", pos);
+                    if (pos == string::npos)
+                        break;
+                    size_t colon = raw.find(':', pos);
+                    size_t space = raw.find_first_of(" \t", pos);
+                    if (colon != string::npos && (space == string::npos || colon < space))
+                    {
+                        lines.push_back({lineno, text, raw.substr(pos, colon + 1 - pos), {}});
+                        pos = colon + 1;
+                        continue;
+                    }
+                    AsmLine line{lineno, text, raw.substr(pos, space == string::npos ? string::npos : space - pos), {}};
+                    if (space != string::npos)
+                    {
+                        stringstream args(raw.substr(space));
+                        string arg;
+                        while (getline(args, arg, ','))
+                        {
+                            size_t b = arg.find_first_not_of(" \t\r"), e = arg.find_last_not_of(" \t\r");
+                            if (b != string::npos)
+                                line.args.push_back(arg.substr(b, e + 1 - b));
+                        }
+                    }
+                    if (line.op == ".text")
+                        text = true;
+                    else if (line.op == ".data" || line.op == ".bss" || line.op == ".rodata")
+                        text = false;
+                    else if (line.op == ".section" && !line.args.empty())
+                        text = line.args[0].compare(0, 5, ".text") == 0;
+                    else
+                    {
+                        line.text = text;
+                        lines.push_back(line);
+                    }
+                    break;
+                }
+            }
+        }
+
+        // 数字、符号、符号+偏移，或%hi(...)/%lo(...)；第一遍时未定义的符号当作0
+        bool immediate(const AsmLine &line, const string &arg, int64_t &value, bool final = true)
+        {
+            if (arg.compare(0, 4, "%hi(") == 0 || arg.compare(0, 4, "%lo(") == 0)
+            {
+                if (arg.back() != ')' || !immediate(line, arg.substr(4, arg.size() - 5), value, final))
+                    return false;
+                int32_t lo = (int32_t)((uint32_t)value << 20) >> 20;
+                value = arg[1] == 'h' ? (int64_t)(((uint32_t)value - lo) >> 12) : lo;
+                return true;
+            }
+            char *end;
+            value = strtoll(arg.c_str(), &end, 0);
+            if (end != arg.c_str() && !*end)
+                return true;
+            size_t plus = arg.find_first_of("+-", 1);
+            string name = arg.substr(0, plus);
+            int64_t offset = 0;
+            if (plus != string::npos)
+            {
+                offset = strtoll(arg.c_str() + plus, &end, 0);
+                if (*end)
+                    return false;
+            }
+            auto it = symbols.find(name);
+            if (it == symbols.end())
+            {
+                if (final)
+                    error(line, "undefined symbol " + name);
+                value = 0;
+                return !final;
+            }
+            value = (int64_t)it->second + offset;
+            return true;
+        }
+
+        // 伪指令展开后的指令条数，只依赖于立即数，不依赖标签的地址
+        int instCount(const AsmLine &line)
+        {
+            if (line.op == "la")
+                return 2;
+            if (line.op == "li" && line.args.size() == 2)
+            {
+                int64_t v;
+                if (!immediate(line, line.args[1], v, false))
+                    return 1;
+                return fitsImm12((int32_t)v) || ((uint32_t)v & 0xfff) == 0 ? 1 : 2;
+            }
+            if (line.op[0] == '.')
+                return 0;
+            return 1;
+        }
+
+        // 数据段的伪指令，memory为nullptr时只计算大小
+        uint32_t dataDirective(const AsmLine &line, uint32_t addr, SimMemory *memory)
+        {
+            const string &op = line.op;
+            int size = op == ".word" ? 4 : op == ".half" ? 2 : op == ".byte" ? 1 : 0;
+            if (size)
+            {
+                for (auto &arg : line.args)
+                {
+                    int64_t v = 0;
+                    if (memory && !immediate(line, arg, v))
+                        return addr;
+                    if (memory)
+                        memory->store(addr, size, (uint32_t)v);
+                    addr += size;
+                }
+                return addr;
+            }
+            int64_t n = 0;
+            if (!line.args.empty())
+                immediate(line, line.args[0], n, false);
+            if (op == ".zero" || op == ".space")
+                return addr + (uint32_t)n;
+            if (op == ".align" || op == ".p2align" || op == ".balign")
+            {
+                uint32_t align = op == ".balign" ? (uint32_t)n : 1u << n;
+                return align ? (addr + align - 1) / align * align : addr;
+            }
+            if (op[0] != '.')
+                error(line, "instruction outside of .text: " + op);
+            return addr; // .globl、.type等不影响运行的伪指令
+        }
+
+        int reg(const AsmLine &line, const string &arg)
+        {
+            int r = regIndex(arg);
+            if (r < 0)
+                error(line, "bad register " + arg);
+            return max(r, 0);
+        }
+
+        // offset(base)
+        void memOperand(const AsmLine &line, const string &arg, int &base, int32_t &offset)
+        {
+            size_t open = arg.rfind('(');
+            if (open == string::npos || arg.back() != ')')
+            {
+                error(line, "bad memory operand " + arg);
+                base = offset = 0;
+                return;
+            }
+            int64_t v = 0;
+            if (open > 0 && !immediate(line, arg.substr(0, open), v))
+                error(line, "bad offset " + arg);
+            if (!fitsImm12(v))
+                error(line, "offset out of range " + arg);
+            offset = (int32_t)v;
+            base = reg(line, arg.substr(open + 1, arg.size() - open - 2));
+        }
+
+        int32_t imm12(const AsmLine &line, const string &arg)
+        {
+            int64_t v = 0;
+            if (!immediate(line, arg, v))
+                error(line, "bad immediate " + arg);
+            else if (!fitsImm12(v))
+                error(line, "immediate out of range " + arg);
+            return (int32_t)v;
+        }
+
+        int32_t target(const AsmLine &line, const string &arg)
+        {
+            int64_t v = 0;
+            if (!immediate(line, arg, v))
+                error(line, "bad branch target " + arg);
+            return (int32_t)v;
+        }
+
+        void emit(SimOp op, int rd, int rs1, int rs2, int32_t imm)
+        {
+            text.push_back({op, (uint8_t)rd, (uint8_t)rs1, (uint8_t)rs2, imm});
+        }
+
+        // li：lui+addi，低12位按有符号数处理，高位相应进位
+        void loadImm(int rd, uint32_t v)
+        {
+            int32_t lo = (int32_t)(v << 20) >> 20;
+            if (fitsImm12((int32_t)v))
+            {
+                emit(OP_ADDI, rd, 0, 0, (int32_t)v);
+                return;
+            }
+            emit(OP_LUI, rd, 0, 0, (int32_t)((v - lo) >> 12));
+            if (lo)
+                emit(OP_ADDI, rd, rd, 0, lo);
+        }
+
+        void encode(const AsmLine &line)
+        {
+            const string &op = line.op;
+            auto &a = line.args;
+            if (op[0] == '.')
+                return;
+            auto need = [&](size_t n)
+            {
+                if (a.size() == n)
+                    return true;
+                error(line, "wrong number of operands for " + op);
+                return false;
+            };
+            auto it = R_OPS.find(op);
+            if (it != R_OPS.end())
+            {
+                if (need(3))
+                    emit(it->second, reg(line, a[0]), reg(line, a[1]), reg(line, a[2]), 0);
+                return;
+            }
+            if ((it = I_OPS.find(op)) != I_OPS.end())
+            {
+                if (need(3))
+                {
+                    int32_t imm = imm12(line, a[2]);
+                    if ((it->second == OP_SLLI || it->second == OP_SRLI || it->second == OP_SRAI) && (imm < 0 || imm > 31))
+                        error(line, "shift amount out of range");
+                    emit(it->second, reg(line, a[0]), reg(line, a[1]), 0, imm);
+                }
+                return;
+            }
+            if ((it = LOAD_OPS.find(op)) != LOAD_OPS.end() || (it = STORE_OPS.find(op)) != STORE_OPS.end())
+            {
+                if (!need(2))
+                    return;
+                int base;
+                int32_t offset;
+                memOperand(line, a[1], base, offset);
+                if (LOAD_OPS.count(op))
+                    emit(it->second, reg(line, a[0]), base, 0, offset);
+                else
+                    emit(it->second, 0, base, reg(line, a[0]), offset);
+                return;
+            }
+            if ((it = BRANCH_OPS.find(op)) != BRANCH_OPS.end())
+            {
+                if (need(3))
+                    emit(it->second, 0, reg(line, a[0]), reg(line, a[1]), target(line, a[2]));
+                return;
+            }
+            if ((it = BRANCH_SWAP_OPS.find(op)) != BRANCH_SWAP_OPS.end())
+            {
+                if (need(3))
+                    emit(it->second, 0, reg(line, a[1]), reg(line, a[0]), target(line, a[2]));
+                return;
+            }
+            auto zero = BRANCH_ZERO_OPS.find(op);
+            if (zero != BRANCH_ZERO_OPS.end())
+            {
+                if (!need(2))
+                    return;
+                int r = reg(line, a[0]);
+                if (zero->second.second)
+                    emit(zero->second.first, 0, r, 0, target(line, a[1]));
+                else
+                    emit(zero->second.first, 0, 0, r, target(line, a[1]));
+                return;
+            }
+            if (op == "lui" || op == "auipc")
+            {
+                int64_t v = 0;
+                if (!need(2))
+                    return;
+                if (!immediate(line, a[1], v) || v < 0 || v >= (1 << 20))
+                    error(line, "bad upper immediate " + a[1]);
+                emit(op == "lui" ? OP_LUI : OP_AUIPC, reg(line, a[0]), 0, 0, (int32_t)v);
+            }
+            else if (op == "jal")
+            {
+                if (a.size() == 1)
+                    emit(OP_JAL, 1, 0, 0, target(line, a[0]));
+                else if (need(2))
+                    emit(OP_JAL, reg(line, a[0]), 0, 0, target(line, a[1]));
+            }
+            else if (op == "jalr")
+            {
+                int base;
+                int32_t offset = 0;
+                if (a.size() == 1)
+                    emit(OP_JALR, 1, reg(line, a[0]), 0, 0);
+                else if (a.size() == 2)
+                {
+                    memOperand(line, a[1], base, offset);
+                    emit(OP_JALR, reg(line, a[0]), base, 0, offset);
+                }
+                else if (need(3))
+                    emit(OP_JALR, reg(line, a[0]), reg(line, a[1]), 0, imm12(line, a[2]));
+            }
+            else if (op == "nop")
+                emit(OP_ADDI, 0, 0, 0, 0);
+            else if (op == "li")
+            {
+                int64_t v = 0;
+                if (!need(2))
+                    return;
+                if (!immediate(line, a[1], v))
+                    error(line, "bad immediate " + a[1]);
+                else if (v < INT32_MIN || v > UINT32_MAX)
+                    error(line, "immediate out of range " + a[1]);
+                loadImm(reg(line, a[0]), (uint32_t)v);
+            }
+            else if (op == "la")
+            {
+                int64_t v = 0;
+                if (!need(2))
+                    return;
+                immediate(line, a[1], v);
+                // 实际为auipc+addi，这里用绝对地址，指令数相同
+                int rd = reg(line, a[0]);
+                int32_t lo = (int32_t)((uint32_t)v << 20) >> 20;
+                emit(OP_LUI, rd, 0, 0, (int32_t)(((uint32_t)v - lo) >> 12));
+                emit(OP_ADDI, rd, rd, 0, lo);
+            }
+            else if (op == "mv" || op == "not" || op == "neg" || op == "seqz" || op == "snez" || op == "sltz" || op == "sgtz")
+            {
+                if (!need(2))
+                    return;
+                int rd = reg(line, a[0]), rs = reg(line, a[1]);
+                if (op == "mv")
+                    emit(OP_ADDI, rd, rs, 0, 0);
+                else if (op == "not")
+                    emit(OP_XORI, rd, rs, 0, -1);
+                else if (op == "neg")
+                    emit(OP_SUB, rd, 0, rs, 0);
+                else if (op == "seqz")
+                    emit(OP_SLTIU, rd, rs, 0, 1);
+                else if (op == "snez")
+                    emit(OP_SLTU, rd, 0, rs, 0);
+                else if (op == "sltz")
+                    emit(OP_SLT, rd, rs, 0, 0);
+                else
+                    emit(OP_SLT, rd, 0, rs, 0);
+            }
+            else if (op == "sgt" || op == "sgtu")
+            {
+                if (need(3))
+                    emit(op == "sgt" ? OP_SLT : OP_SLTU, reg(line, a[0]), reg(line, a[2]), reg(line, a[1]), 0);
+            }
+            else if (op == "j" || op == "call" || op == "tail")
+            {
+                // call和tail链接时松弛为一条jal
+                if (need(1))
+                    emit(OP_JAL, op == "call" ? 1 : 0, 0, 0, target(line, a[0]));
+            }
+            else if (op == "jr")
+            {
+                if (need(1))
+                    emit(OP_JALR, 0, reg(line, a[0]), 0, 0);
+            }
+            else if (op == "ret")
+            {
+                if (need(0))
+                    emit(OP_JALR, 0, 1, 0, 0);
+            }
+            else
+                error(line, "unknown instruction " + op);
+        }
+    };
+
+    uint32_t divide(SimOp op, uint32_t a, uint32_t b)
+    {
+        int32_t sa = (int32_t)a, sb = (int32_t)b;
+        switch (op)
+        {
+        case OP_DIV:
+            if (!b)
+                return UINT32_MAX;
+            if (sa == INT32_MIN && sb == -1)
+                return a;
+            return (uint32_t)(sa / sb);
+        case OP_DIVU:
+            return b ? a / b : UINT32_MAX;
+        case OP_REM:
+            if (!b)
+                return a;
+            if (sa == INT32_MIN && sb == -1)
+                return 0;
+            return (uint32_t)(sa % sb);
+        default: // OP_REMU
+            return b ? a % b : a;
+        }
+    }
+
+    bool parseCount(const string &s, int &value)
+    {
+        char *end;
+        long v = strtol(s.c_str(), &end, 10);
+        if (s.empty() || *end || v < 0 || v > 1000000)
+            return false;
+        value = (int)v;
+        return true;
+    }
+}
+
+bool SimModel::parse(const string &spec)
+{
+    stringstream ss(spec);
+    string item;
+    while (getline(ss, item, ','))
+    {
+        size_t eq = item.find('=');
+        string name = item.substr(0, eq);
+        int *field = name == "alu"      ? &aluLatency
+                     : name == "load"   ? &loadLatency
+                     : name == "mul"    ? &mulLatency
+                     : name == "div"    ? &divLatency
+                     : name == "branch" ? &branchPenalty
+                     : name == "jump"   ? &jumpPenalty
+                     : name == "depth"  ? &depth
+                                        : nullptr;
+        if (!field || eq == string::npos || !parseCount(item.substr(eq + 1), *field))
+        {
+            cerr << "Bad pipeline model parameter: " << item << endl;
+            return false;
+        }
+    }
+    if (aluLatency < 1 || loadLatency < 1 || mulLatency < 1 || divLatency < 1 || depth < 1)
+    {
+        cerr << "Latencies and pipeline depth must be at least 1" << endl;
+        return false;
+    }
+    return true;
+}
+
+void SimStats::report(ostream &os) const
+{
+    char cpi[32];
+    snprintf(cpi, sizeof(cpi), "%.3f", insts ? (double)cycles / insts : 0.0);
+    os << "return value:    " << retval << "\n"
+       << "instructions:    " << insts << "\n"
+       << "loads:           " << loads << "\n"
+       << "stores:          " << stores << "\n"
+       << "branches:        " << branches << " (" << taken << " taken)\n"
+       << "jumps:           " << jumps << "\n"
+       << "stall cycles:    " << stalls << "\n"
+       << "cycles:          " << cycles << " (CPI " << cpi << ")\n";
+}
+
+bool simulateRISCV(const string &assembly, const SimModel &model, SimStats &stats, const string &entry, uint64_t maxInsts)
+{
+    stats = SimStats();
+    SimMemory memory;
+    Assembler as;
+    if (!as.assemble(assembly, memory))
+        return false;
+    auto found = as.symbols.find(entry);
+    if (found == as.symbols.end() || found->second < TEXT_BASE || found->second >= DATA_BASE)
+    {
+        cerr << "simulator: no function " << entry << endl;
+        return false;
+    }
+    const vector<SimInst> &text = as.text;
+
+    uint32_t x[32] = {};
+    uint64_t ready[32] = {}; // 各寄存器的值可以被使用的周期（记分牌）
+    x[1] = EXIT_ADDR;
+    x[2] = STACK_TOP;
+    uint32_t pc = found->second;
+    uint64_t cycle = 0; // 下一条指令最早的发射周期
+    while (pc != EXIT_ADDR)
+    {
+        uint32_t index = (pc - TEXT_BASE) >> 2;
+        if (pc < TEXT_BASE || (pc & 3) || index >= text.size())
+        {
+            cerr << "simulator: jump to invalid address 0x" << hex << pc << dec << endl;
+            return false;
+        }
+        if (maxInsts && stats.insts >= maxInsts)
+        {
+            cerr << "simulator: stopped after " << maxInsts << " instructions" << endl;
+            return false;
+        }
+        const SimInst &in = text[index];
+        ++stats.insts;
+        uint64_t start = max(cycle, max(ready[in.rs1], ready[in.rs2]));
+        stats.stalls += start - cycle;
+        uint32_t a = x[in.rs1], b = x[in.rs2], imm = (uint32_t)in.imm;
+        uint32_t result = 0, next = pc + 4;
+        int latency = model.aluLatency, penalty = 0;
+        bool cond = false;
+        switch (in.op)
+        {
+        case OP_ADD: result = a + b; break;
+        case OP_SUB: result = a - b; break;
+        case OP_SLL: result = a << (b & 31); break;
+        case OP_SLT: result = (int32_t)a < (int32_t)b; break;
+        case OP_SLTU: result = a < b; break;
+        case OP_XOR: result = a ^ b; break;
+        case OP_SRL: result = a >> (b & 31); break;
+        case OP_SRA: result = (uint32_t)((int32_t)a >> (b & 31)); break;
+        case OP_OR: result = a | b; break;
+        case OP_AND: result = a & b; break;
+        case OP_MUL: result = a * b; latency = model.mulLatency; break;
+        case OP_MULH: result = (uint32_t)(((int64_t)(int32_t)a * (int32_t)b) >> 32); latency = model.mulLatency; break;
+        case OP_MULHSU: result = (uint32_t)(((int64_t)(int32_t)a * (int64_t)b) >> 32); latency = model.mulLatency; break;
+        case OP_MULHU: result = (uint32_t)(((uint64_t)a * b) >> 32); latency = model.mulLatency; break;
+        case OP_DIV:
+        case OP_DIVU:
+        case OP_REM:
+        case OP_REMU:
+            result = divide(in.op, a, b);
+            latency = model.divLatency;
+            break;
+        case OP_ADDI: result = a + imm; break;
+        case OP_SLTI: result = (int32_t)a < in.imm; break;
+        case OP_SLTIU: result = a < imm; break;
+        case OP_XORI: result = a ^ imm; break;
+        case OP_ORI: result = a | imm; break;
+        case OP_ANDI: result = a & imm; break;
+        case OP_SLLI: result = a << imm; break;
+        case OP_SRLI: result = a >> imm; break;
+        case OP_SRAI: result = (uint32_t)((int32_t)a >> imm); break;
+        case OP_LUI: result = imm << 12; break;
+        case OP_AUIPC: result = pc + (imm << 12); break;
+        case OP_LB:
+        case OP_LH:
+        case OP_LW:
+        case OP_LBU:
+        case OP_LHU:
+        {
+            int size = in.op == OP_LW ? 4 : in.op == OP_LH || in.op == OP_LHU ? 2 : 1;
+            if (!memory.load(a + imm, size, result))
+            {
+                cerr << "simulator: load from invalid address 0x" << hex << a + imm << dec << endl;
+                return false;
+            }
+            if (in.op == OP_LB)
+                result = (uint32_t)(int32_t)(int8_t)result;
+            else if (in.op == OP_LH)
+                result = (uint32_t)(int32_t)(int16_t)result;
+            ++stats.loads;
+            latency = model.loadLatency;
+            break;
+        }
+        case OP_SB:
+        case OP_SH:
+        case OP_SW:
+            if (!memory.store(a + imm, in.op == OP_SW ? 4 : in.op == OP_SH ? 2 : 1, b))
+            {
+                cerr << "simulator: store to invalid address 0x" << hex << a + imm << dec << endl;
+                return false;
+            }
+            ++stats.stores;
+            break;
+        case OP_BEQ: cond = a == b; break;
+        case OP_BNE: cond = a != b; break;
+        case OP_BLT: cond = (int32_t)a < (int32_t)b; break;
+        case OP_BGE: cond = (int32_t)a >= (int32_t)b; break;
+        case OP_BLTU: cond = a < b; break;
+        case OP_BGEU: cond = a >= b; break;
+        case OP_JAL:
+            result = pc + 4;
+            next = imm;
+            penalty = model.jumpPenalty;
+            ++stats.jumps;
+            break;
+        case OP_JALR:
+            result = pc + 4;
+            next = (a + imm) & ~1u;
+            penalty = model.branchPenalty;
+            ++stats.jumps;
+            break;
+        }
+        if (in.op >= OP_BEQ && in.op <= OP_BGEU)
+        {
+            ++stats.branches;
+            if (cond)
+            {
+                ++stats.taken;
+                next = imm;
+                penalty = model.branchPenalty;
+            }
+        }
+        if (in.rd)
+        {
+            x[in.rd] = result;
+            ready[in.rd] = start + latency;
+        }
+        cycle = start + 1 + penalty;
+        pc = next;
+    }
+    stats.retval = (int32_t)x[10];
+    stats.cycles = stats.insts ? cycle + model.depth - 1 : 0;
+    return true;
+}
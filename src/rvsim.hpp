@@ -0,0 +1,50 @@
+// RV32IM指令级模拟器：运行生成的汇编，统计动态指令数、访存和跳转，按单发射顺序流水线的模型估计周期数
+// 用来衡量后端优化的效果，不依赖外部的模拟器
+#ifndef RVSIM_HPP
+#define RVSIM_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+using namespace std;
+
+// 流水线模型：带前递的单发射顺序流水线，指令在源操作数就绪后发射，每周期最多发射一条
+// 延迟为结果可被后续指令使用前经过的周期数，1表示紧接着的指令可以直接使用
+class SimModel
+{
+public:
+    int aluLatency = 1;
+    int loadLatency = 2;   // load-use停顿1个周期
+    int mulLatency = 3;
+    int divLatency = 20;
+    int branchPenalty = 2; // 静态预测不跳转：跳转的分支和jalr在EX级确定后冲刷取到的指令
+    int jumpPenalty = 1;   // jal的目标在ID级确定
+    int depth = 5;         // 流水线级数，最后一条指令还需要depth-1个周期才能完成
+
+    // 解析 名字=数值,... ，名字为alu load mul div branch jump depth；出错时返回false
+    bool parse(const string &spec);
+};
+
+class SimStats
+{
+public:
+    int32_t retval = 0;      // main返回时的a0
+    uint64_t insts = 0;      // 动态指令数，伪指令按展开后的指令计
+    uint64_t loads = 0;
+    uint64_t stores = 0;
+    uint64_t branches = 0;   // 条件分支
+    uint64_t taken = 0;      // 其中跳转的
+    uint64_t jumps = 0;      // jal/jalr（含call和ret）
+    uint64_t stalls = 0;     // 等待操作数的周期
+    uint64_t cycles = 0;
+
+    void report(ostream &os) const;
+};
+
+// 汇编assembly并从entry开始运行，entry返回时结束；maxInsts为0时不限制指令数
+// 汇编或运行出错（未定义的符号、非法访存、超过指令数等）时在cerr中说明并返回false
+bool simulateRISCV(const string &assembly, const SimModel &model, SimStats &stats,
+                   const string &entry = "main", uint64_t maxInsts = 0);
+
+#endif // RVSIM_HPP
@@ -6,9 +6,17 @@
 #include <unordered_map>
 #include <iostream>
 #include <sstream>
-#include <cassert>
+#include <exception>
 using namespace std;
 
+// 前端发现的错误（未定义的名字、重定义、类型不符等），说明已经输出到cerr
+// 由CompileJob的调用者捕获，该作业失败，批量/服务模式下继续处理下一个作业
+class CompileError : public exception
+{
+public:
+    const char *what() const noexcept override { return "compile error"; }
+};
+
 // 以下常量规定了Fe语言类型所使用的内置类型关键字
 const static string FE_TYPENAME_INT = "int";
 static string foundNameId;  // 变量赋值时找到的左值nameId
@@ -17,7 +25,8 @@ const static int WIDTH_UNIT = 4; // 整型宽度单位
 
 enum ValueType
 {
-    INT_VT
+    INT_VT,
+    VOID_VT // 无返回值的函数调用，不能作为值使用
 };
 static unordered_map<string, int> TYPE_HASH;
 inline static void initTypeHash(); // 初始化类型哈希，其中加入内置类型【目前仅支持int】
@@ -78,7 +87,7 @@ static void initTypeSBT();
 class SBTNode
 {
 public:
-    int const_val;       // 【暂仅支持整型】常量定义值（注意变量值无需放在这！）
+    int32_t const_val;   // 【暂仅支持整型】常量定义值（注意变量值无需放在这！）
     int typeBlockId; // 类定义时所在块（对应TypeSBT的行）
     int typeId;      // 类定义时所在的类id（对应TypeSBT的列）
     int offset;      // 变量偏移量【暂未使用】
@@ -92,7 +101,7 @@ static vector<unordered_map<string, SBTNode> *> SBT;              // 行对应Bl
 // ast.hpp调用，检查某个ident名是否在块路径中存在
 static bool findPureNameInSBT(int blockId, string pureName);
 static bool findInSBT(int blockId, string name, bool findParent);                  // 用于检查是否某个名称是否被定义过
-static void addConstToSBT(int blockId, string name, int initVal); // 声明常量时使用
+static void addConstToSBT(int blockId, string name, int32_t initVal); // 声明常量时使用
 static void addVarToSBT(int blockId, string name);                // 声明变量时使用
 static SBTNode& getNodeFromSBT(int blockId, string name);            // 读取常量值
 
@@ -126,9 +135,9 @@ inline static void initTypeSBT()
     TypeSBTNode t_int;
     t_int.category = BASIC_CT;
     t_int.width = WIDTH_UNIT;
-    unordered_map<string, TypeSBTNode> block;
-    block.insert(make_pair(FE_TYPENAME_INT, t_int));
-    TYPE_SBT.emplace_back(&block);
+    auto block = new unordered_map<string, TypeSBTNode>();
+    block->insert(make_pair(FE_TYPENAME_INT, t_int));
+    TYPE_SBT.emplace_back(block);
 }
 
 static bool findPureNameInSBT(int blockId, string pureName)
@@ -138,7 +147,7 @@ static bool findPureNameInSBT(int blockId, string pureName)
     if (SBT.size() <= blockId)
     {
         cerr << "Block Undefined in SBT Error: " << blockId << endl;
-        assert(false);
+        throw CompileError();
     }
     // 在该块中寻找常量声明
     int cnt = SBT[blockId]->count(nameId);
@@ -165,7 +174,7 @@ static bool findInSBT(int blockId, string name, bool findParent)
     if (SBT.size() <= blockId)
     {
         cerr << "Block Undefined in SBT Error: " << blockId << endl;
-        assert(false);
+        throw CompileError();
     }
     // 在该块中寻找常量声明
     int cnt = SBT[blockId]->count(name);
@@ -186,14 +195,14 @@ static bool findInSBT(int blockId, string name, bool findParent)
     return false;
 }
 
-static void addConstToSBT(int blockId, string name, int initVal)
+static void addConstToSBT(int blockId, string name, int32_t initVal)
 {
     cerr << "Verifying Const... " << blockId << endl;
     // 判断该变量声明是否已经出现过
     if (findInSBT(blockId, name, false))
     {
         cerr << "Syntax Error: Const Redefined " << blockId << " " << name << " " << initVal << endl;
-        assert(false);
+        throw CompileError();
     }
     cerr << "Verifying OK!\n";
     // name = name
@@ -213,7 +222,7 @@ static void addVarToSBT(int blockId, string name)
     if (findInSBT(blockId, name, false))
     {
         cerr << "Syntax Error: Var Redefined " << blockId << " " << name << endl;
-        assert(false);
+        throw CompileError();
     }
     cerr << "Verifying OK!\n";
     // name = name
@@ -233,7 +242,7 @@ static inline SBTNode& getNodeFromSBT(int blockId, string pureName)
     if (SBT.size() <= blockId)
     {
         cerr << "Block Undefined in SBT Error: " << blockId << endl;
-        assert(false);
+        throw CompileError();
     }
     // 在该块中寻找常量声明时的值
     auto findResult = SBT[blockId]->find(nameId);
@@ -251,7 +260,7 @@ static inline SBTNode& getNodeFromSBT(int blockId, string pureName)
         return getNodeFromSBT(BLOCK_HASH.at(blockId)->parent->blockId, pureName);
     }
     cerr << "Syntax Error: Const or val Undefined! " << nameId << endl;
-    assert(false);
+    throw CompileError();
 }
 
 inline static void alloc_block(int blockId, int parentBlockId)
@@ -0,0 +1,240 @@
+#include "passes.hpp"
+#include <set>
+
+using namespace std;
+
+// 稀疏条件常量传播（Wegman-Zadeck）
+// 格：TOP（尚未确定）> 常量c > BOTTOM（非常量），只会单调下降
+namespace
+{
+    enum LatticeKind
+    {
+        LAT_TOP,
+        LAT_CONST,
+        LAT_BOTTOM
+    };
+
+    struct Lattice
+    {
+        LatticeKind kind = LAT_TOP;
+        int32_t val = 0;
+
+        bool operator==(const Lattice &other) const
+        {
+            return kind == other.kind && (kind != LAT_CONST || val == other.val);
+        }
+    };
+
+    Lattice meet(const Lattice &a, const Lattice &b)
+    {
+        if (a.kind == LAT_TOP)
+            return b;
+        if (b.kind == LAT_TOP)
+            return a;
+        if (a.kind == LAT_BOTTOM || b.kind == LAT_BOTTOM || a.val != b.val)
+            return {LAT_BOTTOM, 0};
+        return a;
+    }
+
+    class SCCPSolver
+    {
+    public:
+        explicit SCCPSolver(IRFunction &func) : func(func)
+        {
+            func.buildCFG();
+            incoming = collectIncomingEdges(func);
+            for (auto bb : func.blocks)
+            {
+                for (auto inst : bb->insts)
+                {
+                    forEachOperand(inst, [&](IRValue *&op)
+                                   { users[op].push_back(inst); });
+                }
+            }
+        }
+
+        void solve()
+        {
+            if (func.blocks.empty())
+                return;
+            markBlock(func.blocks[0]);
+            while (!block_work.empty() || !value_work.empty())
+            {
+                while (!block_work.empty())
+                {
+                    IRBlock *bb = block_work.back();
+                    block_work.pop_back();
+                    for (auto inst : bb->insts)
+                        visit(inst);
+                }
+                while (!value_work.empty())
+                {
+                    IRValue *v = value_work.back();
+                    value_work.pop_back();
+                    for (auto user : users[v])
+                    {
+                        if (executable.count(user->parent))
+                            visit(user);
+                    }
+                }
+            }
+        }
+
+        // 按求解结果改写：常量替换、常量分支改为jump、删除不可达块
+        bool rewrite()
+        {
+            bool changed = false;
+            unordered_map<IRValue *, IRValue *> repl;
+            for (auto bb : func.blocks)
+            {
+                if (!executable.count(bb))
+                    continue;
+                for (auto param : bb->params)
+                {
+                    Lattice lat = get(param);
+                    if (lat.kind == LAT_CONST)
+                        repl[param] = func.getInt(lat.val);
+                }
+                for (auto inst : bb->insts)
+                {
+                    Lattice lat = get(inst);
+                    if (inst->kind == IR_BINARY && lat.kind == LAT_CONST)
+                    {
+                        repl[inst] = func.getInt(lat.val);
+                        inst->dead = true;
+                    }
+                    if (inst->kind != IR_BRANCH)
+                        continue;
+                    bool t = edges.count({inst, 0}), f = edges.count({inst, 1});
+                    if (t == f)
+                        continue;
+                    // 只有一条出边可达，条件分支退化为无条件跳转
+                    size_t keep = t ? 0 : 1;
+                    inst->kind = IR_JUMP;
+                    inst->ops.clear();
+                    inst->targets = {inst->targets[keep]};
+                    inst->args = {inst->args[keep]};
+                    changed = true;
+                }
+            }
+            changed |= !repl.empty();
+            func.sweep();
+            func.replaceUses(repl);
+            changed |= func.removeUnreachableBlocks();
+            changed |= PruneBlockParams(func);
+            return changed;
+        }
+
+    private:
+        IRFunction &func;
+        vector<vector<IREdge>> incoming;
+        unordered_map<IRValue *, vector<IRValue *>> users;
+        unordered_map<IRValue *, Lattice> values;
+        unordered_set<IRBlock *> executable;
+        set<IREdge> edges; // 可执行的边
+        vector<IRBlock *> block_work;
+        vector<IRValue *> value_work;
+
+        Lattice get(IRValue *v)
+        {
+            switch (v->kind)
+            {
+            case IR_INT:
+                return {LAT_CONST, v->imm};
+            case IR_UNDEF:
+                return {LAT_TOP, 0};
+            case IR_FUNC_ARG:
+                return {LAT_BOTTOM, 0};
+            default:
+                break;
+            }
+            auto it = values.find(v);
+            return it == values.end() ? Lattice() : it->second;
+        }
+
+        void update(IRValue *v, const Lattice &lat)
+        {
+            Lattice &old = values[v];
+            if (old == lat)
+                return;
+            old = lat;
+            value_work.push_back(v);
+        }
+
+        void markBlock(IRBlock *bb)
+        {
+            if (executable.insert(bb).second)
+                block_work.push_back(bb);
+        }
+
+        void markEdge(IRValue *term, size_t k)
+        {
+            IRBlock *target = term->targets[k];
+            if (edges.insert({term, k}).second)
+                markBlock(target);
+            // 新边或实参变化都可能改变目标块的参数
+            for (size_t i = 0; i < target->params.size(); ++i)
+            {
+                Lattice lat;
+                for (auto &edge : incoming[target->id])
+                {
+                    if (edges.count(edge))
+                        lat = meet(lat, get(edge.first->args[edge.second][i]));
+                }
+                update(target->params[i], lat);
+            }
+        }
+
+        void visit(IRValue *inst)
+        {
+            switch (inst->kind)
+            {
+            case IR_BINARY:
+            {
+                Lattice l = get(inst->ops[0]), r = get(inst->ops[1]);
+                Lattice result;
+                if (l.kind == LAT_BOTTOM || r.kind == LAT_BOTTOM)
+                    result.kind = LAT_BOTTOM;
+                else if (l.kind == LAT_CONST && r.kind == LAT_CONST)
+                {
+                    // 除以0等无法在编译期计算的情况留给运行时
+                    if (foldBinOp(inst->op, l.val, r.val, result.val))
+                        result.kind = LAT_CONST;
+                    else
+                        result.kind = LAT_BOTTOM;
+                }
+                update(inst, result);
+                break;
+            }
+            case IR_BRANCH:
+            {
+                Lattice cond = get(inst->ops[0]);
+                if (cond.kind == LAT_TOP)
+                    break;
+                if (cond.kind == LAT_BOTTOM || cond.val)
+                    markEdge(inst, 0);
+                if (cond.kind == LAT_BOTTOM || !cond.val)
+                    markEdge(inst, 1);
+                break;
+            }
+            case IR_JUMP:
+                markEdge(inst, 0);
+                break;
+            case IR_RETURN:
+            case IR_STORE:
+                break;
+            default:
+                // load、call、alloc的结果在编译期未知
+                if (inst->hasResult)
+                    update(inst, {LAT_BOTTOM, 0});
+            }
+        }
+    };
+}
+
+bool SCCP(IRFunction &func)
+{
+    SCCPSolver solver(func);
+    solver.solve();
+    return solver.rewrite();
+}
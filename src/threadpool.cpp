@@ -0,0 +1,113 @@
+#include "threadpool.hpp"
+
+using namespace std;
+
+ThreadPool::~ThreadPool()
+{
+    stopWorkers();
+}
+
+void ThreadPool::setThreads(int n)
+{
+    n = n < 1 ? 1 : n;
+    if (n != threads)
+        stopWorkers();
+    threads = n;
+}
+
+void ThreadPool::stopWorkers()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    start_cv.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+    workers.clear();
+    queues.clear();
+    lock_guard<mutex> guard(lock);
+    stopping = false;
+}
+
+void ThreadPool::parallelFor(const vector<size_t> &order, const function<void(size_t)> &fn)
+{
+    if (threads <= 1 || order.size() <= 1)
+    {
+        for (auto task : order)
+            fn(task);
+        return;
+    }
+    if (workers.empty())
+    {
+        for (int i = 0; i < threads; ++i)
+            queues.emplace_back(new Queue());
+        for (int i = 1; i < threads; ++i)
+            workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+    // 先设置job再放入任务：上一轮的线程可能还在取任务，取到的必须是这一轮的job
+    {
+        lock_guard<mutex> guard(lock);
+        job = &fn;
+        remaining = order.size();
+        ++generation;
+    }
+    for (size_t k = 0; k < order.size(); ++k)
+    {
+        Queue &queue = *queues[k % threads];
+        lock_guard<mutex> guard(queue.lock);
+        queue.tasks.push_back(order[k]);
+    }
+    start_cv.notify_all();
+    runTasks(0);
+    unique_lock<mutex> guard(lock);
+    done_cv.wait(guard, [&]
+                 { return remaining == 0; });
+    job = nullptr;
+}
+
+void ThreadPool::workerLoop(size_t self)
+{
+    size_t seen = 0;
+    while (true)
+    {
+        {
+            unique_lock<mutex> guard(lock);
+            start_cv.wait(guard, [&]
+                          { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+        runTasks(self);
+    }
+}
+
+void ThreadPool::runTasks(size_t self)
+{
+    size_t task;
+    while (popTask(self, task))
+    {
+        (*job)(task);
+        lock_guard<mutex> guard(lock);
+        if (--remaining == 0)
+            done_cv.notify_all();
+    }
+}
+
+// 先取自己队列中的任务，没有时依次窃取其他线程的；都从队首取，总是先执行开销较大的任务
+bool ThreadPool::popTask(size_t self, size_t &task)
+{
+    for (size_t k = 0; k < queues.size(); ++k)
+    {
+        Queue &queue = *queues[(self + k) % queues.size()];
+        lock_guard<mutex> guard(queue.lock);
+        if (!queue.tasks.empty())
+        {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
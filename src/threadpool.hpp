@@ -0,0 +1,101 @@
+// 工作窃取线程池：每个线程有自己的任务队列，自己的队列空了就从其他线程的队列中窃取
+// 以及流水线各阶段之间使用的有界队列
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+class ThreadPool
+{
+public:
+    ~ThreadPool();
+
+    // 线程数（含调用者线程），不大于1时在调用者线程中顺序执行
+    // 不在parallelFor中调用；线程数改变时已启动的线程退出，下次parallelFor按新的线程数启动
+    void setThreads(int n);
+    int getThreads() const { return threads; }
+
+    // 执行fn(order[0])...fn(order[n-1])，全部完成后返回
+    // 任务轮流分给各线程，每个线程先执行排在前面的任务：把开销大的任务排在前面，总时间接近最大的任务
+    // 不同任务同时执行，fn必须只访问任务自己的数据（或自行加锁）
+    void parallelFor(const vector<size_t> &order, const function<void(size_t)> &fn);
+
+private:
+    class Queue
+    {
+    public:
+        mutex lock;
+        deque<size_t> tasks;
+    };
+
+    int threads = 1;
+    vector<unique_ptr<Queue>> queues; // queues[0]属于调用者线程
+    vector<thread> workers;
+
+    mutex lock; // 保护以下状态
+    condition_variable start_cv, done_cv;
+    const function<void(size_t)> *job = nullptr;
+    size_t remaining = 0;    // 尚未完成的任务数
+    size_t generation = 0;   // 每次parallelFor加一，唤醒等待中的线程
+    bool stopping = false;
+
+    void stopWorkers();
+    void workerLoop(size_t self);
+    void runTasks(size_t self);
+    bool popTask(size_t self, size_t &task);
+};
+
+// 有界的多生产者多消费者队列：满时push阻塞，生产者不会比消费者领先太多
+// close之后pop取完剩余的元素后返回false
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+    void push(T item)
+    {
+        unique_lock<mutex> guard(lock);
+        not_full.wait(guard, [&]
+                      { return items.size() < capacity; });
+        items.push_back(move(item));
+        not_empty.notify_one();
+    }
+
+    bool pop(T &item)
+    {
+        unique_lock<mutex> guard(lock);
+        not_empty.wait(guard, [&]
+                       { return closed || !items.empty(); });
+        if (items.empty())
+            return false;
+        item = move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        lock_guard<mutex> guard(lock);
+        closed = true;
+        not_empty.notify_all();
+    }
+
+private:
+    size_t capacity;
+    deque<T> items;
+    bool closed = false;
+    mutex lock;
+    condition_variable not_full, not_empty;
+};
+
+#endif // THREADPOOL_HPP
@@ -0,0 +1,303 @@
+#include "passes.hpp"
+#include <algorithm>
+
+using namespace std;
+
+// 计数循环展开
+// 只处理最内层的、header上 cmp p, N 判断是否继续的循环（p为基本归纳变量，N在循环内不变）
+// 次数为常量且展开后不超过预算时完全展开；否则按预算选择展开因子，展开后的循环每次执行factor次迭代，
+// 剩余的迭代交给原循环（余数循环）完成
+namespace
+{
+    const int MAX_UNROLL_FACTOR = 8;
+
+    class LoopUnroller
+    {
+    public:
+        LoopUnroller(IRFunction &func, int budget) : func(func), budget(budget) {}
+
+        bool run(LoopInfo &loops)
+        {
+            bool changed = false;
+            for (auto loop : loops.innermostFirst())
+            {
+                if (loop->children.empty())
+                    changed |= unroll(*loop);
+            }
+            return changed;
+        }
+
+    private:
+        IRFunction &func;
+        int budget;
+
+        // 展开需要的循环信息
+        struct CountedLoop
+        {
+            IRBinOp cmp;        // 规范化为 cmp p, bound
+            IRValue *bound;
+            const InductionVar *iv;
+            int64_t trip;       // 常量迭代次数，未知为-1
+        };
+
+        bool isInvariant(Loop &loop, IRValue *v)
+        {
+            if (!v->parent)
+                return v->kind != IR_BLOCK_ARG;
+            return !loop.contains(v->parent);
+        }
+
+        // 计算常量迭代次数
+        int64_t getTripCount(IRBinOp cmp, int64_t init, int64_t bound, int64_t step)
+        {
+            switch (cmp)
+            {
+            case IR_LT:
+                return init < bound ? (bound - init + step - 1) / step : 0;
+            case IR_LE:
+                return init <= bound ? (bound - init) / step + 1 : 0;
+            case IR_GT:
+                return init > bound ? (init - bound - step - 1) / -step : 0;
+            case IR_GE:
+                return init >= bound ? (init - bound) / -step + 1 : 0;
+            default:
+                return -1;
+            }
+        }
+
+        bool analyze(Loop &loop, const vector<InductionVar> &ivs, CountedLoop &info)
+        {
+            IRValue *term = loop.header->terminator();
+            if (!term || term->kind != IR_BRANCH)
+                return false;
+            // 真分支留在循环内，假分支是循环唯一的出口
+            if (!loop.contains(term->targets[0]) || loop.contains(term->targets[1]))
+                return false;
+            for (auto bb : loop.blocks)
+            {
+                for (auto succ : bb->succs)
+                {
+                    if (!loop.contains(succ) && !(bb == loop.header && succ == term->targets[1]))
+                        return false;
+                }
+                for (auto inst : bb->insts)
+                {
+                    // 复制alloc会得到不同的变量
+                    if (inst->kind == IR_ALLOC)
+                        return false;
+                }
+            }
+
+            IRValue *cond = term->ops[0];
+            if (cond->kind != IR_BINARY)
+                return false;
+            IRBinOp cmp = cond->op;
+            IRValue *lhs = cond->ops[0], *rhs = cond->ops[1];
+            if (cmp != IR_LT && cmp != IR_LE && cmp != IR_GT && cmp != IR_GE)
+                return false;
+            if (!isInvariant(loop, rhs))
+            {
+                // N > p 即 p < N
+                static const IRBinOp swapped[] = {IR_NE, IR_EQ, IR_LT, IR_GT, IR_LE, IR_GE};
+                cmp = swapped[cmp];
+                swap(lhs, rhs);
+            }
+            if (!isInvariant(loop, rhs))
+                return false;
+            for (auto &iv : ivs)
+            {
+                if (lhs != iv.param)
+                    continue;
+                bool up = cmp == IR_LT || cmp == IR_LE;
+                if (up != (iv.step > 0))
+                    return false;
+                info.cmp = cmp;
+                info.bound = rhs;
+                info.iv = &iv;
+                info.trip = -1;
+                if (iv.init->kind == IR_INT && rhs->kind == IR_INT)
+                    info.trip = getTripCount(cmp, iv.init->imm, rhs->imm, iv.step);
+                return true;
+            }
+            return false;
+        }
+
+        IRValue *emitBinary(IRBlock *bb, IRBinOp op, IRValue *lhs, IRValue *rhs)
+        {
+            int32_t val;
+            if (lhs->kind == IR_INT && rhs->kind == IR_INT && foldBinOp(op, lhs->imm, rhs->imm, val))
+                return func.getInt(val);
+            IRValue *inst = func.newValue(IR_BINARY);
+            inst->op = op;
+            inst->ops = {lhs, rhs};
+            inst->hasResult = true;
+            inst->parent = bb;
+            if (bb->terminator())
+                bb->insts.insert(bb->insts.end() - 1, inst);
+            else
+                bb->insts.push_back(inst);
+            return inst;
+        }
+
+        IRBlock *newBlockWithParams(const string &hint, size_t n)
+        {
+            IRBlock *bb = func.newBlock(hint);
+            for (size_t i = 0; i < n; ++i)
+            {
+                IRValue *param = func.newValue(IR_BLOCK_ARG);
+                param->hasResult = true;
+                param->parent = bb;
+                bb->params.push_back(param);
+            }
+            return bb;
+        }
+
+        IRValue *newJump(IRBlock *bb, IRBlock *target, const vector<IRValue *> &args)
+        {
+            IRValue *jump = func.newValue(IR_JUMP);
+            jump->parent = bb;
+            jump->targets = {target};
+            jump->args = {args};
+            bb->insts.push_back(jump);
+            return jump;
+        }
+
+        // 复制一次迭代：header复制为entry（参数与header对应），回边改为跳向next
+        // 复制的header不再判断条件，直接进入循环体
+        void cloneIteration(Loop &loop, IRBlock *entry, IRBlock *next, vector<IRBlock *> &created)
+        {
+            unordered_map<IRValue *, IRValue *> vmap;
+            unordered_map<IRBlock *, IRBlock *> bmap;
+            for (size_t i = 0; i < loop.header->params.size(); ++i)
+                vmap[loop.header->params[i]] = entry->params[i];
+            bmap[loop.header] = entry;
+            created.push_back(entry);
+            for (auto bb : loop.blocks)
+            {
+                if (bb == loop.header)
+                    continue;
+                string hint = bb->name.substr(1);
+                IRBlock *nb = newBlockWithParams(hint, bb->params.size());
+                for (size_t i = 0; i < bb->params.size(); ++i)
+                    vmap[bb->params[i]] = nb->params[i];
+                bmap[bb] = nb;
+                created.push_back(nb);
+            }
+            auto mapValue = [&](IRValue *v)
+            {
+                auto it = vmap.find(v);
+                return it == vmap.end() ? v : it->second;
+            };
+
+            IRValue *header_term = loop.header->terminator();
+            for (auto bb : loop.blocks)
+            {
+                IRBlock *nb = bmap[bb];
+                for (auto inst : bb->insts)
+                {
+                    if (inst == header_term)
+                    {
+                        vector<IRValue *> args;
+                        for (auto arg : inst->args[0])
+                            args.push_back(mapValue(arg));
+                        newJump(nb, bmap[inst->targets[0]], args);
+                        continue;
+                    }
+                    IRValue *copy = func.newValue(inst->kind);
+                    copy->op = inst->op;
+                    copy->imm = inst->imm;
+                    copy->name = inst->name;
+                    copy->hasResult = inst->hasResult;
+                    copy->callee = inst->callee;
+                    copy->parent = nb;
+                    for (auto op : inst->ops)
+                        copy->ops.push_back(mapValue(op));
+                    for (auto target : inst->targets)
+                        copy->targets.push_back(target == loop.header ? next : bmap[target]);
+                    for (auto &list : inst->args)
+                    {
+                        copy->args.emplace_back();
+                        for (auto arg : list)
+                            copy->args.back().push_back(mapValue(arg));
+                    }
+                    vmap[inst] = copy;
+                    nb->insts.push_back(copy);
+                }
+            }
+        }
+
+        bool unroll(Loop &loop)
+        {
+            vector<InductionVar> ivs = findInductionVars(loop);
+            CountedLoop info;
+            if (ivs.empty() || !analyze(loop, ivs, info))
+                return false;
+            int64_t size = 0;
+            for (auto bb : loop.blocks)
+                size += bb->insts.size();
+            if (!size)
+                return false;
+
+            // 完全展开：次数已知且总大小在预算内
+            bool full = info.trip > 0 && info.trip * size <= budget;
+            int64_t factor = full ? info.trip : min<int64_t>(MAX_UNROLL_FACTOR, budget / size);
+            if (!full && info.trip >= 0)
+                factor = min(factor, info.trip);
+            if (!full && factor < 2)
+                return false;
+            // 部分展开的保护条件 p + (factor-1)*step cmp N 改写为 p cmp N - (factor-1)*step，不能溢出
+            int64_t delta = (factor - 1) * (int64_t)info.iv->step;
+            if (!full && (delta > INT32_MAX || delta < INT32_MIN))
+                return false;
+
+            IRBlock *pre = insertPreheader(func, loop);
+            IREdge entry, latch;
+            getLoopEdges(loop, entry, latch);
+            size_t nparams = loop.header->params.size();
+            vector<IRBlock *> created;
+            vector<IRBlock *> copies;
+            for (int64_t k = 0; k < factor; ++k)
+                copies.push_back(newBlockWithParams("unroll_body", nparams));
+
+            IRBlock *after;
+            if (full)
+            {
+                // 预头 -> 各次迭代 -> 原循环（条件为假，由常量传播删除）
+                entry.first->targets[entry.second] = copies[0];
+                after = loop.header;
+            }
+            else
+            {
+                // 预头 -> 展开的循环头：还能执行factor次时进入展开的迭代，否则进入原循环
+                IRBlock *guard = newBlockWithParams("unroll", nparams);
+                IRValue *lim = emitBinary(pre, IR_SUB, info.bound, func.getInt((int32_t)delta));
+                IRValue *valid = emitBinary(pre, delta > 0 ? IR_LT : IR_GT, lim, info.bound);
+                IRValue *cond = emitBinary(guard, info.cmp, guard->params[info.iv->index], lim);
+                if (!(valid->kind == IR_INT && valid->imm))
+                    cond = emitBinary(guard, IR_AND, cond, valid);
+                IRValue *br = func.newValue(IR_BRANCH);
+                br->parent = guard;
+                br->ops = {cond};
+                br->targets = {copies[0], loop.header};
+                br->args = {guard->params, guard->params};
+                guard->insts.push_back(br);
+                entry.first->targets[entry.second] = guard;
+                created.push_back(guard);
+                after = guard;
+            }
+            for (int64_t k = 0; k < factor; ++k)
+                cloneIteration(loop, copies[k], k + 1 < factor ? copies[k + 1] : after, created);
+
+            auto pos = find(func.blocks.begin(), func.blocks.end(), loop.header);
+            func.blocks.insert(pos, created.begin(), created.end());
+            func.buildCFG();
+            return true;
+        }
+    };
+}
+
+bool LoopUnroll(IRFunction &func, AnalysisManager &am, int budget)
+{
+    LoopUnroller unroller(func, budget);
+    return unroller.run(am.getLoopInfo(func));
+}